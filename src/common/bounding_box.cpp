@@ -23,6 +23,7 @@
 
 #include <limits>
 #include <glm/common.hpp>
+#include <glm/vec4.hpp>
 
 namespace kuu
 {
@@ -93,6 +94,25 @@ std::vector<glm::vec3> BoundingBox::corners() const
     return out;
 }
 
+BoundingBox BoundingBox::transformed(const glm::mat4& m) const
+{
+    // Extents of the transformed box are the projections of the original
+    // extents onto the target axes (Arvo).
+    const glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+    const glm::vec3 e = size() * 0.5f;
+
+    glm::vec3 extent;
+    for (int i = 0; i < 3; ++i)
+        extent[i] = glm::abs(m[0][i]) * e.x +
+                    glm::abs(m[1][i]) * e.y +
+                    glm::abs(m[2][i]) * e.z;
+
+    BoundingBox out;
+    out.setMinimum(c - extent);
+    out.setMaximum(c + extent);
+    return out;
+}
+
 void BoundingBox::reset()
 {
     min_ = glm::vec3(
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
 #include <vector>
 
 namespace kuu
@@ -92,6 +93,14 @@ public:
      **/
     std::vector<glm::vec3> corners() const;
 
+    /**
+        Returns the bounding box of this box transformed with the matrix.
+        The returned box is axis-aligned in the target space.
+        \param m The affine transform matrix.
+        \return The transformed bounding box.
+     **/
+    BoundingBox transformed(const glm::mat4& m) const;
+
     /**
         Resets the bounding box. The box is now infinite.
      **/
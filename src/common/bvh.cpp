@@ -0,0 +1,512 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::Bvh class.
+ * -------------------------------------------------------------------------- */
+
+#include "bvh.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <limits>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include "frustum.h"
+#include "ray.h"
+
+namespace kuu
+{
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Count of SAH bins per axis.
+const int BIN_COUNT = 16;
+// Leaves are not split below this size if splitting does not pay off.
+const uint32_t MAX_LEAF_SIZE = 4;
+// Cost of traversing a node relative to testing an item.
+const float TRAVERSAL_COST = 1.0f;
+// Subtrees larger than this are built in their own task.
+const uint32_t TASK_SIZE = 1024;
+
+// Frustum classes of a box.
+const int OUTSIDE   = 0;
+const int INSIDE    = 1;
+const int INTERSECT = 2;
+
+/* -------------------------------------------------------------------------- */
+
+bool overlaps(const BoundingBox& a, const BoundingBox& b)
+{
+    const glm::vec3 aMin = a.minimum(), aMax = a.maximum();
+    const glm::vec3 bMin = b.minimum(), bMax = b.maximum();
+    return aMin.x <= bMax.x && aMax.x >= bMin.x &&
+           aMin.y <= bMax.y && aMax.y >= bMin.y &&
+           aMin.z <= bMax.z && aMax.z >= bMin.z;
+}
+
+int classify(const std::vector<glm::vec4>& planes, const BoundingBox& bb)
+{
+    const glm::vec3 c = bb.center();
+    const glm::vec3 e = bb.size() * 0.5f;
+
+    int out = INSIDE;
+    for (const glm::vec4& p : planes)
+    {
+        const glm::vec3 n = glm::vec3(p);
+        const float dist   = glm::dot(n, c) + p.w;
+        const float radius = glm::dot(glm::abs(n), e);
+        if (dist + radius < 0.0f)
+            return OUTSIDE;
+        if (dist - radius < 0.0f)
+            out = INTERSECT;
+    }
+    return out;
+}
+
+// Slab test, returns the entry distance of the ray into the box.
+bool hit(const glm::vec3& start,
+         const glm::vec3& invDir,
+         const BoundingBox& bb,
+         float& distance)
+{
+    const glm::vec3 t1 = (bb.minimum() - start) * invDir;
+    const glm::vec3 t2 = (bb.maximum() - start) * invDir;
+    const glm::vec3 tMin = glm::min(t1, t2);
+    const glm::vec3 tMax = glm::max(t1, t2);
+
+    const float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+    const float exit  = std::min(std::min(tMax.x, tMax.y), tMax.z);
+    if (exit < enter)
+        return false;
+
+    distance = enter;
+    return true;
+}
+
+// Bounds used while building, kept inline as the build grows them for
+// every item of every node.
+struct Bounds
+{
+    void grow(const glm::vec3& p)
+    {
+        minimum = glm::min(minimum, p);
+        maximum = glm::max(maximum, p);
+    }
+
+    void grow(const Bounds& b)
+    {
+        minimum = glm::min(minimum, b.minimum);
+        maximum = glm::max(maximum, b.maximum);
+    }
+
+    float area() const
+    {
+        const glm::vec3 s = maximum - minimum;
+        return 2.0f * (s.x * s.y + s.y * s.z + s.z * s.x);
+    }
+
+    glm::vec3 minimum = glm::vec3( std::numeric_limits<float>::max());
+    glm::vec3 maximum = glm::vec3(-std::numeric_limits<float>::max());
+};
+
+struct Bin
+{
+    Bounds bounds;
+    uint32_t count = 0;
+};
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- *
+   An item box and its centroid while building. Build items are partitioned
+   in place so that the items of a node are contiguous in memory.
+ * -------------------------------------------------------------------------- */
+struct Bvh::BuildItem
+{
+    Bounds bounds;
+    glm::vec3 centroid;
+    uint32_t item;
+};
+
+/* -------------------------------------------------------------------------- */
+
+void Bvh::build(const std::vector<BoundingBox>& bbs)
+{
+    boxes = bbs;
+
+    const uint32_t count = uint32_t(boxes.size());
+    items.resize(count);
+    leaves.assign(count, 0);
+    nodes.assign(std::max(2 * count, 1u), Node());
+
+    std::vector<BuildItem> buildItems(count);
+    #pragma omp parallel for
+    for (int i = 0; i < int(count); ++i)
+    {
+        buildItems[i].bounds.minimum = boxes[i].minimum();
+        buildItems[i].bounds.maximum = boxes[i].maximum();
+        buildItems[i].centroid       = boxes[i].center();
+        buildItems[i].item           = uint32_t(i);
+    }
+
+    nodes[0].count = count;
+
+    std::atomic<uint32_t> nodeCount(1);
+    #pragma omp parallel
+    #pragma omp single
+    buildNode(0, &buildItems, &nodeCount);
+
+    nodes.resize(nodeCount);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void Bvh::buildNode(uint32_t node,
+                    std::vector<BuildItem>* buildItems,
+                    std::atomic<uint32_t>* nodeCount)
+{
+    Node& n = nodes[node];
+    const uint32_t begin = n.first;
+    const uint32_t end   = n.first + n.count;
+    BuildItem* in        = buildItems->data();
+
+    Bounds bounds;
+    Bounds centroidBounds;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        bounds.grow(in[i].bounds);
+        centroidBounds.grow(in[i].centroid);
+    }
+    n.bounds.setMinimum(bounds.minimum);
+    n.bounds.setMaximum(bounds.maximum);
+
+    // Bin the items of all axes in a single pass over the items.
+    Bin bins[3][BIN_COUNT];
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float extent = centroidBounds.maximum[axis] - centroidBounds.minimum[axis];
+        scale[axis] = extent > 0.0f ? BIN_COUNT / extent : 0.0f;
+    }
+
+    for (uint32_t i = begin; i < end && n.count > 1; ++i)
+    {
+        const BuildItem& item = in[i];
+        const glm::vec3 b = (item.centroid - centroidBounds.minimum) * scale;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            Bin& bin = bins[axis][std::min(int(b[axis]), BIN_COUNT - 1)];
+            bin.bounds.grow(item.bounds);
+            bin.count++;
+        }
+    }
+
+    // Find the cheapest split plane among the bin borders of all axes.
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis   = -1;
+    int bestSplit  = 0;
+    for (int axis = 0; axis < 3 && n.count > 1; ++axis)
+    {
+        if (scale[axis] == 0.0f)
+            continue;
+
+        float rightArea[BIN_COUNT];
+        uint32_t rightCount[BIN_COUNT];
+        Bounds right;
+        uint32_t count = 0;
+        for (int b = BIN_COUNT - 1; b > 0; --b)
+        {
+            right.grow(bins[axis][b].bounds);
+            count += bins[axis][b].count;
+            rightArea[b]  = count ? right.area() : 0.0f;
+            rightCount[b] = count;
+        }
+
+        Bounds left;
+        count = 0;
+        for (int b = 0; b < BIN_COUNT - 1; ++b)
+        {
+            left.grow(bins[axis][b].bounds);
+            count += bins[axis][b].count;
+            if (count == 0 || rightCount[b + 1] == 0)
+                continue;
+
+            const float cost = count * left.area() +
+                               rightCount[b + 1] * rightArea[b + 1];
+            if (cost < bestCost)
+            {
+                bestCost  = cost;
+                bestAxis  = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    uint32_t middle = begin;
+    if (bestAxis >= 0)
+    {
+        const float nodeArea  = bounds.area();
+        const float splitCost = nodeArea > 0.0f
+                              ? TRAVERSAL_COST + bestCost / nodeArea
+                              : 0.0f;
+        if (n.count > MAX_LEAF_SIZE || splitCost < float(n.count))
+        {
+            const float minimum = centroidBounds.minimum[bestAxis];
+            const float s       = scale[bestAxis];
+            middle = uint32_t(std::partition(
+                in + begin,
+                in + end,
+                [&](const BuildItem& item)
+                {
+                    const float c = item.centroid[bestAxis];
+                    return std::min(int((c - minimum) * s), BIN_COUNT - 1) <= bestSplit;
+                }) - in);
+        }
+    }
+    else if (n.count > MAX_LEAF_SIZE)
+    {
+        // All the centroids are at the same point.
+        middle = begin + n.count / 2;
+    }
+
+    if (middle == begin || middle == end)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            items[i] = in[i].item;
+            leaves[in[i].item] = node;
+        }
+        return;
+    }
+
+    const uint32_t left = nodeCount->fetch_add(2);
+    n.left = left;
+
+    nodes[left].parent     = node;
+    nodes[left].first      = begin;
+    nodes[left].count      = middle - begin;
+    nodes[left + 1].parent = node;
+    nodes[left + 1].first  = middle;
+    nodes[left + 1].count  = end - middle;
+
+    if (n.count > TASK_SIZE)
+    {
+        #pragma omp task firstprivate(left, buildItems, nodeCount)
+        buildNode(left, buildItems, nodeCount);
+    }
+    else
+    {
+        buildNode(left, buildItems, nodeCount);
+    }
+    buildNode(left + 1, buildItems, nodeCount);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void Bvh::refitNode(uint32_t node)
+{
+    Node& n = nodes[node];
+    n.bounds.reset();
+    if (n.left)
+    {
+        n.bounds.update(nodes[n.left].bounds);
+        n.bounds.update(nodes[n.left + 1].bounds);
+        return;
+    }
+
+    for (uint32_t i = n.first; i < n.first + n.count; ++i)
+        n.bounds.update(boxes[items[i]]);
+}
+
+void Bvh::update(uint32_t item, const BoundingBox& bb)
+{
+    boxes[item] = bb;
+
+    uint32_t node = leaves[item];
+    while (true)
+    {
+        refitNode(node);
+        if (node == 0)
+            break;
+        node = nodes[node].parent;
+    }
+}
+
+void Bvh::refit(const std::vector<BoundingBox>& bbs)
+{
+    boxes = bbs;
+
+    // Children are always after their parent.
+    for (size_t i = nodes.size(); i-- > 0;)
+        refitNode(uint32_t(i));
+}
+
+/* -------------------------------------------------------------------------- */
+
+size_t Bvh::size() const
+{ return boxes.size(); }
+
+BoundingBox Bvh::bounds() const
+{ return nodes.size() ? nodes[0].bounds : BoundingBox(); }
+
+/* -------------------------------------------------------------------------- */
+
+void Bvh::query(const Frustum& frustum, std::vector<uint32_t>& out) const
+{
+    if (boxes.empty())
+        return;
+
+    const std::vector<glm::vec4> planes = frustum.planes();
+
+    std::vector<uint32_t> stack(1, 0);
+    while (stack.size())
+    {
+        const Node& n = nodes[stack.back()];
+        stack.pop_back();
+
+        const int c = classify(planes, n.bounds);
+        if (c == OUTSIDE)
+            continue;
+
+        // Subtree items are contiguous, a node inside the frustum does not
+        // need to be traversed.
+        if (c == INSIDE)
+        {
+            out.insert(out.end(),
+                       items.begin() + n.first,
+                       items.begin() + n.first + n.count);
+            continue;
+        }
+
+        if (n.left)
+        {
+            stack.push_back(n.left);
+            stack.push_back(n.left + 1);
+            continue;
+        }
+
+        for (uint32_t i = n.first; i < n.first + n.count; ++i)
+            if (classify(planes, boxes[items[i]]) != OUTSIDE)
+                out.push_back(items[i]);
+    }
+}
+
+void Bvh::query(const BoundingBox& bb, std::vector<uint32_t>& out) const
+{
+    if (boxes.empty())
+        return;
+
+    std::vector<uint32_t> stack(1, 0);
+    while (stack.size())
+    {
+        const Node& n = nodes[stack.back()];
+        stack.pop_back();
+
+        if (!overlaps(n.bounds, bb))
+            continue;
+
+        if (n.left)
+        {
+            stack.push_back(n.left);
+            stack.push_back(n.left + 1);
+            continue;
+        }
+
+        for (uint32_t i = n.first; i < n.first + n.count; ++i)
+            if (overlaps(boxes[items[i]], bb))
+                out.push_back(items[i]);
+    }
+}
+
+void Bvh::query(const Ray& ray, std::vector<uint32_t>& out) const
+{
+    if (boxes.empty())
+        return;
+
+    const glm::vec3 start  = ray.start();
+    const glm::vec3 invDir = 1.0f / ray.direction();
+
+    std::vector<uint32_t> stack(1, 0);
+    while (stack.size())
+    {
+        const Node& n = nodes[stack.back()];
+        stack.pop_back();
+
+        float distance;
+        if (!hit(start, invDir, n.bounds, distance))
+            continue;
+
+        if (n.left)
+        {
+            stack.push_back(n.left);
+            stack.push_back(n.left + 1);
+            continue;
+        }
+
+        for (uint32_t i = n.first; i < n.first + n.count; ++i)
+            if (hit(start, invDir, boxes[items[i]], distance))
+                out.push_back(items[i]);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+bool Bvh::intersect(const Ray& ray, uint32_t& item, float& distance) const
+{
+    if (boxes.empty())
+        return false;
+
+    const glm::vec3 start  = ray.start();
+    const glm::vec3 invDir = 1.0f / ray.direction();
+
+    float nearest = std::numeric_limits<float>::max();
+    bool found = false;
+
+    std::vector<uint32_t> stack(1, 0);
+    while (stack.size())
+    {
+        const Node& n = nodes[stack.back()];
+        stack.pop_back();
+
+        float d;
+        if (!hit(start, invDir, n.bounds, d) || d >= nearest)
+            continue;
+
+        if (n.left)
+        {
+            // Visit the nearer child first to prune the farther one.
+            float dl = std::numeric_limits<float>::max();
+            float dr = std::numeric_limits<float>::max();
+            const bool hl = hit(start, invDir, nodes[n.left].bounds,     dl);
+            const bool hr = hit(start, invDir, nodes[n.left + 1].bounds, dr);
+            if (hl && hr)
+            {
+                stack.push_back(dl < dr ? n.left + 1 : n.left);
+                stack.push_back(dl < dr ? n.left     : n.left + 1);
+            }
+            else if (hl)
+                stack.push_back(n.left);
+            else if (hr)
+                stack.push_back(n.left + 1);
+            continue;
+        }
+
+        for (uint32_t i = n.first; i < n.first + n.count; ++i)
+        {
+            if (hit(start, invDir, boxes[items[i]], d) && d < nearest)
+            {
+                nearest = d;
+                item    = items[i];
+                found   = true;
+            }
+        }
+    }
+
+    if (found)
+        distance = nearest;
+    return found;
+}
+
+} // namespace kuu
@@ -0,0 +1,84 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::Bvh class.
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "bounding_box.h"
+
+namespace kuu
+{
+
+/* -------------------------------------------------------------------------- */
+
+class Frustum;
+class Ray;
+
+/* -------------------------------------------------------------------------- *
+   A bounding volume hierarchy of axis-aligned boxes. An item is the index of
+   the box in the vector given to build. The hierarchy is built with binned
+   surface area heuristic, the subtrees are built in parallel.
+ * -------------------------------------------------------------------------- */
+class Bvh
+{
+public:
+    // Builds the hierarchy over the boxes.
+    void build(const std::vector<BoundingBox>& boxes);
+
+    // Sets the box of the item and refits the nodes above it. The
+    // hierarchy is not rebuilt, moving items degrades the query speed.
+    void update(uint32_t item, const BoundingBox& bb);
+    // Sets the boxes of all the items and refits all the nodes.
+    void refit(const std::vector<BoundingBox>& boxes);
+
+    // Returns the count of items.
+    size_t size() const;
+    // Returns the bounds of all the items.
+    BoundingBox bounds() const;
+
+    // Appends the items whose boxes intersect the frustum.
+    void query(const Frustum& frustum, std::vector<uint32_t>& out) const;
+    // Appends the items whose boxes intersect the box.
+    void query(const BoundingBox& bb, std::vector<uint32_t>& out) const;
+    // Appends the items whose boxes the ray hits.
+    void query(const Ray& ray, std::vector<uint32_t>& out) const;
+
+    // Returns the item whose box the ray hits first and the distance along
+    // the ray to the box. Returns false if the ray does not hit any box.
+    bool intersect(const Ray& ray, uint32_t& item, float& distance) const;
+
+private:
+    // Triangle hierarchies are collapsed from the binary hierarchy.
+    friend class MeshBvh;
+
+    // A node with the item range of its subtree. Children are next to each
+    // other, the left child of a leaf is zero as root is nobody's child.
+    struct Node
+    {
+        BoundingBox bounds;
+        uint32_t left   = 0;
+        uint32_t parent = 0;
+        uint32_t first  = 0;
+        uint32_t count  = 0;
+    };
+
+    struct BuildItem;
+    void buildNode(uint32_t node,
+                   std::vector<BuildItem>* buildItems,
+                   std::atomic<uint32_t>* nodeCount);
+    void refitNode(uint32_t node);
+
+    std::vector<Node> nodes;
+    std::vector<BoundingBox> boxes;
+    // Items in the order of leaves and the leaf of each item.
+    std::vector<uint32_t> items;
+    std::vector<uint32_t> leaves;
+};
+
+} // namespace kuu
@@ -25,6 +25,8 @@
 //#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/trigonometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/geometric.hpp>
 #include <iostream>
 
 #include "bounding_box.h"
@@ -49,6 +51,51 @@ Frustum::Frustum(const Camera& camera, const glm::vec4& viewport)
     corners_.push_back(projector.unproject(w,    0.0f, 1.0f));
     corners_.push_back(projector.unproject(0.0f, h,    1.0f));
     corners_.push_back(projector.unproject(w,    h,    1.0f));
+
+    extractPlanes(camera.cameraMatrix());
+}
+
+Frustum::Frustum(const glm::mat4& matrix)
+{
+    const glm::mat4 inv = glm::inverse(matrix);
+    for (int z = 0; z < 2; ++z)
+    for (int y = 0; y < 2; ++y)
+    for (int x = 0; x < 2; ++x)
+    {
+        const glm::vec4 p = inv * glm::vec4(x * 2.0f - 1.0f,
+                                            y * 2.0f - 1.0f,
+                                            float(z),
+                                            1.0f);
+        corners_.push_back(glm::vec3(p) / p.w);
+    }
+
+    extractPlanes(matrix);
+}
+
+std::vector<glm::vec4> Frustum::planes() const
+{
+    return planes_;
+}
+
+void Frustum::extractPlanes(const glm::mat4& m)
+{
+    // Gribb-Hartmann, the near plane is z >= 0 as the depth is mapped from
+    // 0 to 1.
+    const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes_.clear();
+    planes_.push_back(row3 + row0); // left
+    planes_.push_back(row3 - row0); // right
+    planes_.push_back(row3 + row1); // bottom
+    planes_.push_back(row3 - row1); // top
+    planes_.push_back(row2);        // near
+    planes_.push_back(row3 - row2); // far
+
+    for (glm::vec4& p : planes_)
+        p /= glm::length(glm::vec3(p));
 }
 
 std::vector<glm::vec3> Frustum::corners() const
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 #include <memory>
 #include <vector>
@@ -44,6 +45,21 @@ public:
     Frustum(const Camera& camera,
             const glm::vec4& viewport);
 
+    /**
+       Creates the frustum of a view-projection matrix. The matrix must map
+       the depth from 0 to 1 (Vulkan mapping).
+       \param matrix The view-projection matrix.
+     **/
+    explicit Frustum(const glm::mat4& matrix);
+
+    /**
+        Returns the frustum planes: left, right, bottom, top, near and far.
+        The plane normals are unit length and point into the frustum, a point
+        p is inside the plane if dot(plane.xyz, p) + plane.w >= 0.
+        \return The planes of the frustum.
+     **/
+    std::vector<glm::vec4> planes() const;
+
     /**
         Returns the frustum corners.
         \return The corners of the frustum.
@@ -90,7 +106,10 @@ public:
         const float distance, const float nearClipOffset) const;
 
 private:
+    void extractPlanes(const glm::mat4& matrix);
+
     std::vector<glm::vec3> corners_;
+    std::vector<glm::vec4> planes_;
 };
 
 } // namespace kuu
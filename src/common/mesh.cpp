@@ -4,7 +4,9 @@
  * -------------------------------------------------------------------------- */
 
 #include "mesh.h"
+#include <atomic>
 #include <glm/geometric.hpp>
+#include "mesh_bvh.h"
 
 namespace kuu
 {
@@ -13,6 +15,7 @@ void Mesh::addVertex(const Vertex& v)
 {
     indices.push_back(unsigned int(vertices.size()));
     vertices.push_back(v);
+    invalidateBvh();
 }
 
 void Mesh::addTriangle(const Vertex& a,
@@ -74,6 +77,30 @@ void Mesh::generateTangents()
     }
 }
 
+BoundingBox Mesh::boundingBox() const
+{
+    BoundingBox bb;
+    for (const Vertex& v : vertices)
+        bb.update(v.pos);
+    return bb;
+}
+
+std::shared_ptr<const MeshBvh> Mesh::triangleBvh() const
+{
+    std::shared_ptr<const MeshBvh> current = std::atomic_load(&bvh);
+    if (!current)
+    {
+        current = std::make_shared<MeshBvh>(*this);
+        std::atomic_store(&bvh, current);
+    }
+    return current;
+}
+
+void Mesh::invalidateBvh()
+{
+    std::atomic_store(&bvh, std::shared_ptr<const MeshBvh>());
+}
+
 std::shared_ptr<Mesh> createBox(float width, float height, float depth)
 {
     float bw = width  / 2.0f;
@@ -9,10 +9,13 @@
 #include <vector>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include "bounding_box.h"
 
 namespace kuu
 {
 
+class MeshBvh;
+
 /* -------------------------------------------------------------------------- *
    A vertex.
  * -------------------------------------------------------------------------- */
@@ -42,9 +45,20 @@ struct Mesh
             const Vertex& c,
             const Vertex& d);
     void generateTangents();
+    // Returns the object space bounds of the vertices.
+    BoundingBox boundingBox() const;
+    // Returns the triangle hierarchy for ray picking. The hierarchy is built
+    // on the first call, call invalidateBvh if the vertices or indices are
+    // changed directly. This is thread-safe, concurrent first calls might
+    // build the hierarchy more than once.
+    std::shared_ptr<const MeshBvh> triangleBvh() const;
+    void invalidateBvh();
 
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
+
+    // Cached triangle hierarchy.
+    mutable std::shared_ptr<const MeshBvh> bvh;
 };
 
 std::shared_ptr<Mesh> createBox(float width, float height, float depth);
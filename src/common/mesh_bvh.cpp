@@ -0,0 +1,302 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::MeshBvh class.
+ * -------------------------------------------------------------------------- */
+
+#include "mesh_bvh.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "bvh.h"
+#include "mesh.h"
+#include "ray.h"
+
+namespace kuu
+{
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Child index of unused children.
+const uint32_t NO_CHILD = std::numeric_limits<uint32_t>::max();
+// Distance of a miss.
+const float MISS = std::numeric_limits<float>::infinity();
+
+float surfaceArea(const BoundingBox& bb)
+{
+    const glm::vec3 s = bb.size();
+    return 2.0f * (s.x * s.y + s.y * s.z + s.z * s.x);
+}
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- */
+
+MeshBvh::MeshBvh(const Mesh& mesh)
+{
+    triangles = mesh.indices.size() / 3;
+    if (triangles == 0)
+        return;
+
+    std::vector<BoundingBox> boxes(triangles);
+    #pragma omp parallel for
+    for (int i = 0; i < int(triangles); ++i)
+    {
+        boxes[i].update(mesh.vertices[mesh.indices[3 * i + 0]].pos);
+        boxes[i].update(mesh.vertices[mesh.indices[3 * i + 1]].pos);
+        boxes[i].update(mesh.vertices[mesh.indices[3 * i + 2]].pos);
+    }
+
+    Bvh bvh;
+    bvh.build(boxes);
+
+    nodes.reserve(bvh.nodes.size() / 3 + 1);
+    packets.reserve(triangles / 3 + 1);
+    collapse(bvh, mesh, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+
+uint32_t MeshBvh::collapse(const Bvh& bvh, const Mesh& mesh, uint32_t binaryNode)
+{
+    const uint32_t index = uint32_t(nodes.size());
+    nodes.push_back(Node());
+
+    // Children of the binary node are opened, largest first, until there
+    // are four of them.
+    uint32_t slots[4];
+    int slotCount = 0;
+    if (bvh.nodes[binaryNode].left)
+    {
+        slots[slotCount++] = bvh.nodes[binaryNode].left;
+        slots[slotCount++] = bvh.nodes[binaryNode].left + 1;
+    }
+    else
+    {
+        slots[slotCount++] = binaryNode;
+    }
+
+    while (slotCount < 4)
+    {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (int i = 0; i < slotCount; ++i)
+        {
+            const Bvh::Node& n = bvh.nodes[slots[i]];
+            if (n.left && surfaceArea(n.bounds) > largestArea)
+            {
+                largest     = i;
+                largestArea = surfaceArea(n.bounds);
+            }
+        }
+        if (largest < 0)
+            break;
+
+        const uint32_t left  = bvh.nodes[slots[largest]].left;
+        slots[largest]       = left;
+        slots[slotCount++]   = left + 1;
+    }
+
+    Node node;
+    for (int i = 0; i < 4; ++i)
+    {
+        node.minX[i] = node.minY[i] = node.minZ[i] = 0.0f;
+        node.maxX[i] = node.maxY[i] = node.maxZ[i] = 0.0f;
+        node.child[i]       = NO_CHILD;
+        node.packetCount[i] = 0;
+    }
+
+    for (int i = 0; i < slotCount; ++i)
+    {
+        const Bvh::Node& n = bvh.nodes[slots[i]];
+        const glm::vec3 minimum = n.bounds.minimum();
+        const glm::vec3 maximum = n.bounds.maximum();
+        node.minX[i] = minimum.x; node.minY[i] = minimum.y; node.minZ[i] = minimum.z;
+        node.maxX[i] = maximum.x; node.maxY[i] = maximum.y; node.maxZ[i] = maximum.z;
+
+        if (n.left)
+            node.child[i] = collapse(bvh, mesh, slots[i]);
+        else
+            addLeaf(bvh, mesh, slots[i], node, i);
+    }
+
+    nodes[index] = node;
+    return index;
+}
+
+void MeshBvh::addLeaf(const Bvh& bvh,
+                      const Mesh& mesh,
+                      uint32_t binaryNode,
+                      Node& node,
+                      int slot)
+{
+    const Bvh::Node& n = bvh.nodes[binaryNode];
+    node.child[slot]       = uint32_t(packets.size());
+    node.packetCount[slot] = (n.count + 3) / 4;
+
+    for (uint32_t first = n.first; first < n.first + n.count; first += 4)
+    {
+        Packet p = {};
+        for (uint32_t lane = 0; lane < 4; ++lane)
+        {
+            p.triangle[lane] = NO_CHILD;
+            if (first + lane >= n.first + n.count)
+                continue;
+
+            const uint32_t t = bvh.items[first + lane];
+            const glm::vec3 v0 = mesh.vertices[mesh.indices[3 * t + 0]].pos;
+            const glm::vec3 e1 = mesh.vertices[mesh.indices[3 * t + 1]].pos - v0;
+            const glm::vec3 e2 = mesh.vertices[mesh.indices[3 * t + 2]].pos - v0;
+            p.v0X[lane] = v0.x; p.v0Y[lane] = v0.y; p.v0Z[lane] = v0.z;
+            p.e1X[lane] = e1.x; p.e1Y[lane] = e1.y; p.e1Z[lane] = e1.z;
+            p.e2X[lane] = e2.x; p.e2Y[lane] = e2.y; p.e2Z[lane] = e2.z;
+            p.triangle[lane] = t;
+        }
+        packets.push_back(p);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+bool MeshBvh::intersect(const Ray& ray,
+                        float maxDistance,
+                        uint32_t& triangle,
+                        float& distance) const
+{
+    if (nodes.empty())
+        return false;
+
+    const glm::vec3 o   = ray.start();
+    const glm::vec3 d   = ray.direction();
+    const glm::vec3 inv = 1.0f / d;
+
+    float nearest = maxDistance;
+    bool found = false;
+
+    // A stack entry is a node or a leaf with the entry distance of the ray
+    // into its box.
+    struct Entry
+    {
+        uint32_t child;
+        uint32_t packetCount;
+        float distance;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+    stack.push_back({ 0, 0, 0.0f });
+
+    while (stack.size())
+    {
+        const Entry e = stack.back();
+        stack.pop_back();
+        if (e.distance >= nearest)
+            continue;
+
+        if (e.packetCount)
+        {
+            // Möller-Trumbore test of four triangles at once.
+            for (uint32_t i = e.child; i < e.child + e.packetCount; ++i)
+            {
+                const Packet& p = packets[i];
+                float t[4];
+
+                #pragma omp simd
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    const float px = d.y * p.e2Z[lane] - d.z * p.e2Y[lane];
+                    const float py = d.z * p.e2X[lane] - d.x * p.e2Z[lane];
+                    const float pz = d.x * p.e2Y[lane] - d.y * p.e2X[lane];
+                    const float det = p.e1X[lane] * px + p.e1Y[lane] * py + p.e1Z[lane] * pz;
+                    const float invDet = 1.0f / det;
+
+                    const float sx = o.x - p.v0X[lane];
+                    const float sy = o.y - p.v0Y[lane];
+                    const float sz = o.z - p.v0Z[lane];
+                    const float u = (sx * px + sy * py + sz * pz) * invDet;
+
+                    const float qx = sy * p.e1Z[lane] - sz * p.e1Y[lane];
+                    const float qy = sz * p.e1X[lane] - sx * p.e1Z[lane];
+                    const float qz = sx * p.e1Y[lane] - sy * p.e1X[lane];
+                    const float v  = (d.x * qx + d.y * qy + d.z * qz) * invDet;
+                    const float tt = (p.e2X[lane] * qx + p.e2Y[lane] * qy + p.e2Z[lane] * qz) * invDet;
+
+                    const bool hit = det != 0.0f &&
+                                     u >= 0.0f && v >= 0.0f && u + v <= 1.0f &&
+                                     tt >= 0.0f && tt < nearest;
+                    t[lane] = hit ? tt : MISS;
+                }
+
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    if (t[lane] < nearest)
+                    {
+                        nearest  = t[lane];
+                        triangle = p.triangle[lane];
+                        found    = true;
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Slab test of four child boxes at once.
+        const Node& n = nodes[e.child];
+        float enter[4];
+
+        #pragma omp simd
+        for (int i = 0; i < 4; ++i)
+        {
+            const float tx1 = (n.minX[i] - o.x) * inv.x;
+            const float tx2 = (n.maxX[i] - o.x) * inv.x;
+            const float ty1 = (n.minY[i] - o.y) * inv.y;
+            const float ty2 = (n.maxY[i] - o.y) * inv.y;
+            const float tz1 = (n.minZ[i] - o.z) * inv.z;
+            const float tz2 = (n.maxZ[i] - o.z) * inv.z;
+
+            const float tMin = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)),
+                                        std::max(std::min(tz1, tz2), 0.0f));
+            const float tMax = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)),
+                                        std::max(tz1, tz2));
+
+            const bool hit = n.child[i] != NO_CHILD && tMin <= tMax && tMin < nearest;
+            enter[i] = hit ? tMin : MISS;
+        }
+
+        // Push the farthest first so that the nearest is visited first.
+        int order[4];
+        int count = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (enter[i] == MISS)
+                continue;
+
+            int j = count++;
+            while (j > 0 && enter[order[j - 1]] < enter[i])
+            {
+                order[j] = order[j - 1];
+                --j;
+            }
+            order[j] = i;
+        }
+
+        for (int i = 0; i < count; ++i)
+            stack.push_back({ n.child[order[i]],
+                              n.packetCount[order[i]],
+                              enter[order[i]] });
+    }
+
+    if (found)
+        distance = nearest;
+    return found;
+}
+
+/* -------------------------------------------------------------------------- */
+
+size_t MeshBvh::triangleCount() const
+{ return triangles; }
+
+} // namespace kuu
@@ -0,0 +1,79 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::MeshBvh class.
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace kuu
+{
+
+/* -------------------------------------------------------------------------- */
+
+class Bvh;
+class Ray;
+struct Mesh;
+
+/* -------------------------------------------------------------------------- *
+   A triangle hierarchy of a mesh for ray picking. The hierarchy is a binary
+   SAH hierarchy collapsed into nodes of four children. Child boxes of a node
+   and triangles of a leaf are stored as lanes of four so that a ray is
+   tested against four boxes or triangles at once with SIMD instructions.
+ * -------------------------------------------------------------------------- */
+class MeshBvh
+{
+public:
+    // Builds the hierarchy over the triangles of the mesh.
+    explicit MeshBvh(const Mesh& mesh);
+
+    // Returns the triangle that the ray hits first, the triangle is the
+    // index of the first vertex index of the triangle divided by three.
+    // The distance is along the ray in the units of the ray direction,
+    // hits farther than the max distance are ignored. Returns false if the
+    // ray does not hit any triangle.
+    bool intersect(const Ray& ray,
+                   float maxDistance,
+                   uint32_t& triangle,
+                   float& distance) const;
+
+    // Returns the count of triangles.
+    size_t triangleCount() const;
+
+private:
+    // Boxes of the four children. Child is a node index or the first packet
+    // of a leaf if the packet count is not zero. Unused children have empty
+    // boxes.
+    struct Node
+    {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        uint32_t child[4];
+        uint32_t packetCount[4];
+    };
+
+    // Four triangles as the first vertex and the two edges from it. Unused
+    // lanes have null edges.
+    struct Packet
+    {
+        float v0X[4], v0Y[4], v0Z[4];
+        float e1X[4], e1Y[4], e1Z[4];
+        float e2X[4], e2Y[4], e2Z[4];
+        uint32_t triangle[4];
+    };
+
+    uint32_t collapse(const Bvh& bvh, const Mesh& mesh, uint32_t binaryNode);
+    void addLeaf(const Bvh& bvh, const Mesh& mesh, uint32_t binaryNode,
+                 Node& node, int slot);
+
+    std::vector<Node> nodes;
+    std::vector<Packet> packets;
+    size_t triangles = 0;
+};
+
+} // namespace kuu
@@ -118,13 +118,13 @@ glm::vec3 Projector::unproject(float x, float y, float z, bool topDown) const
     return unproject(glm::vec3(x, y, z), topDown);
 }
 
-Ray Projector::viewportRay(const glm::vec2& pos) const
+Ray Projector::viewportRay(const glm::vec2& pos, bool topDown) const
 {
     glm::vec3 nearPlane(pos.x, pos.y, 0.0);
-    nearPlane = unproject(nearPlane, false);
+    nearPlane = unproject(nearPlane, topDown);
 
     glm::vec3 farPlane(pos.x, pos.y, 1.0);
-    farPlane = unproject(farPlane, false);
+    farPlane = unproject(farPlane, topDown);
 
     return Ray(nearPlane, farPlane - nearPlane);
 }
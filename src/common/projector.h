@@ -93,9 +93,11 @@ public:
         Creates a world space ray from the viewport coordinate that starts
         from the near plane and moves towards the far plane.
         \param pos The viewport coordinate. The coordinate must be positive.
+        \param topDown Set true if the [0, 0] viewport coordinate is located at
+                       top-left corner.
         \return Returns the viewport ray.
      **/
-    Ray viewportRay(const glm::vec2& pos) const;
+    Ray viewportRay(const glm::vec2& pos, bool topDown = true) const;
 
 private:
     const Camera camera_;
@@ -5,7 +5,130 @@
 
 #include "scene.h"
 
+/* -------------------------------------------------------------------------- */
+
+#include <limits>
+#include <glm/matrix.hpp>
+#include "mesh_bvh.h"
+#include "projector.h"
+
 namespace kuu
 {
 
+/* -------------------------------------------------------------------------- */
+
+void Scene::updateTransforms()
+{
+    transforms.resize(models.size());
+    for (size_t i = 0; i < models.size(); ++i)
+        transforms.set(i, models[i]->worldTransform);
+}
+
+void Scene::updateChangedTransforms()
+{
+    if (transforms.size() != models.size() ||
+        meshBounds.size() != models.size())
+    {
+        updateTransforms();
+        buildBvh();
+        return;
+    }
+
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < models.size(); ++i)
+    {
+        if (transforms.get(i) == models[i]->worldTransform)
+            continue;
+        transforms.set(i, models[i]->worldTransform);
+        changed.push_back(i);
+    }
+
+    // Refitting the whole tree is cheaper than updating the paths of many
+    // models one by one.
+    if (changed.size() > models.size() / 4)
+    {
+        refitBvh();
+        return;
+    }
+
+    for (size_t i : changed)
+        refitBvh(i);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void Scene::buildBvh()
+{
+    meshBounds.resize(models.size());
+    for (size_t i = 0; i < models.size(); ++i)
+        meshBounds[i] = models[i]->mesh->boundingBox();
+
+    std::vector<BoundingBox> boxes(models.size());
+    for (size_t i = 0; i < models.size(); ++i)
+        boxes[i] = modelBounds(i);
+    bvh.build(boxes);
+}
+
+void Scene::refitBvh()
+{
+    std::vector<BoundingBox> boxes(models.size());
+    for (size_t i = 0; i < models.size(); ++i)
+        boxes[i] = modelBounds(i);
+    bvh.refit(boxes);
+}
+
+void Scene::refitBvh(size_t modelIndex)
+{
+    bvh.update(uint32_t(modelIndex), modelBounds(modelIndex));
+}
+
+/* -------------------------------------------------------------------------- */
+
+BoundingBox Scene::modelBounds(size_t modelIndex) const
+{
+    return meshBounds[modelIndex].transformed(models[modelIndex]->worldTransform);
+}
+
+/* -------------------------------------------------------------------------- */
+
+bool Scene::pick(const glm::vec2& pos, Pick& pick) const
+{
+    const Projector projector(camera, viewport);
+    return this->pick(projector.viewportRay(pos), pick);
+}
+
+bool Scene::pick(const Ray& ray, Pick& pick) const
+{
+    std::vector<uint32_t> candidates;
+    bvh.query(ray, candidates);
+
+    // Distances along the ray are kept in the object space of the models
+    // as affine transforms preserve them when the direction is transformed
+    // along with the start.
+    float nearest = std::numeric_limits<float>::max();
+    bool found = false;
+    for (uint32_t i : candidates)
+    {
+        const std::shared_ptr<Model>& model = models[i];
+        const glm::mat4 inv = glm::inverse(model->worldTransform);
+        const Ray local(glm::vec3(inv * glm::vec4(ray.start(),     1.0f)),
+                        glm::vec3(inv * glm::vec4(ray.direction(), 0.0f)));
+
+        uint32_t triangle;
+        float distance;
+        if (model->mesh->triangleBvh()->intersect(local, nearest, triangle, distance))
+        {
+            nearest         = distance;
+            pick.model      = model;
+            pick.modelIndex = i;
+            pick.triangle   = triangle;
+            found           = true;
+        }
+    }
+
+    if (found)
+        pick.point = ray.position(nearest);
+    return found;
+}
+
 } // namespace kuu
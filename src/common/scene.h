@@ -8,13 +8,30 @@
 /* -------------------------------------------------------------------------- */
 
 #include <vector>
+#include <glm/vec2.hpp>
+#include "bvh.h"
 #include "camera.h"
 #include "light.h"
 #include "model.h"
+#include "ray.h"
+#include "transform_store.h"
 
 namespace kuu
 {
 
+/* -------------------------------------------------------------------------- *
+   A ray hit of a model triangle.
+ * -------------------------------------------------------------------------- */
+struct Pick
+{
+    std::shared_ptr<Model> model;
+    size_t modelIndex = 0;
+    // Index of the triangle in the mesh indices divided by three.
+    uint32_t triangle = 0;
+    // World space hit point.
+    glm::vec3 point;
+};
+
 /* -------------------------------------------------------------------------- *
    A scene to render.
  * -------------------------------------------------------------------------- */
@@ -25,6 +42,41 @@ struct Scene
     Light light;
     std::vector<std::shared_ptr<Model>> models;
     glm::vec4 viewport;
+
+    // Copies the world transforms of the models into the transform store.
+    // Needs to be called after the models or their world transforms have
+    // changed.
+    void updateTransforms();
+    // Copies the world transforms that have changed since the last update
+    // into the transform store and refits the spatial index of the changed
+    // models. Needs to be called once per frame before rendering.
+    void updateChangedTransforms();
+
+    // Builds the spatial index of the models. Needs to be called after the
+    // models have been added or removed.
+    void buildBvh();
+    // Refits the spatial index after the world transforms have changed.
+    void refitBvh();
+    // Refits the spatial index after the world transform of a model has
+    // changed.
+    void refitBvh(size_t modelIndex);
+
+    // Returns the world space bounds of a model.
+    BoundingBox modelBounds(size_t modelIndex) const;
+
+    // Picks the nearest model triangle under the top-down viewport
+    // coordinate. Returns false if there is nothing under the coordinate.
+    bool pick(const glm::vec2& pos, Pick& pick) const;
+    // Picks the nearest model triangle that the world space ray hits.
+    bool pick(const Ray& ray, Pick& pick) const;
+
+    // Spatial index of the model world bounds, the item is the model index.
+    Bvh bvh;
+    // Object space bounds of the model meshes, updated by buildBvh.
+    std::vector<BoundingBox> meshBounds;
+    // World transforms of the models in the model order, renderers read
+    // the transforms from here instead of the models.
+    TransformStore transforms;
 };
 
 } // namespace kuu
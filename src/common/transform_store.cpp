@@ -0,0 +1,205 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::TransformStore class.
+ * -------------------------------------------------------------------------- */
+
+#include "transform_store.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cstring>
+
+namespace kuu
+{
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Count of matrices in a batch.
+const size_t LANES = 8;
+
+// Matrices of a batch, element first.
+struct Batch
+{
+    float e[16][LANES];
+};
+
+// Loads the matrices of the items into a batch. Unused lanes are zero.
+void gather(const std::vector<float> (&elements)[16],
+            const uint32_t* items,
+            size_t count,
+            Batch& batch)
+{
+    if (count < LANES)
+        std::memset(&batch, 0, sizeof(Batch));
+
+    for (int e = 0; e < 16; ++e)
+    {
+        const float* src = elements[e].data();
+        for (size_t lane = 0; lane < count; ++lane)
+            batch.e[e][lane] = src[items[lane]];
+    }
+}
+
+// Writes the matrices of a batch into the output.
+void scatter(const Batch& batch, size_t count, void* out, size_t stride)
+{
+    unsigned char* dst = static_cast<unsigned char*>(out);
+    for (size_t lane = 0; lane < count; ++lane)
+    {
+        float* m = reinterpret_cast<float*>(dst + lane * stride);
+        for (int e = 0; e < 16; ++e)
+            m[e] = batch.e[e][lane];
+    }
+}
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- */
+
+void TransformStore::resize(size_t count)
+{
+    for (int e = 0; e < 16; ++e)
+        elements[e].resize(count, (e % 5 == 0) ? 1.0f : 0.0f);
+}
+
+size_t TransformStore::size() const
+{ return elements[0].size(); }
+
+/* -------------------------------------------------------------------------- */
+
+void TransformStore::set(size_t item, const glm::mat4& m)
+{
+    for (int e = 0; e < 16; ++e)
+        elements[e][item] = m[e / 4][e % 4];
+}
+
+glm::mat4 TransformStore::get(size_t item) const
+{
+    glm::mat4 m;
+    for (int e = 0; e < 16; ++e)
+        m[e / 4][e % 4] = elements[e][item];
+    return m;
+}
+
+/* -------------------------------------------------------------------------- */
+
+void TransformStore::copy(const uint32_t* items,
+                          size_t count,
+                          void* out,
+                          size_t stride) const
+{
+    unsigned char* dst = static_cast<unsigned char*>(out);
+    for (size_t first = 0; first < count; first += LANES)
+    {
+        const size_t n = std::min(LANES, count - first);
+
+        Batch in;
+        gather(elements, items + first, n, in);
+        scatter(in, n, dst + first * stride, stride);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+void TransformStore::multiply(const glm::mat4& m,
+                              const uint32_t* items,
+                              size_t count,
+                              void* out,
+                              size_t stride) const
+{
+    unsigned char* dst = static_cast<unsigned char*>(out);
+    for (size_t first = 0; first < count; first += LANES)
+    {
+        const size_t n = std::min(LANES, count - first);
+
+        Batch in;
+        Batch result;
+        gather(elements, items + first, n, in);
+
+        // Column c of the result is the matrix times column c of the item.
+        for (int c = 0; c < 4; ++c)
+        {
+            for (int r = 0; r < 4; ++r)
+            {
+                const float m0 = m[0][r], m1 = m[1][r], m2 = m[2][r], m3 = m[3][r];
+                const float* c0 = in.e[c * 4 + 0];
+                const float* c1 = in.e[c * 4 + 1];
+                const float* c2 = in.e[c * 4 + 2];
+                const float* c3 = in.e[c * 4 + 3];
+                float* o = result.e[c * 4 + r];
+
+                #pragma omp simd
+                for (size_t lane = 0; lane < LANES; ++lane)
+                    o[lane] = m0 * c0[lane] + m1 * c1[lane] +
+                              m2 * c2[lane] + m3 * c3[lane];
+            }
+        }
+
+        scatter(result, n, dst + first * stride, stride);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+void TransformStore::normalMatrices(const uint32_t* items,
+                                    size_t count,
+                                    void* out,
+                                    size_t stride) const
+{
+    unsigned char* dst = static_cast<unsigned char*>(out);
+    for (size_t first = 0; first < count; first += LANES)
+    {
+        const size_t n = std::min(LANES, count - first);
+
+        Batch in;
+        Batch result;
+        gather(elements, items + first, n, in);
+
+        // With columns a, b and c the inverse transpose has the columns
+        // b x c, c x a and a x b divided by the determinant.
+        #pragma omp simd
+        for (size_t lane = 0; lane < LANES; ++lane)
+        {
+            const float ax = in.e[0][lane], ay = in.e[1][lane], az = in.e[2][lane];
+            const float bx = in.e[4][lane], by = in.e[5][lane], bz = in.e[6][lane];
+            const float cx = in.e[8][lane], cy = in.e[9][lane], cz = in.e[10][lane];
+
+            const float bcx = by * cz - bz * cy;
+            const float bcy = bz * cx - bx * cz;
+            const float bcz = bx * cy - by * cx;
+            const float cax = cy * az - cz * ay;
+            const float cay = cz * ax - cx * az;
+            const float caz = cx * ay - cy * ax;
+            const float abx = ay * bz - az * by;
+            const float aby = az * bx - ax * bz;
+            const float abz = ax * by - ay * bx;
+
+            const float det = ax * bcx + ay * bcy + az * bcz;
+            const float inv = det != 0.0f ? 1.0f / det : 0.0f;
+
+            result.e[0][lane]  = bcx * inv;
+            result.e[1][lane]  = bcy * inv;
+            result.e[2][lane]  = bcz * inv;
+            result.e[3][lane]  = 0.0f;
+            result.e[4][lane]  = cax * inv;
+            result.e[5][lane]  = cay * inv;
+            result.e[6][lane]  = caz * inv;
+            result.e[7][lane]  = 0.0f;
+            result.e[8][lane]  = abx * inv;
+            result.e[9][lane]  = aby * inv;
+            result.e[10][lane] = abz * inv;
+            result.e[11][lane] = 0.0f;
+            result.e[12][lane] = 0.0f;
+            result.e[13][lane] = 0.0f;
+            result.e[14][lane] = 0.0f;
+            result.e[15][lane] = 1.0f;
+        }
+
+        scatter(result, n, dst + first * stride, stride);
+    }
+}
+
+} // namespace kuu
@@ -0,0 +1,55 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::TransformStore class.
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+
+namespace kuu
+{
+
+/* -------------------------------------------------------------------------- *
+   Transform matrices stored as structure of arrays, each matrix element is
+   in its own contiguous array. The matrices of items are processed in
+   batches with SIMD instructions and the results are written as column-major
+   4x4 float matrices into an output, e.g. a mapped buffer, with a stride in
+   bytes between the results.
+ * -------------------------------------------------------------------------- */
+class TransformStore
+{
+public:
+    // Sets and returns the count of matrices.
+    void resize(size_t count);
+    size_t size() const;
+
+    // Sets and returns the matrix of the item.
+    void set(size_t item, const glm::mat4& m);
+    glm::mat4 get(size_t item) const;
+
+    // Writes the matrices of the items.
+    void copy(const uint32_t* items, size_t count,
+              void* out, size_t stride) const;
+    // Writes the matrices of the items multiplied from the left with the
+    // matrix, e.g. view-projection times model.
+    void multiply(const glm::mat4& m,
+                  const uint32_t* items, size_t count,
+                  void* out, size_t stride) const;
+    // Writes the normal matrices of the items. The normal matrix is the
+    // inverse transpose of the upper 3x3 matrix, the fourth row and column
+    // are of identity.
+    void normalMatrices(const uint32_t* items, size_t count,
+                        void* out, size_t stride) const;
+
+private:
+    // Elements in column-major order.
+    std::vector<float> elements[16];
+};
+
+} // namespace kuu
@@ -11,9 +11,6 @@
 
 layout(binding = 0) uniform Params
 {
-    vec4 viewport;
-    mat4 invProj;
-    mat4 invViewRot;
     vec4 lightDir;
     vec4 kr;
     float rayleighBrightness;
@@ -30,24 +27,12 @@ layout(binding = 0) uniform Params
 
 // -----------------------------------------------------------------------------
 
-layout(location = 0) in vec2 uv;
+layout(location = 0) in vec3 texCoord;
 
 // -----------------------------------------------------------------------------
 
 layout(location = 0) out vec4 colorOut;
 
-// -----------------------------------------------------------------------------
-// Normal in the world space as seen from this fragment
-vec3 getWorldNormal()
-{
-    vec2 fragCoord = gl_FragCoord.xy / data.viewport.xy;
-    fragCoord = (fragCoord - 0.5) * 2.0;
-    vec4 deviceNormal = vec4(fragCoord, 0.0, 1.0);
-    vec3 eyeNormal = normalize(vec3(data.invProj * deviceNormal));
-    vec3 worldNormal = normalize(mat3(data.invViewRot) * eyeNormal);
-    return worldNormal;
-}
-
 // -----------------------------------------------------------------------------
 // Distance to the sphere of 1 radius outer sheel from the position and direction
 float atmosphericDepth(vec3 position, vec3 dir)
@@ -128,7 +113,7 @@ void main(void)
     vec3 eyePosition = vec3(0.0, surfaceHeight, 0.0);
 
     // The look-at direction
-    vec3 eyedir = getWorldNormal();
+    vec3 eyedir = normalize(texCoord);
 
     // Distance from the eye position into planet outershell
     float eyeDepth = atmosphericDepth(eyePosition, eyedir);
@@ -0,0 +1,39 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   Cube bake vertex shader.
+
+   Renders a fullscreen triangle. The world space direction of the vertex on
+   the cube face is passed to the fragment shader.
+ * -------------------------------------------------------------------------- */
+
+#version 450
+
+// -----------------------------------------------------------------------------
+
+layout(set = 1, binding = 0) uniform Faces
+{
+    // Inverse view-projection matrices of the cube faces.
+    mat4 faces[6];
+
+} faces;
+
+layout(push_constant) uniform Face
+{
+    int index;
+
+} face;
+
+// -----------------------------------------------------------------------------
+
+layout(location = 0) out vec3 texCoord;
+
+// -----------------------------------------------------------------------------
+
+void main()
+{
+    vec2 ndc = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2.0 - 1.0;
+    vec4 dir = faces.faces[face.index] * vec4(ndc, 1.0, 1.0);
+
+    gl_Position = vec4(ndc, 0.0, 1.0);
+    texCoord    = dir.xyz / dir.w;
+}
@@ -5,10 +5,22 @@
 
 #version 450
 
+// -----------------------------------------------------------------------------
+// Uniform frame
+
+layout(set = 0, binding = 0) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    mat4 light;
+    vec4 camPos;
+
+} frame;
+
 // -----------------------------------------------------------------------------
 // Uniform light
 
-layout(binding = 1) uniform Light
+layout(set = 0, binding = 1) uniform Light
 {
     vec4 worldDir;  // Direction of light in world space.
     vec4 intensity; // Itensity of light (values can be over 1.0)
@@ -18,9 +30,8 @@ layout(binding = 1) uniform Light
 // -----------------------------------------------------------------------------
 // Params
 
-layout(binding = 2) uniform PbrParams
+layout(set = 1, binding = 0) uniform PbrParams
 {
-    vec4 camPos;
     vec4 albedo;
     float metallic;
     float roughness;
@@ -31,20 +42,36 @@ layout(binding = 2) uniform PbrParams
 // -----------------------------------------------------------------------------
 // Material maps
 
-layout(binding = 3)  uniform sampler2D ambientOcclusionMap;
-layout(binding = 4)  uniform sampler2D baseColorMap;
-layout(binding = 5)  uniform sampler2D heightMap;
-layout(binding = 6)  uniform sampler2D metallicMap;
-layout(binding = 7)  uniform sampler2D normalMap;
-layout(binding = 8)  uniform sampler2D roughnessMap;
+layout(set = 1, binding = 1) uniform sampler2D ambientOcclusionMap;
+layout(set = 1, binding = 2) uniform sampler2D baseColorMap;
+layout(set = 1, binding = 3) uniform sampler2D heightMap;
+layout(set = 1, binding = 4) uniform sampler2D metallicMap;
+layout(set = 1, binding = 5) uniform sampler2D normalMap;
+layout(set = 1, binding = 6) uniform sampler2D roughnessMap;
+
+// -----------------------------------------------------------------------------
+// Material features, a missing map is not sampled. The pipeline of a material
+// specializes these so the fetches of the missing maps are compiled out.
+
+layout(constant_id = 0) const bool HAS_AMBIENT_OCCLUSION_MAP = true;
+layout(constant_id = 1) const bool HAS_BASE_COLOR_MAP        = true;
+layout(constant_id = 2) const bool HAS_HEIGHT_MAP            = true;
+layout(constant_id = 3) const bool HAS_METALLIC_MAP          = true;
+layout(constant_id = 4) const bool HAS_NORMAL_MAP            = true;
+layout(constant_id = 5) const bool HAS_ROUGHNESS_MAP         = true;
 
 // -----------------------------------------------------------------------------
 // Generated maps
 
-layout(binding = 9)  uniform samplerCube irradianceMap;
-layout(binding = 10)  uniform samplerCube prefilteredMap;
-layout(binding = 11) uniform sampler2D brdfLutMap;
-layout(binding = 12) uniform sampler2D shadowMap;
+layout(set = 0, binding = 2) uniform IrradianceSh
+{
+    // SH coefficients of irradiance divided by PI, w is unused.
+    vec4 coefficients[9];
+
+} irradianceSh;
+layout(set = 0, binding = 3) uniform samplerCube prefilteredMap;
+layout(set = 0, binding = 4) uniform sampler2D brdfLutMap;
+layout(set = 0, binding = 5) uniform sampler2D shadowMap;
 
 // -----------------------------------------------------------------------------
 // Vertex shader outputs
@@ -104,6 +131,23 @@ vec3 brdfFresnelRoughness(float nDotV, vec3 f0, float roughness)
     return f0 + (max(vec3(1.0 - roughness), f0) - f0) * pow(1.0 - nDotV, 5.0);
 }
 
+// -----------------------------------------------------------------------------
+// Evaluates the SH irradiance at the normal.
+
+vec3 shIrradiance(vec3 n)
+{
+    vec3 e = irradianceSh.coefficients[0].rgb * 0.282095
+           + irradianceSh.coefficients[1].rgb * 0.488603 * n.y
+           + irradianceSh.coefficients[2].rgb * 0.488603 * n.z
+           + irradianceSh.coefficients[3].rgb * 0.488603 * n.x
+           + irradianceSh.coefficients[4].rgb * 1.092548 * n.x * n.y
+           + irradianceSh.coefficients[5].rgb * 1.092548 * n.y * n.z
+           + irradianceSh.coefficients[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0)
+           + irradianceSh.coefficients[7].rgb * 1.092548 * n.x * n.z
+           + irradianceSh.coefficients[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(e, vec3(0.0));
+}
+
 // -----------------------------------------------------------------------------
 // Offsets the texture coordinates based on the height map.
 
@@ -164,14 +208,15 @@ float shadowFactor(float epsilon)
 void main()
 {
     // Calculate vectors.
-    vec3 v = normalize(pbrParams.camPos.xyz - worldPos);
+    vec3 v = normalize(frame.camPos.xyz - worldPos);
     vec3 l = normalize(-light.worldDir.xyz);
     vec3 h = normalize(l + v);
     vec3 n = normalize(worldNormal);
 
-    // Offset texture coordinates if height map exits
+    // Offset texture coordinates if height map exits, the map might have
+    // been evicted by the texture residency.
     vec2 tc = texCoord;
-    if (textureSize(heightMap, 1).x > 1)
+    if (HAS_HEIGHT_MAP && textureSize(heightMap, 1).x > 1)
     {
         vec3 tangent = normalize(transpose(tbn) * v);
         tc = parallaxMapping(tc, tangent);
@@ -179,23 +224,23 @@ void main()
 
     // Sample maps
     float metallic = pbrParams.metallic;
-    if (textureSize(metallicMap, 1).x > 1)
+    if (HAS_METALLIC_MAP && textureSize(metallicMap, 1).x > 1)
         metallic  = texture(metallicMap, tc).r;
 
     float roughness = pbrParams.roughness;
-    if (textureSize(roughnessMap, 1).x > 1)
+    if (HAS_ROUGHNESS_MAP && textureSize(roughnessMap, 1).x > 1)
         roughness = texture(roughnessMap, tc).r;
     vec3 albedo = pbrParams.albedo.rgb;
-    if (textureSize(baseColorMap, 1).x > 1)
+    if (HAS_BASE_COLOR_MAP && textureSize(baseColorMap, 1).x > 1)
         albedo = texture(baseColorMap, tc).rgb;
 
     // Use ambient occlusion from map if available
     float ao = pbrParams.ao;
-    if (textureSize(ambientOcclusionMap, 1).x > 1)
+    if (HAS_AMBIENT_OCCLUSION_MAP && textureSize(ambientOcclusionMap, 1).x > 1)
         ao = texture(ambientOcclusionMap, tc).r;
 
     // Use normal form map if available
-    if (textureSize(normalMap, 1).x > 1)
+    if (HAS_NORMAL_MAP && textureSize(normalMap, 1).x > 1)
     {
         n = texture(normalMap, tc).rgb;
         n = normalize(n * 2.0 - 1.0);
@@ -236,7 +281,7 @@ void main()
     radiance = mix(shadowColor, radiance, shadow);
 
     // Use precalculated diffuse light irradiance
-    vec3 irradianceDiffuse  = texture(irradianceMap, n).rgb * albedo;
+    vec3 irradianceDiffuse  = shIrradiance(n) * albedo;
 
 
     // Use precalculated specular light irradiance
@@ -7,15 +7,33 @@
 
 // -----------------------------------------------------------------------------
 
-layout(binding = 0) uniform Matrices
+layout(set = 0, binding = 0) uniform Frame
 {
-    mat4 model;
     mat4 view;
     mat4 projection;
-    mat4 normal;
     mat4 light;
+    vec4 camPos;
+
+} frame;
+
+struct Draw
+{
+    mat4 model;
+    mat4 normal;
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer Draws
+{
+    Draw draws[];
+};
 
-} matrices;
+// Index of the first instance into draws array, the instances of a draw
+// follow each other.
+layout(push_constant) uniform DrawIndex
+{
+    uint index;
+
+} drawIndex;
 
 // -----------------------------------------------------------------------------
 
@@ -37,20 +55,22 @@ layout(location = 4) out mat3 tbn;
 
 void main()
 {
-    vec3 t = normalize(vec3(matrices.normal * vec4(inTangent,   0.0)));
-    vec3 b = normalize(vec3(matrices.normal * vec4(inBitangent, 0.0)));
-    vec3 n = normalize(vec3(matrices.normal * vec4(inNormal,    0.0)));
+    Draw draw = draws[drawIndex.index + gl_InstanceIndex];
+
+    vec3 t = normalize(vec3(draw.normal * vec4(inTangent,   0.0)));
+    vec3 b = normalize(vec3(draw.normal * vec4(inBitangent, 0.0)));
+    vec3 n = normalize(vec3(draw.normal * vec4(inNormal,    0.0)));
 
     // re-orthogonalize T with respect to N
     t = normalize(t - dot(t, n) * n);
     b = cross(n, t);
 
-    gl_Position = matrices.projection *
-                  matrices.view *
-                  matrices.model * vec4(inPosition, 1.0);
+    gl_Position = frame.projection *
+                  frame.view *
+                  draw.model * vec4(inPosition, 1.0);
     texCoord  = inTexCoord * 4.0;
-    worldNormal = mat3(matrices.normal) * inNormal;
-    worldPos    = vec3(matrices.model * vec4(inPosition, 1.0));
+    worldNormal = mat3(draw.normal) * inNormal;
+    worldPos    = vec3(draw.model * vec4(inPosition, 1.0));
     tbn        = mat3(t, b, n);
 
     const mat4 biasMat = mat4(
@@ -59,5 +79,5 @@ void main()
         0.0, 0.0, 1.0, 0.0,
         0.5, 0.5, 0.0, 1.0);
 
-    lightPos = biasMat * matrices.light * matrices.model * vec4(inPosition, 1.0);
+    lightPos = biasMat * frame.light * draw.model * vec4(inPosition, 1.0);
 }
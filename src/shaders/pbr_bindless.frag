@@ -0,0 +1,303 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   PBR bindless fragment shader.
+ * -------------------------------------------------------------------------- */
+
+#version 450
+
+// -----------------------------------------------------------------------------
+// Per-draw data, indexed with the draw index.
+
+struct Draw
+{
+    mat4 model;
+    mat4 normal;
+    vec4 albedo;
+    float metallic;
+    float roughness;
+    float ao;
+    float padding;
+    ivec4 maps0; // ambient occlusion, base color, height, metallic
+    ivec4 maps1; // normal, roughness, unused, unused
+};
+
+layout(std430, binding = 0) readonly buffer Draws
+{
+    Draw draws[];
+};
+
+// -----------------------------------------------------------------------------
+// Per-frame data
+
+layout(binding = 1) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    mat4 light;
+    vec4 camPos;
+
+} frame;
+
+// -----------------------------------------------------------------------------
+// Uniform light
+
+layout(binding = 2) uniform Light
+{
+    vec4 worldDir;  // Direction of light in world space.
+    vec4 intensity; // Itensity of light (values can be over 1.0)
+
+} light;
+
+// -----------------------------------------------------------------------------
+// Material maps of all the materials. Array size is set when the pipeline
+// is created.
+
+layout(constant_id = 0) const int TEXTURE_COUNT = 1;
+layout(binding = 3) uniform sampler2D textures[TEXTURE_COUNT];
+
+// -----------------------------------------------------------------------------
+// Generated maps
+
+layout(binding = 4) uniform IrradianceSh
+{
+    // SH coefficients of irradiance divided by PI, w is unused.
+    vec4 coefficients[9];
+
+} irradianceSh;
+layout(binding = 5) uniform samplerCube prefilteredMap;
+layout(binding = 6) uniform sampler2D brdfLutMap;
+layout(binding = 7) uniform sampler2D shadowMap;
+
+// -----------------------------------------------------------------------------
+// Vertex shader outputs
+
+layout(location = 0) in vec2 texCoord;
+layout(location = 1) in vec3 worldNormal;
+layout(location = 2) in vec3 worldPos;
+layout(location = 3) in vec4 lightPos;
+layout(location = 4) in mat3 tbn;
+layout(location = 7) flat in int drawIndex;
+
+// -----------------------------------------------------------------------------
+// Fragment shader outputs
+
+layout(location = 0) out vec4 outColor;
+
+// -----------------------------------------------------------------------------
+// Constants
+
+const float PI                 = 3.14159;
+const float MAX_REFLECTION_LOD = 4.0;
+
+// -----------------------------------------------------------------------------
+// Cook-Torrance specular BRDF (GGX) normal distribution function.
+
+float brdfNormalDistributionGGX(float nDotH, float a)
+{
+    float nDotH2 = nDotH * nDotH;
+    float a2     = a * a;
+    float q      = (nDotH2 * (a2 -1.0) + 1.0);
+    return a2 / (PI * q * q);
+}
+
+// -----------------------------------------------------------------------------
+// Cook-Torrance specular BRDF (GGX) geometry function.
+
+float brdfGeometryGGX(float nDotV, float nDotL, float k)
+{
+    float ggx1 = nDotV / (nDotV * (1.0 - k) + k);
+    float ggx2 = nDotL / (nDotL * (1.0 - k) + k);
+
+    return ggx1 * ggx2;
+}
+
+// -----------------------------------------------------------------------------
+// Diffuse / specular ration.
+
+vec3 brdfFresnel(float nDotV, vec3 f0)
+{
+    return f0 + (1.0 - f0) * pow(1.0 - nDotV, 5.0);
+}
+
+// -----------------------------------------------------------------------------
+//
+
+vec3 brdfFresnelRoughness(float nDotV, vec3 f0, float roughness)
+{
+    return f0 + (max(vec3(1.0 - roughness), f0) - f0) * pow(1.0 - nDotV, 5.0);
+}
+
+// -----------------------------------------------------------------------------
+// Evaluates the SH irradiance at the normal.
+
+vec3 shIrradiance(vec3 n)
+{
+    vec3 e = irradianceSh.coefficients[0].rgb * 0.282095
+           + irradianceSh.coefficients[1].rgb * 0.488603 * n.y
+           + irradianceSh.coefficients[2].rgb * 0.488603 * n.z
+           + irradianceSh.coefficients[3].rgb * 0.488603 * n.x
+           + irradianceSh.coefficients[4].rgb * 1.092548 * n.x * n.y
+           + irradianceSh.coefficients[5].rgb * 1.092548 * n.y * n.z
+           + irradianceSh.coefficients[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0)
+           + irradianceSh.coefficients[7].rgb * 1.092548 * n.x * n.z
+           + irradianceSh.coefficients[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(e, vec3(0.0));
+}
+
+// -----------------------------------------------------------------------------
+// Offsets the texture coordinates based on the height map.
+
+vec2 parallaxMapping(vec2 texCoords, vec3 viewDir, int heightMap)
+{
+    float height_scale = 0.1;
+
+    const float minLayers = 8.0;
+    const float maxLayers = 32.0;
+    float numLayers = mix(maxLayers, minLayers, abs(dot(vec3(0.0, 0.0, 1.0), viewDir)));
+
+     float layerDepth = 1.0 / numLayers;
+     float currentLayerDepth = 0.0;
+     vec2 P = viewDir.xy * height_scale;
+     vec2 deltaTexCoords = P / numLayers;
+
+     vec2  currentTexCoords     = texCoords;
+     float currentDepthMapValue = 1.0 - texture(textures[heightMap], currentTexCoords).r;
+
+     while(currentLayerDepth < currentDepthMapValue)
+     {
+         currentTexCoords -= deltaTexCoords;
+         currentDepthMapValue = 1.0 - texture(textures[heightMap], currentTexCoords).r;
+         currentLayerDepth += layerDepth;
+     }
+
+     vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
+
+     float afterDepth  = currentDepthMapValue - currentLayerDepth;
+     float beforeDepth = 1.0 - texture(textures[heightMap], prevTexCoords).r - currentLayerDepth + layerDepth;
+
+     float weight = afterDepth / (afterDepth - beforeDepth);
+     vec2 finalTexCoords = prevTexCoords * weight + currentTexCoords * (1.0 - weight);
+
+//     if(finalTexCoords.x > 1.0 || finalTexCoords.y > 1.0 || finalTexCoords.x < 0.0 || finalTexCoords.y < 0.0)
+//         return texCoord;
+
+     return finalTexCoords;
+}
+
+float shadowFactor(float epsilon)
+{
+    // Transform the vertex from the light points of view in UV space
+    vec3 ndc = lightPos.xyz / lightPos.w;
+    vec3 uv = ndc;
+
+    // Vertex distance from the light point of view in UV space
+    float z = uv.z;
+
+    // The closest pixel from the light point of view in UV space.
+    float depth = texture(shadowMap, uv.xy).r;
+
+    return smoothstep(z - epsilon, z, depth);
+}
+
+/* ---------------------------------------------------------------- */
+
+void main()
+{
+    // Material of draw
+    float metallic  = draws[drawIndex].metallic;
+    float roughness = draws[drawIndex].roughness;
+    vec3 albedo     = draws[drawIndex].albedo.rgb;
+    float ao        = draws[drawIndex].ao;
+    ivec4 maps0     = draws[drawIndex].maps0;
+    ivec4 maps1     = draws[drawIndex].maps1;
+
+    // Calculate vectors.
+    vec3 v = normalize(frame.camPos.xyz - worldPos);
+    vec3 l = normalize(-light.worldDir.xyz);
+    vec3 h = normalize(l + v);
+    vec3 n = normalize(worldNormal);
+
+    // Offset texture coordinates if height map exits
+    vec2 tc = texCoord;
+    if (maps0.z >= 0 && textureSize(textures[maps0.z], 1).x > 1)
+    {
+        vec3 tangent = normalize(transpose(tbn) * v);
+        tc = parallaxMapping(tc, tangent, maps0.z);
+    }
+
+    // Sample maps
+    if (maps0.w >= 0 && textureSize(textures[maps0.w], 1).x > 1)
+        metallic  = texture(textures[maps0.w], tc).r;
+
+    if (maps1.y >= 0 && textureSize(textures[maps1.y], 1).x > 1)
+        roughness = texture(textures[maps1.y], tc).r;
+
+    if (maps0.y >= 0 && textureSize(textures[maps0.y], 1).x > 1)
+        albedo = texture(textures[maps0.y], tc).rgb;
+
+    // Use ambient occlusion from map if available
+    if (maps0.x >= 0 && textureSize(textures[maps0.x], 1).x > 1)
+        ao = texture(textures[maps0.x], tc).r;
+
+    // Use normal form map if available
+    if (maps1.x >= 0 && textureSize(textures[maps1.x], 1).x > 1)
+    {
+        n = texture(textures[maps1.x], tc).rgb;
+        n = normalize(n * 2.0 - 1.0);
+        n = tbn * n;
+        n = normalize(n);
+    }
+
+    // Vector angles
+    float nDotL = max(dot(n, l), 0.0);
+    float nDotV = max(dot(n, v), 0.0);
+    float nDotH = max(dot(n, h), 0.0);
+
+    // Base reflectivity
+    vec3 f0 = vec3(0.04);
+    f0 = mix(f0, albedo, metallic);
+
+    // Specular BRDF of light.
+    float ndf = brdfNormalDistributionGGX(nDotH, roughness * roughness);
+    float g   = brdfGeometryGGX(nDotV, nDotL, roughness);
+    vec3 f    = brdfFresnel(nDotL, f0);
+
+    // Reflection/refraction ratio
+    vec3 kS = f;
+    vec3 kD = vec3(1.0) - kS;
+    kD *= 1.0 - metallic;
+
+    // Calc. light diffuse and specular radiance
+    vec3 radianceDiffuse  = kD * albedo / PI;
+
+    // Mix shadow
+    vec3 shadowColor = vec3(0.01, 0.01, 0.01);
+    float shadow = shadowFactor(0.005);
+
+    vec3 radianceSpecular = (ndf * g * f )/ max(4.0 * nDotV * nDotL, 0.001);
+
+    // Calc. light radiance
+    vec3 radiance = (radianceDiffuse + radianceSpecular) * light.intensity.rgb * nDotL;
+    radiance = mix(shadowColor, radiance, shadow);
+
+    // Use precalculated diffuse light irradiance
+    vec3 irradianceDiffuse  = shIrradiance(n) * albedo;
+
+
+    // Use precalculated specular light irradiance
+    vec3 r = reflect(-v, n);
+    r.z = -r.z;
+    vec3 fr = brdfFresnelRoughness(nDotV, f0, roughness);
+    //vec3 prefilteredColor = textureLod(prefilteredMap, r, roughness * MAX_REFLECTION_LOD).rgb;
+    vec3 prefilteredColor = texture(prefilteredMap, r).rgb;
+    vec2 envBRDF  = texture(brdfLutMap, vec2(nDotV, roughness)).rg;
+    vec3 irradianceSpecular = prefilteredColor * (fr * envBRDF.x + envBRDF.y);
+
+    vec3 irradiance = (kD * irradianceDiffuse + irradianceSpecular) * ao;
+
+    outColor.rgb = radiance + irradiance;
+
+    // reinhard tone mapping
+    outColor = outColor / (outColor + vec4(1.0));
+    outColor.a = 1.0;
+}
@@ -0,0 +1,89 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   PBR bindless vertex shader.
+ * -------------------------------------------------------------------------- */
+
+#version 450
+
+// -----------------------------------------------------------------------------
+// Per-draw data, indexed with the instance index.
+
+struct Draw
+{
+    mat4 model;
+    mat4 normal;
+    vec4 albedo;
+    float metallic;
+    float roughness;
+    float ao;
+    float padding;
+    ivec4 maps0; // ambient occlusion, base color, height, metallic
+    ivec4 maps1; // normal, roughness, unused, unused
+};
+
+layout(std430, binding = 0) readonly buffer Draws
+{
+    Draw draws[];
+};
+
+// -----------------------------------------------------------------------------
+// Per-frame data
+
+layout(binding = 1) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    mat4 light;
+    vec4 camPos;
+
+} frame;
+
+// -----------------------------------------------------------------------------
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec3 inNormal;
+layout(location = 3) in vec3 inTangent;
+layout(location = 4) in vec3 inBitangent;
+
+// -----------------------------------------------------------------------------
+
+layout(location = 0) out vec2 texCoord;
+layout(location = 1) out vec3 worldNormal;
+layout(location = 2) out vec3 worldPos;
+layout(location = 3) out vec4 lightPos;
+layout(location = 4) out mat3 tbn;
+layout(location = 7) flat out int drawIndex;
+
+// -----------------------------------------------------------------------------
+
+void main()
+{
+    drawIndex = gl_InstanceIndex;
+    mat4 model  = draws[drawIndex].model;
+    mat4 normal = draws[drawIndex].normal;
+
+    vec3 t = normalize(vec3(normal * vec4(inTangent,   0.0)));
+    vec3 b = normalize(vec3(normal * vec4(inBitangent, 0.0)));
+    vec3 n = normalize(vec3(normal * vec4(inNormal,    0.0)));
+
+    // re-orthogonalize T with respect to N
+    t = normalize(t - dot(t, n) * n);
+    b = cross(n, t);
+
+    gl_Position = frame.projection *
+                  frame.view *
+                  model * vec4(inPosition, 1.0);
+    texCoord    = inTexCoord * 4.0;
+    worldNormal = mat3(normal) * inNormal;
+    worldPos    = vec3(model * vec4(inPosition, 1.0));
+    tbn         = mat3(t, b, n);
+
+    const mat4 biasMat = mat4(
+        0.5, 0.0, 0.0, 0.0,
+        0.0, 0.5, 0.0, 0.0,
+        0.0, 0.0, 1.0, 0.0,
+        0.5, 0.5, 0.0, 1.0);
+
+    lightPos = biasMat * frame.light * model * vec4(inPosition, 1.0);
+}
@@ -21,8 +21,6 @@ layout(location = 0) out vec4 outColor;
 
 layout(binding = 0) uniform Uniforms
 {
-    mat4 view;
-    mat4 projection;
     float roughness;
 } data;
 
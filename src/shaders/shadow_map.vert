@@ -7,12 +7,19 @@
 
 // -----------------------------------------------------------------------------
 
-layout(binding = 0) uniform Matrices
+// Light space transforms of the shadow casters, the light matrix times the
+// world transform.
+layout(std430, binding = 0) readonly buffer Transforms
 {
-    mat4 model;
-    mat4 light;
+    mat4 transforms[];
+};
 
-} matrices;
+// Index of the first instance into transforms array.
+layout(push_constant) uniform FirstTransform
+{
+    uint index;
+
+} firstTransform;
 
 // -----------------------------------------------------------------------------
 
@@ -22,5 +29,6 @@ layout(location = 0) in vec3 inPosition;
 
 void main()
 {
-    gl_Position = matrices.light * matrices.model * vec4(inPosition, 1.0);
+    mat4 transform = transforms[firstTransform.index + gl_InstanceIndex];
+    gl_Position = transform * vec4(inPosition, 1.0);
 }
@@ -1,13 +1,28 @@
 /* -------------------------------------------------------------------------- *
    Antti Jumpponen <kuumies@gmail.com>
    Skybox fragment shader.
+
+   The sky is sampled from the sky-view LUT of the current frame and the
+   sun disk is attenuated with the transmittance LUT.
  * -------------------------------------------------------------------------- */
 
 #version 450
 
 // -----------------------------------------------------------------------------
 
-layout(binding = 1) uniform samplerCube skyboxMap;
+layout(binding = 1) uniform sampler2D skyViewLut;
+layout(binding = 2) uniform sampler2D transmittanceLut;
+
+layout(binding = 3) uniform Atmosphere
+{
+    vec4 rayleighScattering; // xyz per km, w scale height in km
+    vec4 mieScattering;      // xyz per km, w scale height in km
+    vec4 mieExtinction;      // xyz per km, w phase asymmetry
+    vec4 ozoneAbsorption;    // xyz per km, w center altitude in km
+    vec4 sunDir;             // xyz towards the sun, w illuminance
+    vec4 radii;              // x ground, y top, z camera altitude, w ground albedo
+
+} atmosphere;
 
 // -----------------------------------------------------------------------------
 
@@ -19,9 +34,36 @@ layout(location = 0) out vec4 outColor;
 
 // -----------------------------------------------------------------------------
 
+const float PI = 3.14159265359;
+// Cosine of the angular radius of the sun.
+const float SUN_COS = 0.99998;
+
+// -----------------------------------------------------------------------------
+
 void main()
 {
-    outColor = texture(skyboxMap, texCoord);
+    vec3 dir = normalize(texCoord);
+
+    // Inverse of the sky-view LUT mapping.
+    float elevation = asin(clamp(dir.y, -1.0, 1.0));
+    float azimuth   = atan(dir.z, dir.x);
+    vec2 uv = vec2(fract(azimuth / (2.0 * PI) + 1.0),
+                   0.5 + 0.5 * sign(elevation) * sqrt(abs(elevation) / (0.5 * PI)));
+
+    vec3 color = texture(skyViewLut, uv).rgb;
+
+    // Sun disk above the horizon.
+    vec3 sunDir = normalize(atmosphere.sunDir.xyz);
+    if (dot(dir, sunDir) > SUN_COS && dir.y > 0.0)
+    {
+        float radius = atmosphere.radii.x + atmosphere.radii.z;
+        vec2 transmittanceUv =
+            vec2(dir.y * 0.5 + 0.5,
+                 (radius - atmosphere.radii.x) / (atmosphere.radii.y - atmosphere.radii.x));
+        color += texture(transmittanceLut, transmittanceUv).rgb * atmosphere.sunDir.w;
+    }
+
+    outColor = vec4(color, 1.0);
     // reinhard tone mapping
     outColor = outColor / (outColor + vec4(1.0));
 }
@@ -24,9 +24,6 @@ class AtmosphereRenderer
 public:
     struct Params
     {
-        glm::vec4 viewport;
-        glm::mat4 inv_proj;
-        glm::mat4 inv_view_rot;
         glm::vec4 lightdir = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
         glm::vec4 Kr = glm::vec4(0.18867780436772762,
                                  0.4978442963618773,
@@ -43,14 +40,23 @@ public:
         float mieDistribution         = 0.63f;
     };
 
+    // Constructs the renderer of the atmosphere into a texture cube of the
+    // given in HDR format.
     AtmosphereRenderer(
         const VkPhysicalDevice& physicalDevice,
         const VkDevice& device,
-        const uint32_t& graphicsQueueFamilyIndex);
+        const VkFormat& format);
 
     void setLightDir(const glm::vec3& lightDir);
+    Params params() const;
 
-    void render();
+    // Records the rendering of the atmosphere into the texture cube. The
+    // renderer needs to be alive until the commands have been executed.
+    // Returns false if the recording failed.
+    bool record(const VkCommandBuffer& cmdBuf);
+
+    // Returns the key of the texture cube in the bake cache.
+    uint64_t cacheKey() const;
 
     std::shared_ptr<TextureCube> textureCube() const;
 
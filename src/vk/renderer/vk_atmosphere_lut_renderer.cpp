@@ -0,0 +1,380 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::AtmosphereLutRenderer class
+ * -------------------------------------------------------------------------- */
+
+#include "vk_atmosphere_lut_renderer.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <glm/geometric.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* -------------------------------------------------------------------------- */
+
+#include "../vk_buffer.h"
+#include "../vk_descriptor_set.h"
+#include "../vk_image_layout_transition.h"
+#include "../vk_pipeline_cache.h"
+#include "../vk_shader_module.h"
+#include "../vk_shader_registry.h"
+#include "../vk_stringify.h"
+#include "../vk_texture.h"
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+struct AtmosphereLutRenderer::Impl
+{
+    // A compute pass writing a LUT.
+    struct Pass
+    {
+        std::shared_ptr<ShaderModule> shaderModule;
+        std::shared_ptr<DescriptorSets> descriptorSet;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        std::shared_ptr<Texture2D> lut;
+    };
+
+    Impl(const VkPhysicalDevice& physicalDevice,
+         const VkDevice& device)
+        : physicalDevice(physicalDevice)
+        , device(device)
+    {
+        valid = createLuts()           &&
+                createParamsBuffer()   &&
+                createDescriptorSets() &&
+                createPipelines();
+    }
+
+    ~Impl()
+    {
+        for (Pass* pass : { &transmittancePass, &multiScatteringPass, &skyViewPass })
+            vkDestroyPipeline(device, pass->pipeline, NULL);
+
+        vkDestroyPipelineLayout(
+            device,
+            pipelineLayout,
+            NULL);
+    }
+
+    std::shared_ptr<Texture2D> createLut(uint32_t width,
+                                         uint32_t height,
+                                         VkSamplerAddressMode addressModeU)
+    {
+        return std::make_shared<Texture2D>(
+            physicalDevice,
+            device,
+            VkExtent2D { width, height },
+            VK_FORMAT_R16G16B16A16_SFLOAT,
+            VK_FILTER_LINEAR,
+            VK_FILTER_LINEAR,
+            addressModeU,
+            VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            VK_IMAGE_USAGE_STORAGE_BIT |
+            VK_IMAGE_USAGE_SAMPLED_BIT);
+    }
+
+    bool createLuts()
+    {
+        // Sizes from the paper, the azimuth of the sky-view wraps around.
+        transmittancePass.lut   = createLut(256, 64,  VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+        multiScatteringPass.lut = createLut(32,  32,  VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+        skyViewPass.lut         = createLut(192, 108, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+        return transmittancePass.lut->sampler   != VK_NULL_HANDLE &&
+               multiScatteringPass.lut->sampler != VK_NULL_HANDLE &&
+               skyViewPass.lut->sampler         != VK_NULL_HANDLE;
+    }
+
+    bool createParamsBuffer()
+    {
+        paramsBuffer = std::make_shared<Buffer>(physicalDevice, device);
+        paramsBuffer->setSize(sizeof(Params));
+        paramsBuffer->setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        paramsBuffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (!paramsBuffer->create())
+            return false;
+
+        paramsBuffer->copyHostVisible(&params, paramsBuffer->size());
+        return true;
+    }
+
+    // The passes share a layout: params, transmittance LUT, multiple
+    // scattering LUT and the output LUT. A pass only writes the bindings
+    // its shader uses.
+    bool createDescriptorSets()
+    {
+        descriptorPool = std::make_shared<DescriptorPool>(device);
+        descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         3);
+        descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3);
+        descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          3);
+        descriptorPool->setMaxCount(3);
+        if (!descriptorPool->create())
+            return false;
+
+        for (Pass* pass : { &transmittancePass, &multiScatteringPass, &skyViewPass })
+        {
+            pass->descriptorSet =
+                std::make_shared<DescriptorSets>(device, descriptorPool->handle());
+            if (pass == &transmittancePass)
+            {
+                pass->descriptorSet->addLayoutBinding(
+                    0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+                    VK_SHADER_STAGE_COMPUTE_BIT);
+                pass->descriptorSet->addLayoutBinding(
+                    1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                    VK_SHADER_STAGE_COMPUTE_BIT);
+                pass->descriptorSet->addLayoutBinding(
+                    2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                    VK_SHADER_STAGE_COMPUTE_BIT);
+                pass->descriptorSet->addLayoutBinding(
+                    3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
+                    VK_SHADER_STAGE_COMPUTE_BIT);
+            }
+            else
+            {
+                pass->descriptorSet->setLayout(
+                    transmittancePass.descriptorSet->layoutHandle());
+            }
+
+            if (!pass->descriptorSet->create())
+                return false;
+
+            pass->descriptorSet->writeUniformBuffer(
+                0, paramsBuffer->handle(),
+                0, paramsBuffer->size());
+
+            pass->descriptorSet->writeStorageImage(
+                3,
+                pass->lut->imageView,
+                VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        for (Pass* pass : { &multiScatteringPass, &skyViewPass })
+            pass->descriptorSet->writeImage(
+                1,
+                transmittancePass.lut->sampler,
+                transmittancePass.lut->imageView,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        skyViewPass.descriptorSet->writeImage(
+            2,
+            multiScatteringPass.lut->sampler,
+            multiScatteringPass.lut->imageView,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        return true;
+    }
+
+    bool createPipeline(Pass& pass, const std::string& shaderFilePath)
+    {
+        pass.shaderModule = shader_registry::module(
+            device, shaderFilePath, VK_SHADER_STAGE_COMPUTE_BIT);
+        if (!pass.shaderModule)
+            return false;
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage  = pass.shaderModule->createInfo();
+        pipelineInfo.layout = pipelineLayout;
+
+        const VkResult result =
+            vkCreateComputePipelines(
+                device,
+                PipelineCache::deviceCache(device),
+                1,
+                &pipelineInfo,
+                NULL,
+                &pass.pipeline);
+
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": compute pipeline creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool createPipelines()
+    {
+        const VkDescriptorSetLayout descriptorSetLayout =
+            transmittancePass.descriptorSet->layoutHandle();
+
+        VkPipelineLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pSetLayouts    = &descriptorSetLayout;
+
+        const VkResult result =
+            vkCreatePipelineLayout(
+                device,
+                &layoutInfo,
+                NULL,
+                &pipelineLayout);
+
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": compute pipeline layout creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+
+        return createPipeline(transmittancePass,   "shaders/atmosphere_transmittance.comp.spv")    &&
+               createPipeline(multiScatteringPass, "shaders/atmosphere_multi_scattering.comp.spv") &&
+               createPipeline(skyViewPass,         "shaders/atmosphere_sky_view.comp.spv");
+    }
+
+    // Records the pass from the given in layout into shader read-only
+    // layout.
+    void recordPass(const VkCommandBuffer& cmdBuf,
+                    const Pass& pass,
+                    VkImageLayout oldLayout,
+                    VkPipelineStageFlags srcStage)
+    {
+        image_layout_transition::record(
+            cmdBuf,
+            pass.lut->image,
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            oldLayout,
+            VK_IMAGE_LAYOUT_GENERAL,
+            srcStage,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        vkCmdBindPipeline(
+            cmdBuf,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            pass.pipeline);
+
+        VkDescriptorSet descriptorHandle = pass.descriptorSet->handle();
+        vkCmdBindDescriptorSets(
+            cmdBuf,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            pipelineLayout, 0,
+            1, &descriptorHandle, 0, NULL);
+
+        const VkExtent2D extent = pass.lut->extent;
+        vkCmdDispatch(cmdBuf,
+                      (extent.width  + 7) / 8,
+                      (extent.height + 7) / 8,
+                      1);
+
+        image_layout_transition::record(
+            cmdBuf,
+            pass.lut->image,
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    // Input Vulkan handles
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+
+    // Parameters
+    Params params;
+    std::shared_ptr<Buffer> paramsBuffer;
+
+    // Passes
+    Pass transmittancePass;
+    Pass multiScatteringPass;
+    Pass skyViewPass;
+
+    // Descriptors and the shared pipeline layout.
+    std::shared_ptr<DescriptorPool> descriptorPool;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+
+    // True if the resources were created.
+    bool valid = false;
+};
+
+/* -------------------------------------------------------------------------- */
+
+AtmosphereLutRenderer::AtmosphereLutRenderer(
+        const VkPhysicalDevice& physicalDevice,
+        const VkDevice& device)
+    : impl(std::make_shared<Impl>(physicalDevice, device))
+{}
+
+void AtmosphereLutRenderer::setLightDir(const glm::vec3& lightDir)
+{
+    if (!impl->valid)
+        return;
+
+    // Same convention as in the atmosphere shader of the texture cube.
+    const glm::vec3 sunDir = glm::normalize(glm::vec3(-lightDir.x,
+                                                      -lightDir.y,
+                                                       lightDir.z));
+    impl->params.sunDir = glm::vec4(sunDir, impl->params.sunDir.w);
+    impl->paramsBuffer->copyHostVisible(&impl->params, impl->paramsBuffer->size());
+}
+
+bool AtmosphereLutRenderer::recordPrecomputed(const VkCommandBuffer& cmdBuf)
+{
+    if (!impl->valid)
+        return false;
+
+    impl->recordPass(cmdBuf,
+                     impl->transmittancePass,
+                     VK_IMAGE_LAYOUT_UNDEFINED,
+                     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+    impl->recordPass(cmdBuf,
+                     impl->multiScatteringPass,
+                     VK_IMAGE_LAYOUT_UNDEFINED,
+                     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+    // The per-frame pass expects the sky-view to be in shader read-only
+    // layout.
+    image_layout_transition::record(
+        cmdBuf,
+        impl->skyViewPass.lut->image,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+    return true;
+}
+
+void AtmosphereLutRenderer::recordSkyView(const VkCommandBuffer& cmdBuf)
+{
+    if (!impl->valid)
+        return;
+
+    // Waits until the previous frame has sampled the LUT.
+    impl->recordPass(cmdBuf,
+                     impl->skyViewPass,
+                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+std::shared_ptr<Buffer> AtmosphereLutRenderer::paramsBuffer() const
+{ return impl->paramsBuffer; }
+
+std::shared_ptr<Texture2D> AtmosphereLutRenderer::transmittance() const
+{ return impl->transmittancePass.lut; }
+
+std::shared_ptr<Texture2D> AtmosphereLutRenderer::multiScattering() const
+{ return impl->multiScatteringPass.lut; }
+
+std::shared_ptr<Texture2D> AtmosphereLutRenderer::skyView() const
+{ return impl->skyViewPass.lut; }
+
+} // namespace vk
+} // namespace kuu
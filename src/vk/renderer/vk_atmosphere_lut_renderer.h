@@ -0,0 +1,84 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::AtmosphereLutRenderer class
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <memory>
+#include <vulkan/vulkan.h>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+class Buffer;
+struct Texture2D;
+
+/* -------------------------------------------------------------------------- *
+   Computes the lookup tables of a physically based atmosphere.
+
+   The transmittance and multiple scattering LUTs depend only on the
+   atmosphere and are computed once. The small sky-view LUT depends on the
+   sun direction and is cheap enough to be computed every frame. Distances
+   are in kilometers.
+ * -------------------------------------------------------------------------- */
+class AtmosphereLutRenderer
+{
+public:
+    // Parameters of the earth atmosphere, matches the uniform block of the
+    // atmosphere shaders.
+    struct Params
+    {
+        // xyz per km, w scale height in km
+        glm::vec4 rayleighScattering = glm::vec4(5.802e-3f, 13.558e-3f, 33.1e-3f, 8.0f);
+        // xyz per km, w scale height in km
+        glm::vec4 mieScattering = glm::vec4(3.996e-3f, 3.996e-3f, 3.996e-3f, 1.2f);
+        // xyz per km, w phase asymmetry
+        glm::vec4 mieExtinction = glm::vec4(4.40e-3f, 4.40e-3f, 4.40e-3f, 0.8f);
+        // xyz per km, w center altitude in km
+        glm::vec4 ozoneAbsorption = glm::vec4(0.650e-3f, 1.881e-3f, 0.085e-3f, 25.0f);
+        // xyz towards the sun, w illuminance
+        glm::vec4 sunDir = glm::vec4(0.0f, 1.0f, 0.0f, 20.0f);
+        // x ground, y top, z camera altitude, w ground albedo
+        glm::vec4 radii = glm::vec4(6360.0f, 6460.0f, 0.2f, 0.3f);
+    };
+
+    AtmosphereLutRenderer(const VkPhysicalDevice& physicalDevice,
+                          const VkDevice& device);
+
+    // Sets the light direction. The sun is in the same direction as in the
+    // baked atmosphere texture cube.
+    void setLightDir(const glm::vec3& lightDir);
+
+    // Records the computing of the transmittance and multiple scattering
+    // LUTs. The sky-view LUT is left into shader read-only layout. The
+    // renderer needs to be alive until the commands have been executed.
+    // Returns false if the recording failed.
+    bool recordPrecomputed(const VkCommandBuffer& cmdBuf);
+
+    // Records the computing of the sky-view LUT. This needs to be recorded
+    // outside of a render pass before the sky is rendered.
+    void recordSkyView(const VkCommandBuffer& cmdBuf);
+
+    // Returns the uniform buffer of the parameters.
+    std::shared_ptr<Buffer> paramsBuffer() const;
+
+    std::shared_ptr<Texture2D> transmittance() const;
+    std::shared_ptr<Texture2D> multiScattering() const;
+    std::shared_ptr<Texture2D> skyView() const;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,613 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::BakeCache class
+ * -------------------------------------------------------------------------- */
+
+#include "vk_bake_cache.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+#include <QtCore/QDir>
+
+/* -------------------------------------------------------------------------- */
+
+#include "../vk_buffer.h"
+#include "../vk_command.h"
+#include "../vk_image_layout_transition.h"
+#include "../vk_queue.h"
+#include "../vk_shader_registry.h"
+#include "../vk_texture.h"
+
+namespace kuu
+{
+namespace vk
+{
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Identifies the cache file and the version of its layout.
+const char CACHE_MAGIC[4] = { 'K', 'B', 'C', '1' };
+
+// Header of the cache file, followed by the bake data.
+struct CacheHeader
+{
+    char magic[4];
+    uint64_t key;
+    uint64_t size;
+};
+
+/* -------------------------------------------------------------------------- *
+   Returns the size of a texel of the format in bytes or zero if the format
+   is not supported by the cache.
+ * -------------------------------------------------------------------------- */
+VkDeviceSize texelSize(VkFormat format)
+{
+    switch(format)
+    {
+        case VK_FORMAT_R8G8B8A8_UNORM:           return 4;
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:  return 4;
+        case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:   return 4;
+        case VK_FORMAT_R16G16_SFLOAT:            return 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:      return 8;
+        case VK_FORMAT_R32G32_SFLOAT:            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:      return 16;
+        default: return 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- *
+   Describes the image data of a texture in tightly packed mipmap levels,
+   layers of a level are consecutive.
+ * -------------------------------------------------------------------------- */
+struct ImageData
+{
+    ImageData(VkImage image,
+              VkFormat format,
+              VkExtent2D extent,
+              uint32_t mipmapCount,
+              uint32_t layerCount)
+        : image(image)
+        , size(0)
+    {
+        const VkDeviceSize texel = texelSize(format);
+        for (uint32_t m = 0; m < mipmapCount; ++m)
+        {
+            const uint32_t w = std::max(extent.width  >> m, 1u);
+            const uint32_t h = std::max(extent.height >> m, 1u);
+
+            VkBufferImageCopy region = {};
+            region.bufferOffset                    = size;
+            region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel       = m;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount     = layerCount;
+            region.imageExtent                     = { w, h, 1 };
+            regions.push_back(region);
+
+            size += w * h * texel * layerCount;
+        }
+
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.levelCount = mipmapCount;
+        range.layerCount = layerCount;
+
+        if (texel == 0)
+            size = 0;
+    }
+
+    VkImage image;
+    VkDeviceSize size;
+    VkImageSubresourceRange range = {};
+    std::vector<VkBufferImageCopy> regions;
+};
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- */
+
+struct BakeCache::Impl
+{
+    // Returns the file path of the bake.
+    std::string filePath(const std::string& name, uint64_t key) const
+    {
+        std::stringstream ss;
+        ss << dirPath << "/" << name << "_" << std::hex << key << ".bin";
+        return ss.str();
+    }
+
+    // Reads the bake data from the cache file. Returns false if the file
+    // does not exist or does not match the key and size.
+    bool read(const std::string& name,
+              uint64_t key,
+              VkDeviceSize size,
+              std::vector<char>& data) const
+    {
+        if (size == 0)
+            return false;
+
+        std::ifstream file(filePath(name, key), std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        CacheHeader header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file                                                      ||
+            std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+            header.key  != key                                         ||
+            header.size != size)
+        {
+            return false;
+        }
+
+        data.resize(size);
+        file.read(data.data(), std::streamsize(size));
+        return bool(file);
+    }
+
+    // Writes the bake data into the cache file.
+    bool write(const std::string& name,
+               uint64_t key,
+               const std::vector<char>& data) const
+    {
+        if (!QDir().mkpath(QString::fromStdString(dirPath)))
+        {
+            std::cerr << __FUNCTION__
+                      << ": failed to create cache directory "
+                      << dirPath
+                      << std::endl;
+            return false;
+        }
+
+        const std::string path = filePath(name, key);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << __FUNCTION__
+                      << ": failed to open cache file "
+                      << path
+                      << std::endl;
+            return false;
+        }
+
+        CacheHeader header = {};
+        std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.key  = key;
+        header.size = data.size();
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(data.data(), std::streamsize(data.size()));
+        return bool(file);
+    }
+
+    // Creates a host visible staging buffer.
+    std::shared_ptr<Buffer> createStagingBuffer(VkDeviceSize size,
+                                                VkBufferUsageFlags usage)
+    {
+        std::shared_ptr<Buffer> buffer =
+            std::make_shared<Buffer>(physicalDevice, device);
+        buffer->setSize(size);
+        buffer->setUsage(usage);
+        buffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (!buffer->create())
+            return nullptr;
+        return buffer;
+    }
+
+    // Records the commands with the function, submits them and waits until
+    // the queue is idle.
+    bool submit(std::function<void(VkCommandBuffer)> record)
+    {
+        CommandPool commandPool(device);
+        commandPool.setQueueFamilyIndex(graphicsQueueFamilyIndex);
+        if (!commandPool.create())
+            return false;
+
+        VkCommandBuffer cmdBuf =
+            commandPool.allocateBuffer(
+                VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(cmdBuf, &beginInfo);
+
+        record(cmdBuf);
+
+        if (vkEndCommandBuffer(cmdBuf) != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": cache transfer commands failed"
+                      << std::endl;
+            return false;
+        }
+
+        Queue graphicsQueue(device, graphicsQueueFamilyIndex, 0);
+        graphicsQueue.create();
+        if (!graphicsQueue.submit(cmdBuf,
+                                  VK_NULL_HANDLE,
+                                  VK_NULL_HANDLE,
+                                  VK_PIPELINE_STAGE_TRANSFER_BIT))
+        {
+            return false;
+        }
+        return graphicsQueue.waitIdle();
+    }
+
+    bool restoreImage(const std::string& name,
+                      uint64_t key,
+                      const ImageData& image)
+    {
+        std::vector<char> data;
+        if (!read(name, key, image.size, data))
+            return false;
+        return uploadImage(data, image);
+    }
+
+    bool uploadImage(const std::vector<char>& data, const ImageData& image)
+    {
+        if (image.size == 0 || data.size() != image.size)
+        {
+            std::cerr << __FUNCTION__
+                      << ": image data does not match the texture"
+                      << std::endl;
+            return false;
+        }
+
+        std::shared_ptr<Buffer> staging =
+            createStagingBuffer(image.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+        if (!staging)
+            return false;
+        staging->copyHostVisible(data.data(), data.size());
+
+        return submit([&](VkCommandBuffer cmdBuf)
+        {
+            image_layout_transition::record(
+                cmdBuf,
+                image.image,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                image.range,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+            vkCmdCopyBufferToImage(
+                cmdBuf,
+                staging->handle(),
+                image.image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                uint32_t(image.regions.size()),
+                image.regions.data());
+
+            image_layout_transition::record(
+                cmdBuf,
+                image.image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                image.range,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        });
+    }
+
+    bool storeImage(const std::string& name,
+                    uint64_t key,
+                    const ImageData& image)
+    {
+        if (image.size == 0)
+        {
+            std::cerr << __FUNCTION__
+                      << ": texture format of " << name
+                      << " is not supported by the cache"
+                      << std::endl;
+            return false;
+        }
+
+        std::vector<char> data;
+        if (!downloadImage(image, data))
+            return false;
+
+        return write(name, key, data);
+    }
+
+    bool downloadImage(const ImageData& image, std::vector<char>& data)
+    {
+        if (image.size == 0)
+            return false;
+
+        std::shared_ptr<Buffer> staging =
+            createStagingBuffer(image.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+        if (!staging)
+            return false;
+
+        const bool copied = submit([&](VkCommandBuffer cmdBuf)
+        {
+            image_layout_transition::record(
+                cmdBuf,
+                image.image,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                image.range,
+                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+            vkCmdCopyImageToBuffer(
+                cmdBuf,
+                image.image,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                staging->handle(),
+                uint32_t(image.regions.size()),
+                image.regions.data());
+
+            image_layout_transition::record(
+                cmdBuf,
+                image.image,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                image.range,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        });
+        if (!copied)
+            return false;
+
+        data.resize(image.size);
+        std::memcpy(data.data(), staging->map(), data.size());
+        staging->unmap();
+        return true;
+    }
+
+    // Records a barrier that makes the transfer writes of the buffer visible
+    // or the shader writes of the buffer available to transfer.
+    void recordBufferBarrier(VkCommandBuffer cmdBuf,
+                             VkBuffer buffer,
+                             VkAccessFlags srcAccessMask,
+                             VkAccessFlags dstAccessMask,
+                             VkPipelineStageFlags srcStageMask,
+                             VkPipelineStageFlags dstStageMask)
+    {
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask       = srcAccessMask;
+        barrier.dstAccessMask       = dstAccessMask;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer              = buffer;
+        barrier.offset              = 0;
+        barrier.size                = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(
+            cmdBuf,
+            srcStageMask,
+            dstStageMask,
+            0,
+            0, NULL,
+            1, &barrier,
+            0, NULL);
+    }
+
+    // Input Vulkan handles
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+
+    // Graphics queue.
+    uint32_t graphicsQueueFamilyIndex;
+
+    // Cache directory
+    std::string dirPath;
+};
+
+/* -------------------------------------------------------------------------- */
+
+BakeCache::BakeCache(const VkPhysicalDevice& physicalDevice,
+                     const VkDevice& device,
+                     const uint32_t& graphicsQueueFamilyIndex,
+                     const std::string& dirPath)
+    : impl(std::make_shared<Impl>())
+{
+    impl->physicalDevice           = physicalDevice;
+    impl->device                   = device;
+    impl->graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+    impl->dirPath                  = dirPath;
+}
+
+uint64_t BakeCache::hash(const void* data, size_t size, uint64_t key)
+{
+    // FNV-1a
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        key ^= bytes[i];
+        key *= 1099511628211ULL;
+    }
+    return key;
+}
+
+uint64_t BakeCache::hashFile(const std::string& filePath, uint64_t key)
+{
+    std::ifstream file(filePath, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+    return hash(data.data(), data.size(), key);
+}
+
+uint64_t BakeCache::hashShader(const std::string& filePath, uint64_t key)
+{
+    const std::vector<char> source = shader_registry::embeddedSource(filePath);
+    if (source.empty())
+        return hashFile(filePath, key);
+    return hash(source.data(), source.size(), key);
+}
+
+bool BakeCache::restore(const std::string& name,
+                        uint64_t key,
+                        std::shared_ptr<TextureCube> textureCube)
+{
+    const ImageData image(textureCube->image,
+                          textureCube->format,
+                          textureCube->extent,
+                          textureCube->mipmapCount,
+                          6);
+    return impl->restoreImage(name, key, image);
+}
+
+bool BakeCache::restore(const std::string& name,
+                        uint64_t key,
+                        std::shared_ptr<Texture2D> texture)
+{
+    const ImageData image(texture->image,
+                          texture->format,
+                          texture->extent,
+                          texture->mipmapCount,
+                          1);
+    return impl->restoreImage(name, key, image);
+}
+
+bool BakeCache::upload(const std::vector<char>& data,
+                       std::shared_ptr<TextureCube> textureCube)
+{
+    const ImageData image(textureCube->image,
+                          textureCube->format,
+                          textureCube->extent,
+                          textureCube->mipmapCount,
+                          6);
+    return impl->uploadImage(data, image);
+}
+
+bool BakeCache::upload(const std::vector<char>& data,
+                       std::shared_ptr<Texture2D> texture)
+{
+    const ImageData image(texture->image,
+                          texture->format,
+                          texture->extent,
+                          texture->mipmapCount,
+                          1);
+    return impl->uploadImage(data, image);
+}
+
+bool BakeCache::restore(const std::string& name,
+                        uint64_t key,
+                        std::shared_ptr<Buffer> buffer)
+{
+    std::vector<char> data;
+    if (!impl->read(name, key, buffer->size(), data))
+        return false;
+
+    std::shared_ptr<Buffer> staging =
+        impl->createStagingBuffer(buffer->size(),
+                                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    if (!staging)
+        return false;
+    staging->copyHostVisible(data.data(), data.size());
+
+    return impl->submit([&](VkCommandBuffer cmdBuf)
+    {
+        VkBufferCopy region = {};
+        region.size = buffer->size();
+        vkCmdCopyBuffer(cmdBuf, staging->handle(), buffer->handle(), 1, &region);
+
+        impl->recordBufferBarrier(
+            cmdBuf,
+            buffer->handle(),
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    });
+}
+
+bool BakeCache::download(std::shared_ptr<TextureCube> textureCube,
+                         std::vector<char>& data)
+{
+    const ImageData image(textureCube->image,
+                          textureCube->format,
+                          textureCube->extent,
+                          textureCube->mipmapCount,
+                          6);
+    return impl->downloadImage(image, data);
+}
+
+bool BakeCache::download(std::shared_ptr<Texture2D> texture,
+                         std::vector<char>& data)
+{
+    const ImageData image(texture->image,
+                          texture->format,
+                          texture->extent,
+                          texture->mipmapCount,
+                          1);
+    return impl->downloadImage(image, data);
+}
+
+bool BakeCache::store(const std::string& name,
+                      uint64_t key,
+                      std::shared_ptr<TextureCube> textureCube)
+{
+    const ImageData image(textureCube->image,
+                          textureCube->format,
+                          textureCube->extent,
+                          textureCube->mipmapCount,
+                          6);
+    return impl->storeImage(name, key, image);
+}
+
+bool BakeCache::store(const std::string& name,
+                      uint64_t key,
+                      std::shared_ptr<Texture2D> texture)
+{
+    const ImageData image(texture->image,
+                          texture->format,
+                          texture->extent,
+                          texture->mipmapCount,
+                          1);
+    return impl->storeImage(name, key, image);
+}
+
+bool BakeCache::store(const std::string& name,
+                      uint64_t key,
+                      std::shared_ptr<Buffer> buffer)
+{
+    std::shared_ptr<Buffer> staging =
+        impl->createStagingBuffer(buffer->size(),
+                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    if (!staging)
+        return false;
+
+    const bool copied = impl->submit([&](VkCommandBuffer cmdBuf)
+    {
+        impl->recordBufferBarrier(
+            cmdBuf,
+            buffer->handle(),
+            VK_ACCESS_SHADER_WRITE_BIT,
+            VK_ACCESS_TRANSFER_READ_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        VkBufferCopy region = {};
+        region.size = buffer->size();
+        vkCmdCopyBuffer(cmdBuf, buffer->handle(), staging->handle(), 1, &region);
+    });
+    if (!copied)
+        return false;
+
+    std::vector<char> data(buffer->size());
+    std::memcpy(data.data(), staging->map(), data.size());
+    staging->unmap();
+
+    return impl->write(name, key, data);
+}
+
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,105 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::BakeCache class
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+class Buffer;
+struct Texture2D;
+struct TextureCube;
+
+/* -------------------------------------------------------------------------- *
+   A persistent disk cache of baked textures and buffers.
+
+   A bake is stored into a file named by the bake name and key. The key is
+   built by the user from the bake parameters and from the SPIR-V of the
+   bake shaders so a changed parameter or shader misses the cache. A cached
+   bake is restored with a single upload and the texture is in shader
+   read-only layout afterwards.
+ * -------------------------------------------------------------------------- */
+class BakeCache
+{
+public:
+    // Initial key of the hash functions.
+    static const uint64_t EMPTY_KEY = 14695981039346656037ULL;
+
+    // Constructs the cache of bakes within the given in directory.
+    BakeCache(const VkPhysicalDevice& physicalDevice,
+              const VkDevice& device,
+              const uint32_t& graphicsQueueFamilyIndex,
+              const std::string& dirPath = "cache");
+
+    // Hashes the data into the key.
+    static uint64_t hash(const void* data, size_t size,
+                         uint64_t key = EMPTY_KEY);
+    // Hashes the content of the file into the key, e.g. the SPIR-V of a
+    // shader. Missing file is hashed as an empty file.
+    static uint64_t hashFile(const std::string& filePath,
+                             uint64_t key = EMPTY_KEY);
+    // Hashes the SPIR-V of the shader into the key. The SPIR-V embedded
+    // into the binary is hashed if available, otherwise the file.
+    static uint64_t hashShader(const std::string& filePath,
+                               uint64_t key = EMPTY_KEY);
+
+    // Restores the bake from the cache. Returns false if the cache does not
+    // contain the bake of given in name and key.
+    bool restore(const std::string& name,
+                 uint64_t key,
+                 std::shared_ptr<TextureCube> textureCube);
+    bool restore(const std::string& name,
+                 uint64_t key,
+                 std::shared_ptr<Texture2D> texture);
+    bool restore(const std::string& name,
+                 uint64_t key,
+                 std::shared_ptr<Buffer> buffer);
+
+    // Uploads the bake data in the layout of the cache into the texture,
+    // e.g. a bake of the CPU. The texture is in shader read-only layout
+    // afterwards. Returns false if the data does not match the texture.
+    bool upload(const std::vector<char>& data,
+                std::shared_ptr<TextureCube> textureCube);
+    bool upload(const std::vector<char>& data,
+                std::shared_ptr<Texture2D> texture);
+
+    // Downloads the bake data in the layout of the cache from the texture,
+    // e.g. to compare with a bake of the CPU. The texture needs to be in
+    // shader read-only layout. Returns false if the download failed.
+    bool download(std::shared_ptr<TextureCube> textureCube,
+                  std::vector<char>& data);
+    bool download(std::shared_ptr<Texture2D> texture,
+                  std::vector<char>& data);
+
+    // Stores the bake into the cache. Textures need to be in shader
+    // read-only layout. Returns false if the bake could not be stored.
+    bool store(const std::string& name,
+               uint64_t key,
+               std::shared_ptr<TextureCube> textureCube);
+    bool store(const std::string& name,
+               uint64_t key,
+               std::shared_ptr<Texture2D> texture);
+    bool store(const std::string& name,
+               uint64_t key,
+               std::shared_ptr<Buffer> buffer);
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,197 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::BakeGraph class
+ * -------------------------------------------------------------------------- */
+
+#include "vk_bake_graph.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+/* -------------------------------------------------------------------------- */
+
+#include "../vk_command.h"
+#include "../vk_queue.h"
+#include "../vk_stringify.h"
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+struct BakeGraph::Impl
+{
+    struct Pass
+    {
+        Record record;
+        // Passes of a level only depend on the passes of earlier levels.
+        int level;
+    };
+
+    // Input Vulkan handles
+    VkDevice device;
+
+    // Graphics queue.
+    uint32_t graphicsQueueFamilyIndex;
+
+    // Passes in the order of adding.
+    std::vector<Pass> passes;
+};
+
+/* -------------------------------------------------------------------------- */
+
+BakeGraph::BakeGraph(const VkDevice& device,
+                     const uint32_t& graphicsQueueFamilyIndex)
+    : impl(std::make_shared<Impl>())
+{
+    impl->device                   = device;
+    impl->graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+}
+
+int BakeGraph::addPass(const Record& record,
+                       const std::vector<int>& dependencies)
+{
+    const int index = int(impl->passes.size());
+
+    int level = 0;
+    for (int dependency : dependencies)
+    {
+        if (dependency < 0 || dependency >= index)
+        {
+            std::cerr << __FUNCTION__
+                      << ": pass can only depend on earlier passes"
+                      << std::endl;
+            continue;
+        }
+        level = std::max(level, impl->passes[dependency].level + 1);
+    }
+
+    impl->passes.push_back( { record, level } );
+    return index;
+}
+
+bool BakeGraph::isEmpty() const
+{ return impl->passes.empty(); }
+
+void BakeGraph::recordBarrier(const VkCommandBuffer& cmdBuf)
+{
+    VkMemoryBarrier barrier = {};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_SHADER_WRITE_BIT           |
+                            VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT  |
+                            VK_ACCESS_UNIFORM_READ_BIT |
+                            VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(
+        cmdBuf,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT         |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT          |
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT         |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT          |
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &barrier,
+        0, NULL,
+        0, NULL);
+}
+
+bool BakeGraph::execute()
+{
+    if (impl->passes.empty())
+        return true;
+
+    //--------------------------------------------------------------------------
+    // Record the passes level by level.
+
+    CommandPool commandPool(impl->device);
+    commandPool.setQueueFamilyIndex(impl->graphicsQueueFamilyIndex);
+    if (!commandPool.create())
+        return false;
+
+    VkCommandBuffer cmdBuf =
+        commandPool.allocateBuffer(
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmdBuf, &beginInfo);
+
+    int levelCount = 0;
+    for (const Impl::Pass& pass : impl->passes)
+        levelCount = std::max(levelCount, pass.level + 1);
+
+    for (int level = 0; level < levelCount; ++level)
+    {
+        if (level > 0)
+            recordBarrier(cmdBuf);
+
+        for (const Impl::Pass& pass : impl->passes)
+        {
+            if (pass.level != level)
+                continue;
+
+            if (!pass.record(cmdBuf))
+            {
+                vkEndCommandBuffer(cmdBuf);
+                return false;
+            }
+        }
+    }
+
+    VkResult result = vkEndCommandBuffer(cmdBuf);
+    if (result != VK_SUCCESS)
+    {
+        std::cerr << __FUNCTION__
+                  << ": bake commands failed as "
+                  << vk::stringify::resultDesc(result)
+                  << std::endl;
+        return false;
+    }
+
+    //--------------------------------------------------------------------------
+    // Submit once and wait for the fence.
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence = VK_NULL_HANDLE;
+    result = vkCreateFence(impl->device, &fenceInfo, NULL, &fence);
+    if (result != VK_SUCCESS)
+    {
+        std::cerr << __FUNCTION__
+                  << ": fence creation failed as "
+                  << vk::stringify::resultDesc(result)
+                  << std::endl;
+        return false;
+    }
+
+    Queue graphicsQueue(impl->device, impl->graphicsQueueFamilyIndex, 0);
+    graphicsQueue.create();
+    bool ok = graphicsQueue.submit(cmdBuf,
+                                   VK_NULL_HANDLE,
+                                   VK_NULL_HANDLE,
+                                   0,
+                                   fence);
+    if (ok)
+    {
+        result = vkWaitForFences(impl->device, 1, &fence, VK_TRUE,
+                                 std::numeric_limits<uint64_t>::max());
+        ok = result == VK_SUCCESS;
+    }
+
+    vkDestroyFence(impl->device, fence, NULL);
+    return ok;
+}
+
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,60 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::BakeGraph class
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- *
+   A graph of dependent bake passes recorded into a single command buffer.
+
+   A pass is recorded after the passes it depends on. Passes are grouped
+   into levels by their dependencies and a single memory barrier separates
+   the levels so the passes of a level can overlap on the GPU. The command
+   buffer is submitted once and the host waits for a fence at the end.
+ * -------------------------------------------------------------------------- */
+class BakeGraph
+{
+public:
+    // Records the commands of a pass. Returns false if the recording failed.
+    using Record = std::function<bool(const VkCommandBuffer&)>;
+
+    // Constructs the graph that is executed in the given in queue family.
+    BakeGraph(const VkDevice& device,
+              const uint32_t& graphicsQueueFamilyIndex);
+
+    // Adds a pass. Dependencies are indices of earlier added passes whose
+    // output the pass reads. Returns the index of the pass.
+    int addPass(const Record& record,
+                const std::vector<int>& dependencies = std::vector<int>());
+
+    // Returns true if the graph does not contain passes.
+    bool isEmpty() const;
+
+    // Records the passes, submits the commands and waits until they have
+    // been executed. Returns false if the recording or execution failed.
+    bool execute();
+
+    // Records a barrier that makes the outputs of the earlier passes
+    // visible to the shaders and transfers of the later passes.
+    static void recordBarrier(const VkCommandBuffer& cmdBuf);
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,431 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::cpu_baker namespace.
+ * -------------------------------------------------------------------------- */
+
+#include "vk_cpu_baker.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <glm/geometric.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/* -------------------------------------------------------------------------- */
+
+#include "vk_cube_baker.h"
+
+namespace kuu
+{
+namespace vk
+{
+namespace cpu_baker
+{
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+const float PI = 3.14159265359f;
+
+/* -------------------------------------------------------------------------- *
+   Writes and reads a texel of float components in the given in format.
+   Packed formats have RGB components.
+ * -------------------------------------------------------------------------- */
+class TexelCodec
+{
+public:
+    enum class Encoding { Float, Half, B10G11R11, E5B9G9R9 };
+
+    TexelCodec(VkFormat format)
+    {
+        switch(format)
+        {
+            case VK_FORMAT_R16G16_SFLOAT:           components = 2; encoding = Encoding::Half;      break;
+            case VK_FORMAT_R32G32_SFLOAT:           components = 2; encoding = Encoding::Float;     break;
+            case VK_FORMAT_B10G11R11_UFLOAT_PACK32: components = 3; encoding = Encoding::B10G11R11; break;
+            case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:  components = 3; encoding = Encoding::E5B9G9R9;  break;
+            case VK_FORMAT_R16G16B16A16_SFLOAT:     components = 4; encoding = Encoding::Half;      break;
+            case VK_FORMAT_R32G32B32A32_SFLOAT:     components = 4; encoding = Encoding::Float;     break;
+            default: components = 0; encoding = Encoding::Float; break;
+        }
+    }
+
+    size_t texelSize() const
+    {
+        switch(encoding)
+        {
+            case Encoding::Float: return components * sizeof(float);
+            case Encoding::Half:  return components * sizeof(uint16_t);
+            default:              return sizeof(uint32_t);
+        }
+    }
+
+    void write(char* dst, const float* texel) const
+    {
+        switch(encoding)
+        {
+            case Encoding::Float:
+                std::memcpy(dst, texel, texelSize());
+                break;
+
+            case Encoding::Half:
+                for (int c = 0; c < components; ++c)
+                {
+                    const uint16_t h = uint16_t(glm::packHalf1x16(texel[c]));
+                    std::memcpy(dst + c * sizeof(uint16_t), &h, sizeof(uint16_t));
+                }
+                break;
+
+            case Encoding::B10G11R11:
+            {
+                const uint32_t p = glm::packF2x11_1x10(glm::vec3(texel[0], texel[1], texel[2]));
+                std::memcpy(dst, &p, sizeof(uint32_t));
+                break;
+            }
+
+            case Encoding::E5B9G9R9:
+            {
+                const uint32_t p = glm::packF3x9_E1x5(glm::vec3(texel[0], texel[1], texel[2]));
+                std::memcpy(dst, &p, sizeof(uint32_t));
+                break;
+            }
+        }
+    }
+
+    void read(const char* src, float* texel) const
+    {
+        switch(encoding)
+        {
+            case Encoding::Float:
+                std::memcpy(texel, src, texelSize());
+                break;
+
+            case Encoding::Half:
+                for (int c = 0; c < components; ++c)
+                {
+                    uint16_t h;
+                    std::memcpy(&h, src + c * sizeof(uint16_t), sizeof(uint16_t));
+                    texel[c] = glm::unpackHalf1x16(h);
+                }
+                break;
+
+            case Encoding::B10G11R11:
+            case Encoding::E5B9G9R9:
+            {
+                uint32_t p;
+                std::memcpy(&p, src, sizeof(uint32_t));
+                const glm::vec3 v = encoding == Encoding::B10G11R11
+                    ? glm::unpackF2x11_1x10(p)
+                    : glm::unpackF3x9_E1x5(p);
+                texel[0] = v.x;
+                texel[1] = v.y;
+                texel[2] = v.z;
+                break;
+            }
+        }
+    }
+
+    int components;
+    Encoding encoding;
+};
+
+/* -------------------------------------------------------------------------- *
+   Functions of atmosphere.frag.
+ * -------------------------------------------------------------------------- */
+
+// Distance to the sphere of 1 radius outer shell from the position and
+// direction.
+inline float atmosphericDepth(const glm::vec3& position, const glm::vec3& dir)
+{
+    const float a = glm::dot(dir, dir);
+    const float b = 2.0f * glm::dot(dir, position);
+    const float c = glm::dot(position, position) - 1.0f;
+    const float det = b * b - 4.0f * a * c;
+    const float detSqrt = std::sqrt(det);
+    const float q = (-b - detSqrt) / 2.0f;
+    return c / q;
+}
+
+inline float phase(float alpha, float g)
+{
+    const float a = 3.0f * (1.0f - g * g);
+    const float b = 2.0f * (2.0f + g * g);
+    const float c = 1.0f + alpha * alpha;
+    const float d = std::pow(1.0f + g * g - 2.0f * g * alpha, 1.5f);
+    return (a / b) * (c / d);
+}
+
+inline float smoothstep(float edge0, float edge1, float x)
+{
+    const float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+inline float horizonExtinction(const glm::vec3& position,
+                               const glm::vec3& dir,
+                               float radius)
+{
+    const float u = glm::dot(dir, -position);
+    if (u < 0.0f)
+        return 1.0f;
+
+    const glm::vec3 nearPos = position + u * dir;
+    if (glm::length(nearPos) < radius)
+        return 0.0f;
+
+    const glm::vec3 v2 = glm::normalize(nearPos) * radius - position;
+    const float cosDiff = std::min(std::max(glm::dot(glm::normalize(v2), dir), -1.0f), 1.0f);
+    const float diff = std::acos(cosDiff);
+    return smoothstep(0.0f, 1.0f, std::pow(diff * 2.0f, 3.0f));
+}
+
+inline glm::vec3 absorb(float dist,
+                        const glm::vec3& color,
+                        float factor,
+                        const glm::vec3& kr)
+{
+    const float e = factor / dist;
+    return color - color * glm::vec3(std::pow(kr.x, e),
+                                     std::pow(kr.y, e),
+                                     std::pow(kr.z, e));
+}
+
+// Returns the color of the sky into the direction.
+inline glm::vec3 sky(const AtmosphereRenderer::Params& params,
+                     const glm::vec3& lightDir,
+                     const glm::vec3& texCoord)
+{
+    const float surfaceHeight = 0.99f;
+    const float intensity = 2.0f;
+    const int stepCount = 32;
+
+    const glm::vec3 kr = glm::vec3(params.Kr);
+
+    // Eye position on the planet of radius of 1.0f
+    const glm::vec3 eyePosition = glm::vec3(0.0f, surfaceHeight, 0.0f);
+    const glm::vec3 eyeDir = glm::normalize(texCoord);
+
+    const float eyeDepth = atmosphericDepth(eyePosition, eyeDir);
+    const float stepLength = eyeDepth / float(stepCount);
+
+    glm::vec3 rayleighCollected = glm::vec3(0.0f);
+    glm::vec3 mieCollected      = glm::vec3(0.0f);
+
+    for (int i = 0; i < stepCount; ++i)
+    {
+        const float sampleDistance = stepLength * float(i);
+        const glm::vec3 position = eyePosition + eyeDir * sampleDistance;
+        const float sampleDepth = atmosphericDepth(position, lightDir);
+        const float extinction = horizonExtinction(position, lightDir, surfaceHeight - 0.35f);
+
+        const glm::vec3 influx =
+            absorb(sampleDepth, glm::vec3(intensity), params.scatterStrength, kr) * extinction;
+
+        rayleighCollected += absorb(sampleDistance, kr * influx, params.rayleighStrength, kr);
+        mieCollected      += absorb(sampleDistance, influx,      params.mieStrength,      kr);
+    }
+
+    const float alpha = glm::dot(eyeDir, lightDir);
+    const float rayleighFactor = phase(alpha, -0.01f) * params.rayleighBrightness;
+    const float mieFactor = phase(alpha, params.mieDistribution) * params.mieBrightness;
+    const float spot = smoothstep(0.0f, 15.0f, phase(alpha, 0.9995f)) * params.spotBrightness;
+
+    const float eyeExtinction = horizonExtinction(eyePosition, eyeDir, surfaceHeight - 0.15f);
+    rayleighCollected = (rayleighCollected * eyeExtinction *
+                         std::pow(eyeDepth, params.rayleighCollectionPower)) / float(stepCount);
+    mieCollected      = (mieCollected * eyeExtinction *
+                         std::pow(eyeDepth, params.mieCollectionPower)) / float(stepCount);
+
+    return spot * mieCollected + mieFactor * mieCollected + rayleighFactor * rayleighCollected;
+}
+
+/* -------------------------------------------------------------------------- *
+   Functions of pbr_ibl_brdf_lut.frag.
+ * -------------------------------------------------------------------------- */
+
+inline float geometrySchlickGGX(float nDotV, float roughness)
+{
+    const float k = (roughness * roughness) / 2.0f;
+    return nDotV / (nDotV * (1.0f - k) + k);
+}
+
+inline float radicalInverse_VdC(uint32_t bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10f; // / 0x100000000
+}
+
+inline glm::vec3 importanceSampleGGX(float xiX, float xiY, float roughness)
+{
+    const float a = roughness * roughness;
+
+    const float phi = 2.0f * PI * xiX;
+    const float cosTheta = std::sqrt((1.0f - xiY) / (1.0f + (a * a - 1.0f) * xiY));
+    const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+    // Tangent space of the normal (0, 0, 1) of the shader is
+    // t = (0, -1, 0) and b = (1, 0, 0).
+    const glm::vec3 h = glm::vec3(std::cos(phi) * sinTheta,
+                                  std::sin(phi) * sinTheta,
+                                  cosTheta);
+    return glm::normalize(glm::vec3(h.y, -h.x, h.z));
+}
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<char> atmosphere(const AtmosphereRenderer::Params& params,
+                             const VkExtent2D& extent,
+                             VkFormat format)
+{
+    const TexelCodec writer(format);
+    if (writer.components < 3)
+        return std::vector<char>();
+
+    const int width  = int(extent.width);
+    const int height = int(extent.height);
+    const size_t texelSize = writer.texelSize();
+    std::vector<char> data(size_t(6 * width * height) * texelSize);
+
+    const std::vector<glm::mat4> faces = CubeBaker::faceMatrices();
+
+    glm::vec3 lightDir = glm::normalize(glm::vec3(params.lightdir));
+    lightDir.x = -lightDir.x;
+    lightDir.y = -lightDir.y;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int row = 0; row < 6 * height; ++row)
+    {
+        const int face = row / height;
+        const int y    = row % height;
+        const float ndcY = (float(y) + 0.5f) / float(height) * 2.0f - 1.0f;
+
+        // Texel directions are interpolated as in the vertex shader of the
+        // cube bake. The ray march of a texel has branches and
+        // transcendental functions so the texels are evaluated one by one.
+        char* dst = data.data() + size_t(row) * width * texelSize;
+        for (int x = 0; x < width; ++x)
+        {
+            const float ndcX = (float(x) + 0.5f) / float(width) * 2.0f - 1.0f;
+            const glm::vec4 dir = faces[face] * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+            const glm::vec4 color =
+                glm::vec4(sky(params, lightDir, glm::vec3(dir) / dir.w), 1.0f);
+            writer.write(dst + x * texelSize, &color.x);
+        }
+    }
+
+    return data;
+}
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<char> brdfLut(const VkExtent2D& extent, VkFormat format)
+{
+    const TexelCodec writer(format);
+    if (writer.components != 2)
+        return std::vector<char>();
+
+    const int width  = int(extent.width);
+    const int height = int(extent.height);
+    const size_t texelSize = writer.texelSize();
+    std::vector<char> data(size_t(width * height) * texelSize);
+
+    const uint32_t sampleCount = 1024u;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < height; ++y)
+    {
+        const float roughness = (float(y) + 0.5f) / float(height);
+
+        // Half vectors only depend on the roughness of the row.
+        std::vector<glm::vec3> halfVectors(sampleCount);
+        for (uint32_t i = 0; i < sampleCount; ++i)
+            halfVectors[i] = importanceSampleGGX(float(i) / float(sampleCount),
+                                                 radicalInverse_VdC(i),
+                                                 roughness);
+
+        std::vector<float> nDotVs(width);
+        for (int x = 0; x < width; ++x)
+            nDotVs[x] = (float(x) + 0.5f) / float(width);
+
+        std::vector<float> a(width, 0.0f);
+        std::vector<float> b(width, 0.0f);
+        for (uint32_t i = 0; i < sampleCount; ++i)
+        {
+            const glm::vec3 h = halfVectors[i];
+            const float nDotH = std::max(h.z, 0.0f);
+
+            #pragma omp simd
+            for (int x = 0; x < width; ++x)
+            {
+                const float nDotV = nDotVs[x];
+                const glm::vec3 v = glm::vec3(std::sqrt(1.0f - nDotV * nDotV), 0.0f, nDotV);
+                const float vh = glm::dot(v, h);
+                const glm::vec3 l = glm::normalize(2.0f * vh * h - v);
+
+                const float nDotL = std::max(l.z, 0.0f);
+                const float vDotH = std::max(vh, 0.0f);
+
+                const float g = geometrySchlickGGX(nDotL, roughness) *
+                                geometrySchlickGGX(nDotV, roughness);
+                const float gVis = (g * vDotH) / (nDotH * nDotV);
+                const float fc = std::pow(1.0f - vDotH, 5.0f);
+
+                // Branchless form of the sample rejection.
+                const float mask = nDotL > 0.0f ? 1.0f : 0.0f;
+                a[x] += mask * (1.0f - fc) * gVis;
+                b[x] += mask * fc * gVis;
+            }
+        }
+
+        char* dst = data.data() + size_t(y) * width * texelSize;
+        for (int x = 0; x < width; ++x)
+        {
+            const float texel[2] = { a[x] / float(sampleCount),
+                                     b[x] / float(sampleCount) };
+            writer.write(dst + x * texelSize, texel);
+        }
+    }
+
+    return data;
+}
+
+/* -------------------------------------------------------------------------- */
+
+float difference(const std::vector<char>& a,
+                 const std::vector<char>& b,
+                 VkFormat format,
+                 float floor)
+{
+    const TexelCodec codec(format);
+    const size_t texelSize = codec.texelSize();
+    if (codec.components == 0 || a.size() != b.size() || a.size() % texelSize)
+        return -1.0f;
+
+    float maxDiff = 0.0f;
+    for (size_t offset = 0; offset < a.size(); offset += texelSize)
+    {
+        float ta[4], tb[4];
+        codec.read(a.data() + offset, ta);
+        codec.read(b.data() + offset, tb);
+        for (int c = 0; c < codec.components; ++c)
+        {
+            const float scale = std::max(std::max(std::abs(ta[c]), std::abs(tb[c])), floor);
+            maxDiff = std::max(maxDiff, std::abs(ta[c] - tb[c]) / scale);
+        }
+    }
+    return maxDiff;
+}
+
+} // namespace cpu_baker
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,65 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::cpu_baker namespace.
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/* -------------------------------------------------------------------------- */
+
+#include "vk_atmoshere_renderer.h"
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- *
+   CPU implementations of the bake shaders.
+
+   The bakes do not need a device and can be used in headless and offline
+   runs, as a fallback of the GPU bakes and as a reference when validating
+   the GPU bakes. Texels are evaluated at the same positions as the GPU
+   bakes and the data is tightly packed in the layout of the bake cache:
+   layers of a texture cube are consecutive. The rows are divided between
+   the cores with OpenMP. The BRDF LUT accumulates a sample into a row of
+   texels in SIMD lanes, the atmosphere is evaluated texel by texel.
+
+   Results match the GPU bakes within the precision of the transcendental
+   functions of the device, not bit by bit.
+ * -------------------------------------------------------------------------- */
+namespace cpu_baker
+{
+
+// Computes the atmosphere of atmosphere.frag into the faces of a texture
+// cube. Supported formats are RGBA 32-bit and 16-bit float and the packed
+// B10G11R11 and E5B9G9R9 float formats. Returns an empty vector if the
+// format is not supported.
+std::vector<char> atmosphere(const AtmosphereRenderer::Params& params,
+                             const VkExtent2D& extent,
+                             VkFormat format);
+
+// Computes the split-sum BRDF integration of pbr_ibl_brdf_lut.frag. U is
+// the cosine of the view angle and V the roughness. Supported formats are
+// RG 16-bit and 32-bit float. Returns an empty vector if the format is not
+// supported.
+std::vector<char> brdfLut(const VkExtent2D& extent, VkFormat format);
+
+// Returns the largest difference of the texel components of two bakes of
+// the format. The difference is relative to the larger component or to
+// the floor if both components are smaller than the floor, a floor of 1.0
+// gives the absolute difference of normalized data. Returns a negative
+// value if the sizes differ or the format is not supported.
+float difference(const std::vector<char>& a,
+                 const std::vector<char>& b,
+                 VkFormat format,
+                 float floor);
+
+} // namespace cpu_baker
+} // namespace vk
+} // namespace kuu
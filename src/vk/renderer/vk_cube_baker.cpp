@@ -0,0 +1,808 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::CubeBaker class
+ * -------------------------------------------------------------------------- */
+
+// The header includes glm, the projection needs to be configured first.
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "vk_cube_baker.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <iostream>
+
+/* -------------------------------------------------------------------------- */
+
+#include "../vk_buffer.h"
+#include "../vk_descriptor_set.h"
+#include "../vk_image_layout_transition.h"
+#include "../vk_object_key.h"
+#include "../vk_pipeline.h"
+#include "../vk_pipeline_registry.h"
+#include "../vk_pipeline_cache.h"
+#include "../vk_shader_module.h"
+#include "../vk_shader_registry.h"
+#include "../vk_stringify.h"
+#include "../vk_texture.h"
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+struct CubeBaker::Impl
+{
+    Impl(const VkPhysicalDevice& physicalDevice,
+         const VkDevice& device,
+         std::shared_ptr<TextureCube> textureCube)
+        : physicalDevice(physicalDevice)
+        , device(device)
+        , textureCube(textureCube)
+    {
+        // Layered rendering needs the geometry shader, the renderer
+        // enables the feature when the device supports it.
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+        layered = features.geometryShader == VK_TRUE;
+
+        // Compute shaders write storage images without a format so that
+        // any HDR format can be used. The renderer enables the feature when
+        // the device supports it.
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(
+            physicalDevice,
+            textureCube->format,
+            &formatProperties);
+        storage = features.shaderStorageImageWriteWithoutFormat == VK_TRUE &&
+                  (formatProperties.optimalTilingFeatures &
+                   VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+    }
+
+    ~Impl()
+    {
+        destroyFramebuffers();
+
+        vkDestroyPipeline(
+            device,
+            computePipeline,
+            NULL);
+
+        vkDestroyPipelineLayout(
+            device,
+            computePipelineLayout,
+            NULL);
+
+        object_key::removeRenderPass(renderPass);
+        vkDestroyRenderPass(
+            device,
+            renderPass,
+            NULL);
+    }
+
+    bool createShaders()
+    {
+        vshModule = shader_registry::module(
+            device, "shaders/cube_bake.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+        if (!vshModule)
+            return false;
+
+        if (!layered)
+            return true;
+
+        gshModule = shader_registry::module(
+            device, "shaders/cube_bake.geom.spv", VK_SHADER_STAGE_GEOMETRY_BIT);
+        if (!gshModule)
+            layered = false;
+        return true;
+    }
+
+    bool createFacesBuffer()
+    {
+        if (facesUniformBuffer)
+            return true;
+
+        facesUniformBuffer = std::make_shared<Buffer>(physicalDevice, device);
+        facesUniformBuffer->setSize(6 * sizeof(glm::mat4));
+        facesUniformBuffer->setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        facesUniformBuffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (!facesUniformBuffer->create())
+            return false;
+
+        const std::vector<glm::mat4> faces = CubeBaker::faceMatrices();
+        facesUniformBuffer->copyHostVisible(faces.data(), facesUniformBuffer->size());
+        return true;
+    }
+
+    bool createFaces()
+    {
+        if (!createFacesBuffer())
+            return false;
+
+        facesDescriptorPool = std::make_shared<DescriptorPool>(device);
+        facesDescriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
+        facesDescriptorPool->setMaxCount(1);
+        if (!facesDescriptorPool->create())
+            return false;
+
+        facesDescriptorSet = std::make_shared<DescriptorSets>(device, facesDescriptorPool->handle());
+        facesDescriptorSet->addLayoutBinding(
+            0,
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT);
+        if (!facesDescriptorSet->create())
+            return false;
+
+        facesDescriptorSet->writeUniformBuffer(
+            0, facesUniformBuffer->handle(),
+            0, facesUniformBuffer->size());
+        return true;
+    }
+
+    bool createRenderPass()
+    {
+        // Fullscreen triangle covers the whole attachment so the previous
+        // content does not need to be loaded.
+        VkAttachmentDescription colorAttachment;
+        colorAttachment.flags          = 0;
+        colorAttachment.format         = textureCube->format;
+        colorAttachment.samples        = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp         = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkAttachmentReference colorAttachmentRef;
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass;
+        subpass.flags                   = 0;
+        subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.inputAttachmentCount    = 0;
+        subpass.pInputAttachments       = NULL;
+        subpass.colorAttachmentCount    = 1;
+        subpass.pColorAttachments       = &colorAttachmentRef;
+        subpass.pResolveAttachments     = NULL;
+        subpass.pDepthStencilAttachment = NULL;
+        subpass.preserveAttachmentCount = 0;
+        subpass.pPreserveAttachments    = NULL;
+
+        std::vector<VkSubpassDependency> dependencies(2);
+        dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass      = 0;
+        dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[0].srcAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dependencyFlags = 0;
+
+        dependencies[1].srcSubpass      = 0;
+        dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[1].dependencyFlags = 0;
+
+        VkRenderPassCreateInfo rpInfo;
+        rpInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        rpInfo.pNext           = NULL;
+        rpInfo.flags           = 0;
+        rpInfo.attachmentCount = 1;
+        rpInfo.pAttachments    = &colorAttachment;
+        rpInfo.subpassCount    = 1;
+        rpInfo.pSubpasses      = &subpass;
+        rpInfo.dependencyCount = uint32_t(dependencies.size());
+        rpInfo.pDependencies   = dependencies.data();
+
+        const VkResult result =
+            vkCreateRenderPass(
+                device,
+                &rpInfo,
+                NULL,
+                &renderPass);
+
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": render pass creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+
+        object_key::addRenderPass(renderPass, rpInfo);
+        return true;
+    }
+
+    // Creates a framebuffer for the mipmap level. Layered framebuffer
+    // contains all the faces, otherwise the framebuffer has the given in
+    // face.
+    bool createFramebuffer(uint32_t level, uint32_t face)
+    {
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image                           = textureCube->image;
+        viewInfo.viewType                        = layered ? VK_IMAGE_VIEW_TYPE_2D_ARRAY
+                                                           : VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format                          = textureCube->format;
+        viewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel   = level;
+        viewInfo.subresourceRange.levelCount     = 1;
+        viewInfo.subresourceRange.baseArrayLayer = layered ? 0 : face;
+        viewInfo.subresourceRange.layerCount     = layered ? 6 : 1;
+
+        VkImageView imageView = VK_NULL_HANDLE;
+        VkResult result = vkCreateImageView(device, &viewInfo, NULL, &imageView);
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": image view creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+        imageViews.push_back(imageView);
+
+        const VkExtent2D extent = levelExtent(level);
+
+        VkFramebufferCreateInfo fbInfo;
+        fbInfo.sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        fbInfo.pNext           = NULL;
+        fbInfo.flags           = 0;
+        fbInfo.renderPass      = renderPass;
+        fbInfo.attachmentCount = 1;
+        fbInfo.pAttachments    = &imageView;
+        fbInfo.width           = extent.width;
+        fbInfo.height          = extent.height;
+        fbInfo.layers          = layered ? 6 : 1;
+
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        result = vkCreateFramebuffer(device, &fbInfo, NULL, &framebuffer);
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": framebuffer creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+        framebuffers.push_back(framebuffer);
+        return true;
+    }
+
+    void destroyFramebuffers()
+    {
+        for (VkFramebuffer framebuffer : framebuffers)
+            vkDestroyFramebuffer(device, framebuffer, NULL);
+        for (VkImageView imageView : imageViews)
+            vkDestroyImageView(device, imageView, NULL);
+
+        framebuffers.clear();
+        imageViews.clear();
+    }
+
+    bool createPipeline(std::shared_ptr<ShaderModule> fshModule,
+                        const VkDescriptorSetLayout& descriptorSetLayout)
+    {
+        VkPipelineColorBlendAttachmentState colorBlend = {};
+        colorBlend.blendEnable    = VK_FALSE;
+        colorBlend.colorWriteMask = 0xf;
+
+        float blendConstants[4] = { 0, 0, 0, 0 };
+
+        const VkExtent2D extent = levelExtent(0);
+
+        pipeline = std::make_shared<Pipeline>(device);
+        pipeline->addShaderStage(vshModule->createInfo());
+        if (layered)
+            pipeline->addShaderStage(gshModule->createInfo());
+        pipeline->addShaderStage(fshModule->createInfo());
+        pipeline->setVertexInputState( {}, {} );
+        pipeline->setInputAssemblyState(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_FALSE);
+        pipeline->setViewportState(
+            { { 0, 0, float(extent.width), float(extent.height), 0, 1 } },
+            { { { 0, 0 }, { extent.width, extent.height }  } } );
+        pipeline->setRasterizerState(
+            VK_POLYGON_MODE_FILL,
+            VK_CULL_MODE_NONE,
+            VK_FRONT_FACE_COUNTER_CLOCKWISE);
+        pipeline->setMultisampleState(VK_FALSE, VK_SAMPLE_COUNT_1_BIT);
+        pipeline->setDepthStencilState(VK_FALSE, VK_FALSE);
+        pipeline->setColorBlendingState(
+                VK_FALSE,
+                VK_LOGIC_OP_CLEAR,
+                { colorBlend },
+                blendConstants);
+
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
+        descriptorSetLayouts.push_back(descriptorSetLayout);
+        descriptorSetLayouts.push_back(facesDescriptorSet->layoutHandle());
+
+        VkPushConstantRange faceRange;
+        faceRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        faceRange.offset     = 0;
+        faceRange.size       = sizeof(int32_t);
+
+        pipeline->setPipelineLayout(descriptorSetLayouts, { faceRange });
+        pipeline->setDynamicState( { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR } );
+        pipeline->setRenderPass(renderPass);
+        pipeline = pipeline_registry::pipeline(pipeline);
+        return pipeline != nullptr;
+    }
+
+    // Creates a descriptor set per mipmap level that contains the face
+    // matrices and the storage image of the level.
+    bool createStorage()
+    {
+        if (!createFacesBuffer())
+            return false;
+
+        const uint32_t mipmapCount = textureCube->mipmapCount;
+
+        storageDescriptorPool = std::make_shared<DescriptorPool>(device);
+        storageDescriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, mipmapCount);
+        storageDescriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,  mipmapCount);
+        storageDescriptorPool->setMaxCount(mipmapCount);
+        if (!storageDescriptorPool->create())
+            return false;
+
+        for (uint32_t m = 0; m < mipmapCount; ++m)
+        {
+            VkImageViewCreateInfo viewInfo = {};
+            viewInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image                           = textureCube->image;
+            viewInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+            viewInfo.format                          = textureCube->format;
+            viewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            viewInfo.subresourceRange.baseMipLevel   = m;
+            viewInfo.subresourceRange.levelCount     = 1;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount     = 6;
+
+            VkImageView imageView = VK_NULL_HANDLE;
+            const VkResult result = vkCreateImageView(device, &viewInfo, NULL, &imageView);
+            if (result != VK_SUCCESS)
+            {
+                std::cerr << __FUNCTION__
+                          << ": image view creation failed as "
+                          << vk::stringify::resultDesc(result)
+                          << std::endl;
+                return false;
+            }
+            imageViews.push_back(imageView);
+
+            std::shared_ptr<DescriptorSets> descriptorSet =
+                std::make_shared<DescriptorSets>(device, storageDescriptorPool->handle());
+            if (storageDescriptorSets.empty())
+            {
+                descriptorSet->addLayoutBinding(
+                    0,
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+                    VK_SHADER_STAGE_COMPUTE_BIT);
+                descriptorSet->addLayoutBinding(
+                    1,
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
+                    VK_SHADER_STAGE_COMPUTE_BIT);
+            }
+            else
+            {
+                descriptorSet->setLayout(storageDescriptorSets[0]->layoutHandle());
+            }
+
+            if (!descriptorSet->create())
+                return false;
+
+            descriptorSet->writeUniformBuffer(
+                0, facesUniformBuffer->handle(),
+                0, facesUniformBuffer->size());
+
+            descriptorSet->writeStorageImage(
+                1,
+                imageView,
+                VK_IMAGE_LAYOUT_GENERAL);
+
+            storageDescriptorSets.push_back(descriptorSet);
+        }
+        return true;
+    }
+
+    bool createComputePipeline(std::shared_ptr<ShaderModule> cshModule,
+                               const VkDescriptorSetLayout& descriptorSetLayout)
+    {
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
+        descriptorSetLayouts.push_back(descriptorSetLayout);
+        descriptorSetLayouts.push_back(storageDescriptorSets[0]->layoutHandle());
+
+        VkPipelineLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = uint32_t(descriptorSetLayouts.size());
+        layoutInfo.pSetLayouts    = descriptorSetLayouts.data();
+
+        VkResult result =
+            vkCreatePipelineLayout(
+                device,
+                &layoutInfo,
+                NULL,
+                &computePipelineLayout);
+
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": compute pipeline layout creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage  = cshModule->createInfo();
+        pipelineInfo.layout = computePipelineLayout;
+
+        result = vkCreateComputePipelines(
+                device,
+                PipelineCache::deviceCache(device),
+                1,
+                &pipelineInfo,
+                NULL,
+                &computePipeline);
+
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": compute pipeline creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    VkExtent2D levelExtent(uint32_t level) const
+    {
+        return { std::max(textureCube->extent.width  >> level, 1u),
+                 std::max(textureCube->extent.height >> level, 1u) };
+    }
+
+    void recordPass(VkCommandBuffer cmdBuf,
+                    VkFramebuffer framebuffer,
+                    VkDescriptorSet descriptorSet,
+                    const VkExtent2D& extent,
+                    int32_t face)
+    {
+        VkViewport viewport;
+        viewport.x        = 0;
+        viewport.y        = 0;
+        viewport.width    = float(extent.width);
+        viewport.height   = float(extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
+
+        VkRect2D scissor;
+        scissor.offset = {};
+        scissor.extent = extent;
+        vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
+
+        VkRenderPassBeginInfo renderPassInfo;
+        renderPassInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.pNext             = NULL;
+        renderPassInfo.renderPass        = renderPass;
+        renderPassInfo.framebuffer       = framebuffer;
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = extent;
+        renderPassInfo.clearValueCount   = 0;
+        renderPassInfo.pClearValues      = NULL;
+
+        vkCmdBeginRenderPass(
+            cmdBuf,
+            &renderPassInfo,
+            VK_SUBPASS_CONTENTS_INLINE);
+
+        std::vector<VkDescriptorSet> descriptorHandles =
+        { descriptorSet, facesDescriptorSet->handle() };
+
+        vkCmdBindDescriptorSets(
+            cmdBuf,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            pipeline->pipelineLayoutHandle(), 0,
+            uint32_t(descriptorHandles.size()),
+            descriptorHandles.data(), 0, NULL);
+
+        vkCmdBindPipeline(
+            cmdBuf,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            pipeline->handle());
+
+        vkCmdPushConstants(
+            cmdBuf,
+            pipeline->pipelineLayoutHandle(),
+            VK_SHADER_STAGE_VERTEX_BIT,
+            0, sizeof(int32_t), &face);
+
+        vkCmdDraw(cmdBuf, 3, 1, 0, 0);
+
+        vkCmdEndRenderPass(cmdBuf);
+    }
+
+    // Input Vulkan handles
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+
+    // Output texture cube
+    std::shared_ptr<TextureCube> textureCube;
+
+    // True if the faces are rendered in a single pass.
+    bool layered = false;
+    // True if the cube can be written by compute shaders.
+    bool storage = false;
+
+    // Shaders
+    std::shared_ptr<ShaderModule> vshModule;
+    std::shared_ptr<ShaderModule> gshModule;
+
+    // Face matrices
+    std::shared_ptr<Buffer> facesUniformBuffer;
+    std::shared_ptr<DescriptorPool> facesDescriptorPool;
+    std::shared_ptr<DescriptorSets> facesDescriptorSet;
+
+    // Render pass and the framebuffers of levels (and faces).
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    std::vector<VkImageView> imageViews;
+    std::vector<VkFramebuffer> framebuffers;
+
+    // Pipeline
+    std::shared_ptr<Pipeline> pipeline;
+
+    // User descriptor sets of levels
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    // Compute storage images of levels and pipeline
+    std::shared_ptr<DescriptorPool> storageDescriptorPool;
+    std::vector<std::shared_ptr<DescriptorSets>> storageDescriptorSets;
+    VkPipelineLayout computePipelineLayout = VK_NULL_HANDLE;
+    VkPipeline computePipeline = VK_NULL_HANDLE;
+};
+
+/* -------------------------------------------------------------------------- */
+
+CubeBaker::CubeBaker(const VkPhysicalDevice& physicalDevice,
+                     const VkDevice& device,
+                     std::shared_ptr<TextureCube> textureCube)
+    : impl(std::make_shared<Impl>(physicalDevice,
+                                  device,
+                                  textureCube))
+{}
+
+/* -------------------------------------------------------------------------- */
+
+bool CubeBaker::isLayered() const
+{ return impl->layered; }
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<glm::mat4> CubeBaker::faceMatrices()
+{
+    auto pitchYaw = [](float pitch, float yaw) -> glm::quat
+    {
+        const float pitchRad = glm::radians(pitch);
+        const float yawRad   = glm::radians(yaw);
+
+        glm::vec3 pitchAxis = glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 yawAxis   = glm::vec3(0.0f, 1.0f, 0.0f);
+
+        glm::quat out;
+        out = glm::angleAxis(yawRad,   yawAxis)   * out;
+        out = glm::angleAxis(pitchRad, pitchAxis) * out;
+        return out;
+    };
+
+    std::vector<glm::quat> faceRotations;
+    faceRotations.push_back(pitchYaw(  0.0f,  90.0f)); // pos x
+    faceRotations.push_back(pitchYaw(  0.0f, -90.0f)); // neg x
+    faceRotations.push_back(pitchYaw(-90.0f,   0.0f)); // pos y
+    faceRotations.push_back(pitchYaw( 90.0f,   0.0f)); // neg y
+    faceRotations.push_back(pitchYaw(  0.0f,   0.0f)); // neg z
+    faceRotations.push_back(pitchYaw(  0.0f, 180.0f)); // pos z
+
+    glm::mat4 projection = glm::perspective(float(M_PI / 2.0), 1.0f, 0.1f, 512.0f);
+    projection[1][1] *= -1;
+
+    std::vector<glm::mat4> out;
+    for (const glm::quat& faceRotation : faceRotations)
+        out.push_back(glm::inverse(projection * glm::mat4_cast(faceRotation)));
+    return out;
+}
+
+/* -------------------------------------------------------------------------- */
+
+bool CubeBaker::bake(const VkCommandBuffer& cmdBuf,
+                     std::shared_ptr<ShaderModule> fshModule,
+                     const VkDescriptorSetLayout& descriptorSetLayout,
+                     const std::vector<VkDescriptorSet>& descriptorSets)
+{
+    if (!prepareBake(fshModule, descriptorSetLayout, descriptorSets))
+        return false;
+    recordBake(cmdBuf, 0, impl->textureCube->mipmapCount);
+    return true;
+}
+
+bool CubeBaker::prepareBake(std::shared_ptr<ShaderModule> fshModule,
+                            const VkDescriptorSetLayout& descriptorSetLayout,
+                            const std::vector<VkDescriptorSet>& descriptorSets)
+{
+    const uint32_t mipmapCount = impl->textureCube->mipmapCount;
+    if (descriptorSets.size() != mipmapCount)
+    {
+        std::cerr << __FUNCTION__
+                  << ": a descriptor set per mipmap level is required"
+                  << std::endl;
+        return false;
+    }
+
+    if (!impl->createShaders()    ||
+        !impl->createFaces()      ||
+        !impl->createRenderPass())
+    {
+        return false;
+    }
+
+    for (uint32_t m = 0; m < mipmapCount; ++m)
+    {
+        const uint32_t faceCount = impl->layered ? 1 : 6;
+        for (uint32_t f = 0; f < faceCount; ++f)
+            if (!impl->createFramebuffer(m, f))
+                return false;
+    }
+
+    if (!impl->createPipeline(fshModule, descriptorSetLayout))
+        return false;
+
+    impl->descriptorSets = descriptorSets;
+    return true;
+}
+
+void CubeBaker::recordBake(const VkCommandBuffer& cmdBuf,
+                           uint32_t firstLevel,
+                           uint32_t levelCount)
+{
+    const uint32_t faceCount = impl->layered ? 1 : 6;
+    const uint32_t lastLevel =
+        std::min(firstLevel + levelCount, impl->textureCube->mipmapCount);
+
+    for (uint32_t m = firstLevel; m < lastLevel; ++m)
+    {
+        const VkExtent2D extent = impl->levelExtent(m);
+        for (uint32_t f = 0; f < faceCount; ++f)
+            impl->recordPass(cmdBuf,
+                             impl->framebuffers[m * faceCount + f],
+                             impl->descriptorSets[m],
+                             extent,
+                             int32_t(f));
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+bool CubeBaker::supportsCompute() const
+{ return impl->storage; }
+
+/* -------------------------------------------------------------------------- */
+
+bool CubeBaker::compute(const VkCommandBuffer& cmdBuf,
+                        std::shared_ptr<ShaderModule> cshModule,
+                        const VkDescriptorSetLayout& descriptorSetLayout,
+                        const std::vector<VkDescriptorSet>& descriptorSets)
+{
+    if (!prepareCompute(cshModule, descriptorSetLayout, descriptorSets))
+        return false;
+    recordCompute(cmdBuf, 0, impl->textureCube->mipmapCount);
+    return true;
+}
+
+bool CubeBaker::prepareCompute(std::shared_ptr<ShaderModule> cshModule,
+                               const VkDescriptorSetLayout& descriptorSetLayout,
+                               const std::vector<VkDescriptorSet>& descriptorSets)
+{
+    const uint32_t mipmapCount = impl->textureCube->mipmapCount;
+    if (!impl->storage)
+    {
+        std::cerr << __FUNCTION__
+                  << ": texture cube format does not support storage images"
+                  << std::endl;
+        return false;
+    }
+
+    if (descriptorSets.size() != mipmapCount)
+    {
+        std::cerr << __FUNCTION__
+                  << ": a descriptor set per mipmap level is required"
+                  << std::endl;
+        return false;
+    }
+
+    if (!impl->createStorage() ||
+        !impl->createComputePipeline(cshModule, descriptorSetLayout))
+    {
+        return false;
+    }
+
+    impl->descriptorSets = descriptorSets;
+    return true;
+}
+
+void CubeBaker::recordCompute(const VkCommandBuffer& cmdBuf,
+                              uint32_t firstLevel,
+                              uint32_t levelCount)
+{
+    const uint32_t lastLevel =
+        std::min(firstLevel + levelCount, impl->textureCube->mipmapCount);
+    if (firstLevel >= lastLevel)
+        return;
+
+    // Only the recorded levels are transitioned, the other levels keep
+    // their content and layout.
+    VkImageSubresourceRange subresourceRange = {};
+    subresourceRange.aspectMask   = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.baseMipLevel = firstLevel;
+    subresourceRange.levelCount   = lastLevel - firstLevel;
+    subresourceRange.layerCount   = 6;
+
+    image_layout_transition::record(
+        cmdBuf,
+        impl->textureCube->image,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_GENERAL,
+        subresourceRange,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    vkCmdBindPipeline(
+        cmdBuf,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        impl->computePipeline);
+
+    for (uint32_t m = firstLevel; m < lastLevel; ++m)
+    {
+        std::vector<VkDescriptorSet> descriptorHandles =
+        { impl->descriptorSets[m], impl->storageDescriptorSets[m]->handle() };
+
+        vkCmdBindDescriptorSets(
+            cmdBuf,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            impl->computePipelineLayout, 0,
+            uint32_t(descriptorHandles.size()),
+            descriptorHandles.data(), 0, NULL);
+
+        const VkExtent2D extent = impl->levelExtent(m);
+        vkCmdDispatch(cmdBuf,
+                      (extent.width  + 7) / 8,
+                      (extent.height + 7) / 8,
+                      6);
+    }
+
+    image_layout_transition::record(
+        cmdBuf,
+        impl->textureCube->image,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        subresourceRange,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
+} // namespace vk
+} // namespace kuu
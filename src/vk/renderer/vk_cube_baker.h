@@ -0,0 +1,112 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::CubeBaker class
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <glm/mat4x4.hpp>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+class ShaderModule;
+struct TextureCube;
+
+/* -------------------------------------------------------------------------- *
+   Renders the faces of a texture cube straight into the cube layers.
+
+   If the device supports geometry shaders the six faces of a mipmap level
+   are rendered in a single render pass into a layered framebuffer. Otherwise
+   each face is rendered into a framebuffer of its own layer. The faces are
+   not copied in either case.
+
+   User provides the fragment shader and a descriptor set per mipmap level
+   bound into set 0. Fragment shader receives the world space direction of
+   the cube texel in location 0.
+
+   Alternatively the cube can be computed with a compute shader if the
+   format of the cube supports storage images and the device supports
+   writing storage images without a format. The face matrices and the
+   storage image of the mipmap level are bound into set 1 and the faces are
+   dispatched in z.
+
+   The commands are recorded into a command buffer given by the user. The
+   baker owns the framebuffers and pipelines used by the commands and needs
+   to be alive until the commands have been executed. The baking can be
+   split into ranges of mipmap levels by preparing the baker once and
+   recording the ranges into separate command buffers.
+ * -------------------------------------------------------------------------- */
+class CubeBaker
+{
+public:
+    // Constructs the baker of given in texture cube.
+    CubeBaker(const VkPhysicalDevice& physicalDevice,
+              const VkDevice& device,
+              std::shared_ptr<TextureCube> textureCube);
+
+    // Returns the inverse view-projection matrices of the cube faces in the
+    // order of the cube layers. A matrix maps the NDC position of a face
+    // texel on the far plane into the world space direction of the texel.
+    static std::vector<glm::mat4> faceMatrices();
+
+    // Returns true if the faces are rendered into a layered framebuffer.
+    bool isLayered() const;
+
+    // Records the rendering of all the mipmap levels of the texture cube.
+    // Texture cube is in shader read-only layout afterwards. Returns false
+    // if the recording failed.
+    bool bake(const VkCommandBuffer& cmdBuf,
+              std::shared_ptr<ShaderModule> fshModule,
+              const VkDescriptorSetLayout& descriptorSetLayout,
+              const std::vector<VkDescriptorSet>& descriptorSets);
+
+    // Prepares the rendering without recording commands. Returns false if
+    // the preparation failed.
+    bool prepareBake(std::shared_ptr<ShaderModule> fshModule,
+                     const VkDescriptorSetLayout& descriptorSetLayout,
+                     const std::vector<VkDescriptorSet>& descriptorSets);
+    // Records the rendering of the given in mipmap levels. Requires that
+    // the baker has been prepared for rendering.
+    void recordBake(const VkCommandBuffer& cmdBuf,
+                    uint32_t firstLevel,
+                    uint32_t levelCount);
+
+    // Returns true if the texture cube can be written by a compute shader.
+    bool supportsCompute() const;
+
+    // Records the computing of all the mipmap levels of the texture cube in
+    // 8x8 texel workgroups. Texture cube is in shader read-only layout
+    // afterwards. Returns false if the recording failed.
+    bool compute(const VkCommandBuffer& cmdBuf,
+                 std::shared_ptr<ShaderModule> cshModule,
+                 const VkDescriptorSetLayout& descriptorSetLayout,
+                 const std::vector<VkDescriptorSet>& descriptorSets);
+
+    // Prepares the computing without recording commands. Returns false if
+    // the preparation failed.
+    bool prepareCompute(std::shared_ptr<ShaderModule> cshModule,
+                        const VkDescriptorSetLayout& descriptorSetLayout,
+                        const std::vector<VkDescriptorSet>& descriptorSets);
+    // Records the computing of the given in mipmap levels. Requires that
+    // the baker has been prepared for computing.
+    void recordCompute(const VkCommandBuffer& cmdBuf,
+                       uint32_t firstLevel,
+                       uint32_t levelCount);
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,76 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::DrawList class
+ * -------------------------------------------------------------------------- */
+
+#include "vk_draw_list.h"
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+uint64_t DrawList::key(uint32_t pipeline, uint32_t material, uint32_t mesh)
+{
+    return (uint64_t(pipeline & 0xffff)   << 48) |
+           (uint64_t(material & 0xffffff) << 24) |
+            uint64_t(mesh     & 0xffffff);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void DrawList::clear()
+{ items.clear(); }
+
+void DrawList::add(uint64_t key, uint32_t draw)
+{ items.push_back({ key, draw }); }
+
+/* -------------------------------------------------------------------------- */
+
+void DrawList::sort()
+{
+    // Least significant digit first radix sort of 8-bit digits. Histograms
+    // of all the digits are counted in a single pass and a digit that is
+    // equal in all the keys is skipped, with small state indices most of
+    // the digits are.
+    size_t counts[8][256] = {};
+    for (const Item& item : items)
+        for (int digit = 0; digit < 8; ++digit)
+            counts[digit][(item.key >> (digit * 8)) & 0xff]++;
+
+    sorted.resize(items.size());
+    for (int digit = 0; digit < 8; ++digit)
+    {
+        const size_t* count = counts[digit];
+        if (items.empty() || count[(items[0].key >> (digit * 8)) & 0xff] == items.size())
+            continue;
+
+        size_t offsets[256];
+        size_t offset = 0;
+        for (int i = 0; i < 256; ++i)
+        {
+            offsets[i] = offset;
+            offset += count[i];
+        }
+
+        for (const Item& item : items)
+            sorted[offsets[(item.key >> (digit * 8)) & 0xff]++] = item;
+        items.swap(sorted);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+size_t DrawList::size() const
+{ return items.size(); }
+
+uint32_t DrawList::draw(size_t index) const
+{ return items[index].draw; }
+
+uint64_t DrawList::key(size_t index) const
+{ return items[index].key; }
+
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,57 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::DrawList class
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- *
+   A list of draws sorted by the state they bind. The sort key of a draw is
+   the pipeline in the highest 16 bits, the material in the next 24 bits and
+   the mesh in the lowest 24 bits so that the draws of a pipeline are next
+   to each other, then the draws of a material and so on. The draws are
+   sorted with a radix sort.
+ * -------------------------------------------------------------------------- */
+class DrawList
+{
+public:
+    // Returns the sort key of the state indices.
+    static uint64_t key(uint32_t pipeline, uint32_t material, uint32_t mesh);
+
+    // Removes the draws.
+    void clear();
+    // Adds a draw with the sort key. Draw is an index defined by the user.
+    void add(uint64_t key, uint32_t draw);
+    // Sorts the draws by the key. Draws with equal keys keep their order.
+    void sort();
+
+    // Returns the count of draws.
+    size_t size() const;
+    // Returns the draw and the sort key at the index.
+    uint32_t draw(size_t index) const;
+    uint64_t key(size_t index) const;
+
+private:
+    struct Item
+    {
+        uint64_t key;
+        uint32_t draw;
+    };
+
+    std::vector<Item> items;
+    std::vector<Item> sorted;
+};
+
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,621 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::EnvironmentBaker class
+ * -------------------------------------------------------------------------- */
+
+#include "vk_environment_baker.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+/* -------------------------------------------------------------------------- */
+
+#include "../vk_command.h"
+#include "../vk_queue.h"
+#include "../vk_stringify.h"
+#include "../vk_texture.h"
+#include "vk_atmoshere_renderer.h"
+#include "vk_bake_cache.h"
+#include "vk_bake_graph.h"
+#include "vk_cpu_baker.h"
+#include "vk_ibl_brdf_lut_renderer.h"
+#include "vk_ibl_prefilter_renderer.h"
+#include "vk_irradiance_renderer.h"
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+struct EnvironmentBaker::Impl
+{
+    // Renderers of a set of light direction dependent maps.
+    struct Slot
+    {
+        std::shared_ptr<AtmosphereRenderer> atmosphere;
+        std::shared_ptr<IrradianceRenderer> irradiance;
+        std::shared_ptr<IblPrefilterRenderer> prefilter;
+    };
+
+    // Records a step of an incremental update.
+    using Step = std::function<bool(const VkCommandBuffer&)>;
+
+    ~Impl()
+    {
+        if (inFlight)
+            vkWaitForFences(device, 1, &fence, VK_TRUE,
+                            std::numeric_limits<uint64_t>::max());
+
+        vkDestroyFence(device, fence, NULL);
+        vkDestroyQueryPool(device, queryPool, NULL);
+    }
+
+    Slot createSlot()
+    {
+        Slot slot;
+        slot.atmosphere = std::make_shared<AtmosphereRenderer>(
+            physicalDevice,
+            device,
+            cubeFormat);
+        slot.irradiance = std::make_shared<IrradianceRenderer>(
+            physicalDevice,
+            device,
+            slot.atmosphere->textureCube());
+        slot.prefilter = std::make_shared<IblPrefilterRenderer>(
+            physicalDevice,
+            device,
+            slot.atmosphere->textureCube(),
+            cubeFormat);
+        return slot;
+    }
+
+    // Creates the command pool, the fence and the timestamp queries of the
+    // incremental updates.
+    bool createUpdateResources(uint32_t stepCount)
+    {
+        if (commandPool)
+            return true;
+
+        commandPool = std::make_shared<CommandPool>(device);
+        commandPool->setQueueFamilyIndex(graphicsQueueFamilyIndex);
+        if (!commandPool->create())
+            return false;
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VkResult result = vkCreateFence(device, &fenceInfo, NULL, &fence);
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": fence creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+
+        // Without timestamps the step times are unknown and a single step
+        // is submitted per frame.
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, NULL);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+        const uint32_t validBits = families[graphicsQueueFamilyIndex].timestampValidBits;
+        if (validBits == 0)
+            return true;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod;
+        timestampMask   = validBits >= 64 ? ~uint64_t(0)
+                                          : (uint64_t(1) << validBits) - 1;
+
+        VkQueryPoolCreateInfo queryInfo = {};
+        queryInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+        queryInfo.queryCount = stepCount + 1;
+        result = vkCreateQueryPool(device, &queryInfo, NULL, &queryPool);
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": timestamp query pool creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            queryPool = VK_NULL_HANDLE;
+        }
+        queryCount = stepCount + 1;
+        return true;
+    }
+
+    // Starts an update of the back maps into the pending light direction.
+    bool beginUpdate()
+    {
+        if (!back.atmosphere)
+            back = createSlot();
+
+        back.atmosphere->setLightDir(lightDir);
+        pending = false;
+
+        if (!back.prefilter->prepare())
+            return false;
+
+        // Steps keep the renderers of the slot, the slots are swapped
+        // after the update.
+        const Slot slot = back;
+        steps.clear();
+        steps.push_back([slot](const VkCommandBuffer& cmdBuf)
+        { return slot.atmosphere->record(cmdBuf); });
+        steps.push_back([slot](const VkCommandBuffer& cmdBuf)
+        { return slot.irradiance->record(cmdBuf); });
+
+        const uint32_t mipmapCount = slot.prefilter->textureCube()->mipmapCount;
+        for (uint32_t m = 0; m < mipmapCount; ++m)
+            steps.push_back([slot, m](const VkCommandBuffer& cmdBuf)
+            {
+                slot.prefilter->recordLevels(cmdBuf, m, 1);
+                return true;
+            });
+
+        nextStep = 0;
+        if (stepTimes.size() != steps.size())
+            stepTimes.assign(steps.size(), -1.0);
+
+        return createUpdateResources(uint32_t(steps.size()));
+    }
+
+    // Records and submits the next steps that fit into the budget.
+    bool submitSteps()
+    {
+        if (cmdBuf != VK_NULL_HANDLE)
+            commandPool->freeBuffers( { cmdBuf } );
+        cmdBuf = commandPool->allocateBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(cmdBuf, &beginInfo);
+
+        if (queryPool != VK_NULL_HANDLE)
+            vkCmdResetQueryPool(cmdBuf, queryPool, 0, queryCount);
+
+        // Steps of the previous frames were written by other submissions.
+        BakeGraph::recordBarrier(cmdBuf);
+
+        submittedStep = nextStep;
+        double time = 0.0;
+        while (nextStep < steps.size())
+        {
+            const double stepTime = stepTimes[nextStep];
+            if (nextStep > submittedStep)
+            {
+                if (stepTime < 0.0 || time + stepTime > budget)
+                    break;
+                BakeGraph::recordBarrier(cmdBuf);
+            }
+
+            if (queryPool != VK_NULL_HANDLE)
+                vkCmdWriteTimestamp(cmdBuf,
+                                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                    queryPool,
+                                    uint32_t(nextStep - submittedStep));
+
+            if (!steps[nextStep](cmdBuf))
+            {
+                vkEndCommandBuffer(cmdBuf);
+                steps.clear();
+                return false;
+            }
+
+            time += std::max(stepTime, 0.0);
+            ++nextStep;
+        }
+
+        if (queryPool != VK_NULL_HANDLE)
+            vkCmdWriteTimestamp(cmdBuf,
+                                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                queryPool,
+                                uint32_t(nextStep - submittedStep));
+
+        VkResult result = vkEndCommandBuffer(cmdBuf);
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": update commands failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            steps.clear();
+            return false;
+        }
+
+        vkResetFences(device, 1, &fence);
+
+        Queue graphicsQueue(device, graphicsQueueFamilyIndex, 0);
+        graphicsQueue.create();
+        if (!graphicsQueue.submit(cmdBuf, VK_NULL_HANDLE, VK_NULL_HANDLE, 0, fence))
+        {
+            steps.clear();
+            return false;
+        }
+
+        inFlight = true;
+        return true;
+    }
+
+    // Updates the step times from the timestamps of the executed steps.
+    void readTimestamps()
+    {
+        if (queryPool == VK_NULL_HANDLE)
+            return;
+
+        const size_t stepCount = nextStep - submittedStep;
+        std::vector<uint64_t> timestamps(stepCount + 1);
+        const VkResult result =
+            vkGetQueryPoolResults(
+                device,
+                queryPool,
+                0, uint32_t(timestamps.size()),
+                timestamps.size() * sizeof(uint64_t),
+                timestamps.data(),
+                sizeof(uint64_t),
+                VK_QUERY_RESULT_64_BIT);
+
+        if (result != VK_SUCCESS)
+            return;
+
+        for (size_t i = 0; i < stepCount; ++i)
+        {
+            const uint64_t ticks = (timestamps[i + 1] - timestamps[i]) & timestampMask;
+            const double ms = double(ticks) * timestampPeriod / 1000000.0;
+
+            double& stepTime = stepTimes[submittedStep + i];
+            stepTime = stepTime < 0.0 ? ms : stepTime * 0.75 + ms * 0.25;
+        }
+    }
+
+    // Input Vulkan handles
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+
+    // Graphics queue.
+    uint32_t graphicsQueueFamilyIndex;
+
+    // Format of the texture cubes.
+    VkFormat cubeFormat;
+
+    // Atmosphere light direction.
+    glm::vec3 lightDir = glm::vec3(0.0f, 1.0f, 0.0f);
+
+    // Maps used by the renderers and the maps being updated.
+    Slot front;
+    Slot back;
+    std::shared_ptr<Texture2D> brdfLut;
+
+    // True after the initial bake.
+    bool baked = false;
+    // True if the light direction has changed after the latest update
+    // began.
+    bool pending = false;
+
+    // Steps of the current update and the time estimates of the steps in
+    // milliseconds, negative if unknown.
+    std::vector<Step> steps;
+    std::vector<double> stepTimes;
+    size_t nextStep = 0;
+    size_t submittedStep = 0;
+
+    // GPU time budget per frame in milliseconds.
+    double budget = 1.0;
+
+    // True if the atmosphere and the BRDF LUT are baked with the CPU.
+    bool cpuBake = false;
+
+    // Update submission.
+    std::shared_ptr<CommandPool> commandPool;
+    VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    bool inFlight = false;
+
+    // Timestamp queries of the steps.
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    uint32_t queryCount = 0;
+    float timestampPeriod = 1.0f;
+    uint64_t timestampMask = ~uint64_t(0);
+};
+
+/* -------------------------------------------------------------------------- */
+
+EnvironmentBaker::EnvironmentBaker(const VkPhysicalDevice& physicalDevice,
+                                   const VkDevice& device,
+                                   const uint32_t& graphicsQueueFamilyIndex,
+                                   const VkFormat& cubeFormat)
+    : impl(std::make_shared<Impl>())
+{
+    impl->physicalDevice           = physicalDevice;
+    impl->device                   = device;
+    impl->graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+    impl->cubeFormat               = cubeFormat;
+}
+
+void EnvironmentBaker::setLightDir(const glm::vec3& lightDir)
+{
+    if (impl->lightDir == lightDir)
+        return;
+
+    impl->lightDir = lightDir;
+    if (impl->baked)
+        impl->pending = true;
+}
+
+void EnvironmentBaker::setUpdateBudget(double milliseconds)
+{ impl->budget = milliseconds; }
+
+void EnvironmentBaker::setCpuBake(bool cpuBake)
+{ impl->cpuBake = cpuBake; }
+
+bool EnvironmentBaker::bake()
+{
+    Impl::Slot slot = impl->createSlot();
+    slot.atmosphere->setLightDir(impl->lightDir);
+
+    IblBrdfLutRenderer iblBrdfRenderer(impl->physicalDevice, impl->device);
+
+    //--------------------------------------------------------------------------
+    // Restore the maps from the bake cache. Environment dependent maps are
+    // keyed by the atmosphere key. If the atmosphere is baked with the CPU
+    // then the key is tagged so that the maps derived from it do not
+    // replace the maps derived from the GPU bake.
+
+    BakeCache bakeCache(impl->physicalDevice,
+                        impl->device,
+                        impl->graphicsQueueFamilyIndex);
+
+    const uint64_t atmosphereKey = slot.atmosphere->cacheKey();
+    bool atmosphereCached =
+        bakeCache.restore("atmosphere", atmosphereKey,
+                          slot.atmosphere->textureCube());
+
+    const char cpuTag[] = "cpu";
+    const uint64_t environmentKey =
+        impl->cpuBake && !atmosphereCached
+            ? BakeCache::hash(cpuTag, sizeof(cpuTag), atmosphereKey)
+            : atmosphereKey;
+    const uint64_t irradianceKey =
+        BakeCache::hash(&environmentKey, sizeof(environmentKey),
+                        slot.irradiance->cacheKey());
+    const uint64_t prefilterKey =
+        BakeCache::hash(&environmentKey, sizeof(environmentKey),
+                        slot.prefilter->cacheKey());
+    const uint64_t brdfLutKey = iblBrdfRenderer.cacheKey();
+
+    const bool irradianceCached =
+        bakeCache.restore("irradiance", irradianceKey,
+                          slot.irradiance->buffer());
+    const bool prefilterCached =
+        bakeCache.restore("prefiltered", prefilterKey,
+                          slot.prefilter->textureCube());
+    bool brdfLutCached =
+        bakeCache.restore("brdf_lut", brdfLutKey,
+                          iblBrdfRenderer.texture());
+
+    //--------------------------------------------------------------------------
+    // Bake the atmosphere and the BRDF LUT with the CPU if requested. The
+    // uploaded maps are handled as cached by the GPU bake and are not
+    // stored into the cache, the GPU bake is the reference of the cache.
+    // The maps derived from the CPU atmosphere are stored with the tagged
+    // key.
+
+    if (impl->cpuBake && !atmosphereCached)
+    {
+        std::shared_ptr<TextureCube> cube = slot.atmosphere->textureCube();
+        atmosphereCached = bakeCache.upload(
+            cpu_baker::atmosphere(slot.atmosphere->params(),
+                                  cube->extent,
+                                  cube->format),
+            cube);
+    }
+
+    if (impl->cpuBake && !brdfLutCached)
+    {
+        std::shared_ptr<Texture2D> lut = iblBrdfRenderer.texture();
+        brdfLutCached = bakeCache.upload(
+            cpu_baker::brdfLut(lut->extent, lut->format),
+            lut);
+    }
+
+    //--------------------------------------------------------------------------
+    // Bake the rest in a single submission. The IBL maps read the
+    // atmosphere if it is baked in the same graph, the BRDF LUT does not
+    // depend on anything and overlaps with the atmosphere.
+
+    BakeGraph graph(impl->device, impl->graphicsQueueFamilyIndex);
+
+    std::vector<int> environmentDeps;
+    if (!atmosphereCached)
+        environmentDeps.push_back(graph.addPass(
+            [&](const VkCommandBuffer& cmdBuf)
+            { return slot.atmosphere->record(cmdBuf); }));
+
+    if (!irradianceCached)
+        graph.addPass(
+            [&](const VkCommandBuffer& cmdBuf)
+            { return slot.irradiance->record(cmdBuf); },
+            environmentDeps);
+
+    if (!prefilterCached)
+        graph.addPass(
+            [&](const VkCommandBuffer& cmdBuf)
+            { return slot.prefilter->record(cmdBuf); },
+            environmentDeps);
+
+    if (!brdfLutCached)
+        graph.addPass(
+            [&](const VkCommandBuffer& cmdBuf)
+            { return iblBrdfRenderer.record(cmdBuf); });
+
+    // The GPU bake falls back into the CPU bake of the atmosphere and the
+    // BRDF LUT, e.g. if their pipelines could not be created.
+    if (!graph.isEmpty() && !graph.execute())
+    {
+        if (impl->cpuBake)
+            return false;
+
+        std::cerr << __FUNCTION__
+                  << ": GPU bake failed, the atmosphere and the BRDF LUT "
+                  << "are baked with the CPU"
+                  << std::endl;
+        impl->cpuBake = true;
+        return bake();
+    }
+
+    //--------------------------------------------------------------------------
+    // Store the baked maps.
+
+    if (!atmosphereCached)
+        bakeCache.store("atmosphere", atmosphereKey,
+                        slot.atmosphere->textureCube());
+    if (!irradianceCached)
+        bakeCache.store("irradiance", irradianceKey,
+                        slot.irradiance->buffer());
+    if (!prefilterCached)
+        bakeCache.store("prefiltered", prefilterKey,
+                        slot.prefilter->textureCube());
+    if (!brdfLutCached)
+        bakeCache.store("brdf_lut", brdfLutKey,
+                        iblBrdfRenderer.texture());
+
+    impl->front   = slot;
+    impl->brdfLut = iblBrdfRenderer.texture();
+    impl->baked   = true;
+    impl->pending = false;
+
+    return true;
+}
+
+bool EnvironmentBaker::validateCpuBake()
+{
+    const float atmosphereTolerance = 0.04f;
+    const float atmosphereFloor     = 0.01f;
+    const float brdfLutTolerance    = 0.01f;
+
+    AtmosphereRenderer atmosphere(impl->physicalDevice,
+                                  impl->device,
+                                  impl->cubeFormat);
+    atmosphere.setLightDir(impl->lightDir);
+    IblBrdfLutRenderer iblBrdfRenderer(impl->physicalDevice, impl->device);
+
+    BakeGraph graph(impl->device, impl->graphicsQueueFamilyIndex);
+    graph.addPass([&](const VkCommandBuffer& cmdBuf)
+    { return atmosphere.record(cmdBuf); });
+    graph.addPass([&](const VkCommandBuffer& cmdBuf)
+    { return iblBrdfRenderer.record(cmdBuf); });
+    if (!graph.execute())
+        return false;
+
+    BakeCache bakeCache(impl->physicalDevice,
+                        impl->device,
+                        impl->graphicsQueueFamilyIndex);
+
+    std::shared_ptr<TextureCube> cube = atmosphere.textureCube();
+    std::shared_ptr<Texture2D> lut = iblBrdfRenderer.texture();
+
+    std::vector<char> gpuAtmosphere;
+    std::vector<char> gpuBrdfLut;
+    if (!bakeCache.download(cube, gpuAtmosphere) ||
+        !bakeCache.download(lut, gpuBrdfLut))
+    {
+        return false;
+    }
+
+    const float atmosphereDiff =
+        cpu_baker::difference(
+            gpuAtmosphere,
+            cpu_baker::atmosphere(atmosphere.params(), cube->extent, cube->format),
+            cube->format,
+            atmosphereFloor);
+    const float brdfLutDiff =
+        cpu_baker::difference(
+            gpuBrdfLut,
+            cpu_baker::brdfLut(lut->extent, lut->format),
+            lut->format,
+            1.0f);
+
+    const bool atmosphereValid =
+        atmosphereDiff >= 0.0f && atmosphereDiff <= atmosphereTolerance;
+    const bool brdfLutValid =
+        brdfLutDiff >= 0.0f && brdfLutDiff <= brdfLutTolerance;
+
+    std::cout << __FUNCTION__
+              << ": atmosphere difference "  << atmosphereDiff
+              << " (tolerance " << atmosphereTolerance << "), "
+              << "BRDF LUT difference " << brdfLutDiff
+              << " (tolerance " << brdfLutTolerance << ")"
+              << std::endl;
+
+    return atmosphereValid && brdfLutValid;
+}
+
+bool EnvironmentBaker::update()
+{
+    if (!impl->baked)
+        return false;
+
+    //--------------------------------------------------------------------------
+    // Collect the previous submission if it has been executed.
+
+    if (impl->inFlight)
+    {
+        if (vkGetFenceStatus(impl->device, impl->fence) != VK_SUCCESS)
+            return false;
+
+        impl->inFlight = false;
+        impl->readTimestamps();
+
+        if (impl->nextStep == impl->steps.size())
+        {
+            // Incrementally updated maps are not stored into the bake
+            // cache, the light direction changes continuously.
+            std::swap(impl->front, impl->back);
+            impl->steps.clear();
+            return true;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // Continue the current update or begin a new one.
+
+    if (impl->steps.empty())
+    {
+        if (!impl->pending)
+            return false;
+        if (!impl->beginUpdate())
+        {
+            impl->steps.clear();
+            return false;
+        }
+    }
+
+    impl->submitSteps();
+    return false;
+}
+
+std::shared_ptr<TextureCube> EnvironmentBaker::environment() const
+{ return impl->front.atmosphere->textureCube(); }
+
+std::shared_ptr<Buffer> EnvironmentBaker::irradiance() const
+{ return impl->front.irradiance->buffer(); }
+
+std::shared_ptr<TextureCube> EnvironmentBaker::prefiltered() const
+{ return impl->front.prefilter->textureCube(); }
+
+std::shared_ptr<Texture2D> EnvironmentBaker::brdfLut() const
+{ return impl->brdfLut; }
+
+} // namespace vk
+} // namespace kuu
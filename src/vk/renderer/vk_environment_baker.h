@@ -0,0 +1,93 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::EnvironmentBaker class
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <glm/vec3.hpp>
+#include <memory>
+#include <vulkan/vulkan.h>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+class Buffer;
+struct Texture2D;
+struct TextureCube;
+
+/* -------------------------------------------------------------------------- *
+   Bakes the atmosphere environment and the IBL maps of it.
+
+   The maps are restored from the bake cache if possible. The maps that are
+   not in the cache are recorded as passes of a bake graph and executed in
+   a single submission.
+
+   After the initial bake a change of the light direction is baked
+   incrementally into a second set of maps. Each update submits the
+   atmosphere, the irradiance and the prefiltered mipmap levels in steps
+   that fit into the GPU time budget. Step times are measured with
+   timestamp queries. The maps are swapped when all the steps have been
+   executed so the shading never sees partially updated maps.
+ * -------------------------------------------------------------------------- */
+class EnvironmentBaker
+{
+public:
+    // Constructs the baker. The atmosphere and the prefiltered texture
+    // cubes are baked in the given in HDR format.
+    EnvironmentBaker(const VkPhysicalDevice& physicalDevice,
+                     const VkDevice& device,
+                     const uint32_t& graphicsQueueFamilyIndex,
+                     const VkFormat& cubeFormat);
+
+    // Sets the light direction of the atmosphere. If the maps have been
+    // baked a change of the direction starts an incremental update.
+    void setLightDir(const glm::vec3& lightDir);
+
+    // Sets the GPU time budget of an incremental update per frame in
+    // milliseconds. At least one step is submitted per frame.
+    void setUpdateBudget(double milliseconds);
+
+    // Sets the atmosphere and the BRDF LUT to be baked with the CPU
+    // instead of the GPU, e.g. if the device is slow or when validating
+    // the GPU bakes. Other maps are baked with the GPU.
+    void setCpuBake(bool cpuBake);
+
+    // Bakes the maps. If the GPU bake fails then the atmosphere and the
+    // BRDF LUT are baked with the CPU. Returns false if the baking failed.
+    bool bake();
+
+    // Bakes the atmosphere and the BRDF LUT with both the GPU and the CPU
+    // and compares the bakes. The tolerance of the atmosphere is 4 % of
+    // the radiance, or of 0.01 for darker texels, and of the BRDF LUT 0.01
+    // in absolute terms. This covers the precision of the transcendental
+    // functions of the device and of the packed float formats. Returns
+    // false if a bake failed or if the bakes differ more.
+    bool validateCpuBake();
+
+    // Continues the incremental update. This does not block. Returns true
+    // if the maps have been swapped and need to be set into renderers.
+    bool update();
+
+    // Returns the atmosphere environment.
+    std::shared_ptr<TextureCube> environment() const;
+    // Returns the SH coefficients of the diffuse irradiance.
+    std::shared_ptr<Buffer> irradiance() const;
+    // Returns the prefiltered specular environment.
+    std::shared_ptr<TextureCube> prefiltered() const;
+    // Returns the BRDF integration lookup table.
+    std::shared_ptr<Texture2D> brdfLut() const;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace vk
+} // namespace kuu
@@ -15,18 +15,20 @@
 #include <glm/gtx/string_cast.hpp>
 #include <iostream>
 #include "../vk_buffer.h"
-#include "../vk_command.h"
 #include "../vk_descriptor_set.h"
 #include "../vk_image.h"
 #include "../vk_mesh.h"
+#include "../vk_object_key.h"
 #include "../vk_pipeline.h"
-#include "../vk_queue.h"
+#include "../vk_pipeline_registry.h"
 #include "../vk_image.h"
 #include "../vk_image_layout_transition.h"
 #include "../vk_render_pass.h"
 #include "../vk_shader_module.h"
+#include "../vk_shader_registry.h"
 #include "../vk_texture.h"
 #include "../../common/mesh.h"
+#include "vk_bake_cache.h"
 
 namespace kuu
 {
@@ -37,13 +39,24 @@ namespace vk
 
 struct IblBrdfLutRenderer::Impl
 {
+    ~Impl()
+    {
+        vkDestroyFramebuffer(
+            device,
+            framebuffer,
+            NULL);
+
+        object_key::removeRenderPass(renderPass);
+        vkDestroyRenderPass(
+            device,
+            renderPass,
+            NULL);
+    }
+
     // Input Vulkan handles
     VkPhysicalDevice physicalDevice;
     VkDevice device;
 
-    // Graphics queue.
-    uint32_t graphicsQueueFamilyIndex;
-
     // Texture
     std::shared_ptr<Texture2D> texture;
 
@@ -52,21 +65,27 @@ struct IblBrdfLutRenderer::Impl
 
     // Format of the texture cube.
     VkFormat format;
+
+    // Resources of the recorded commands.
+    std::shared_ptr<Mesh> mesh;
+    std::shared_ptr<ShaderModule> vshModule;
+    std::shared_ptr<ShaderModule> fshModule;
+    std::shared_ptr<Pipeline> pipeline;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
 };
 
 /* -------------------------------------------------------------------------- */
 
 IblBrdfLutRenderer::IblBrdfLutRenderer(
         const VkPhysicalDevice& physicalDevice,
-        const VkDevice& device,
-        const uint32_t& graphicsQueueFamilyIndex)
+        const VkDevice& device)
     : impl(std::make_shared<Impl>())
 {
-    impl->physicalDevice           = physicalDevice;
-    impl->device                   = device;
-    impl->graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
-    impl->format                   = VK_FORMAT_R16G16_SFLOAT;
-    impl->extent                   = { uint32_t(128), uint32_t(128), uint32_t(1) };
+    impl->physicalDevice = physicalDevice;
+    impl->device         = device;
+    impl->format         = VK_FORMAT_R16G16_SFLOAT;
+    impl->extent         = { uint32_t(128), uint32_t(128), uint32_t(1) };
     impl->texture = std::make_shared<Texture2D>(
         physicalDevice,
         device,
@@ -75,10 +94,14 @@ IblBrdfLutRenderer::IblBrdfLutRenderer(
         VK_FILTER_LINEAR,
         VK_FILTER_LINEAR,
         VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT     |
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT     |
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+        VK_IMAGE_USAGE_SAMPLED_BIT);
 }
 
-void IblBrdfLutRenderer::render()
+bool IblBrdfLutRenderer::record(const VkCommandBuffer& cmdBuf)
 {
     //--------------------------------------------------------------------------
     // Quad mesh in NDC space.
@@ -111,6 +134,7 @@ void IblBrdfLutRenderer::render()
         std::make_shared<Mesh>(
             impl->physicalDevice,
             impl->device);
+    impl->mesh = mesh;
 
     mesh->setVertices(vertexVector);
     mesh->setIndices(m.indices);
@@ -118,7 +142,7 @@ void IblBrdfLutRenderer::render()
     mesh->addVertexAttributeDescription(1, 0, VK_FORMAT_R32G32_SFLOAT,    3 * sizeof(float));
     mesh->setVertexBindingDescription(0, 5 * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX);
     if (!mesh->create())
-        return;
+        return false;
 
     //--------------------------------------------------------------------------
     // Shader modules.
@@ -126,19 +150,17 @@ void IblBrdfLutRenderer::render()
     const std::string vshFilePath = "shaders/pbr_ibl_brdf_lut.vert.spv";
     const std::string fshFilePath = "shaders/pbr_ibl_brdf_lut.frag.spv";
 
-    std::shared_ptr<ShaderModule> vshModule =
-        std::make_shared<ShaderModule>(impl->device, vshFilePath);
-    vshModule->setStageName("main");
-    vshModule->setStage(VK_SHADER_STAGE_VERTEX_BIT);
-    if (!vshModule->create())
-        return;
+    std::shared_ptr<ShaderModule> vshModule = shader_registry::module(
+        impl->device, vshFilePath, VK_SHADER_STAGE_VERTEX_BIT);
+    impl->vshModule = vshModule;
+    if (!vshModule)
+        return false;
 
-    std::shared_ptr<ShaderModule> fshModule =
-        std::make_shared<ShaderModule>(impl->device, fshFilePath);
-    fshModule->setStageName("main");
-    fshModule->setStage(VK_SHADER_STAGE_FRAGMENT_BIT);
-    if (!fshModule->create())
-        return;
+    std::shared_ptr<ShaderModule> fshModule = shader_registry::module(
+        impl->device, fshFilePath, VK_SHADER_STAGE_FRAGMENT_BIT);
+    impl->fshModule = fshModule;
+    if (!fshModule)
+        return false;
 
     //--------------------------------------------------------------------------
     // Render pass
@@ -195,7 +217,7 @@ void IblBrdfLutRenderer::render()
     rpInfo.dependencyCount = 1;
     rpInfo.pDependencies   = &dependency;
 
-    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkRenderPass& renderPass = impl->renderPass;
     VkResult result =
         vkCreateRenderPass(
             impl->device,
@@ -208,9 +230,11 @@ void IblBrdfLutRenderer::render()
         std::cerr << __FUNCTION__
                   << ": render pass creation failed"
                   << std::endl;
-        return;
+        return false;
     }
 
+    object_key::addRenderPass(renderPass, rpInfo);
+
     std::vector<VkImageView> attachments =
     { impl->texture->imageView };
 
@@ -225,7 +249,7 @@ void IblBrdfLutRenderer::render()
     fbInfo.height          = impl->extent.height;
     fbInfo.layers          = 1;
 
-    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VkFramebuffer& framebuffer = impl->framebuffer;
     result = vkCreateFramebuffer(
             impl->device,
             &fbInfo,
@@ -237,7 +261,7 @@ void IblBrdfLutRenderer::render()
         std::cerr << __FUNCTION__
                   << ": framebuffer creation failed"
                   << std::endl;
-        return;
+        return false;
     }
 
     //--------------------------------------------------------------------------
@@ -278,33 +302,14 @@ void IblBrdfLutRenderer::render()
     pipeline->setPipelineLayout(descriptorSetLayouts, pushConstantRanges);
     pipeline->setDynamicState( { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR } );
     pipeline->setRenderPass(renderPass);
-    if (!pipeline->create())
-        return;
-
-    //--------------------------------------------------------------------------
-    // Command pool
-
-    std::shared_ptr<CommandPool> graphicsCommandPool =
-        std::make_shared<CommandPool>(impl->device);
-    graphicsCommandPool->setQueueFamilyIndex(impl->graphicsQueueFamilyIndex);
-    if (!graphicsCommandPool->create())
-        return;
+    pipeline = pipeline_registry::pipeline(pipeline);
+    if (!pipeline)
+        return false;
+    impl->pipeline = pipeline;
 
     //--------------------------------------------------------------------------
     // Record commands
 
-    VkCommandBuffer cmdBuf =
-        graphicsCommandPool->allocateBuffer(
-            VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-    VkCommandBufferBeginInfo beginInfo;
-    beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.pNext            = NULL;
-    beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-    beginInfo.pInheritanceInfo = NULL;
-
-    vkBeginCommandBuffer(cmdBuf, &beginInfo);
-
     VkImageSubresourceRange subresourceRange = {};
     subresourceRange.aspectMask  = VK_IMAGE_ASPECT_COLOR_BIT;
     subresourceRange.levelCount  = 1;
@@ -382,38 +387,15 @@ void IblBrdfLutRenderer::render()
         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-    result = vkEndCommandBuffer(cmdBuf);
-    if (result != VK_SUCCESS)
-    {
-        std::cerr << __FUNCTION__
-                  << ": render commands failed"
-                  << std::endl;
-        return;
-    }
-
-    //--------------------------------------------------------------------------
-    // Render
-
-    Queue graphicsQueue(impl->device, impl->graphicsQueueFamilyIndex, 0);
-    graphicsQueue.create();
-    graphicsQueue.submit(cmdBuf,
-                         VK_NULL_HANDLE,
-                         VK_NULL_HANDLE,
-                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-    graphicsQueue.waitIdle();
-
-    //--------------------------------------------------------------------------
-    // Clean up
-
-    vkDestroyFramebuffer(
-        impl->device,
-        framebuffer,
-        NULL);
+    return true;
+}
 
-    vkDestroyRenderPass(
-        impl->device,
-        renderPass,
-        NULL);
+uint64_t IblBrdfLutRenderer::cacheKey() const
+{
+    uint64_t key = BakeCache::hash(&impl->extent, sizeof(impl->extent));
+    key = BakeCache::hash(&impl->format, sizeof(impl->format), key);
+    key = BakeCache::hashShader("shaders/pbr_ibl_brdf_lut.vert.spv", key);
+    return BakeCache::hashShader("shaders/pbr_ibl_brdf_lut.frag.spv", key);
 }
 
 std::shared_ptr<Texture2D> IblBrdfLutRenderer::texture() const
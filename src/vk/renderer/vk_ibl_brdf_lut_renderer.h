@@ -21,10 +21,15 @@ class IblBrdfLutRenderer
 public:
     IblBrdfLutRenderer(
         const VkPhysicalDevice& physicalDevice,
-        const VkDevice& device,
-        const uint32_t& graphicsQueueFamilyIndex);
+        const VkDevice& device);
 
-    void render();
+    // Records the rendering of the BRDF LUT. The renderer needs to be alive
+    // until the commands have been executed. Returns false if the recording
+    // failed.
+    bool record(const VkCommandBuffer& cmdBuf);
+
+    // Returns the key of the texture in the bake cache.
+    uint64_t cacheKey() const;
 
     std::shared_ptr<Texture2D> texture() const;
 
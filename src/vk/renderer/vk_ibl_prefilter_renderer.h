@@ -19,13 +19,32 @@ struct TextureCube;
 class IblPrefilterRenderer
 {
 public:
+    // Constructs the prefilter of the input texture cube into a texture
+    // cube of the given in HDR format.
     IblPrefilterRenderer(
         const VkPhysicalDevice& physicalDevice,
         const VkDevice& device,
-        const uint32_t& graphicsQueueFamilyIndex,
-        std::shared_ptr<TextureCube> inputTextureCube);
-
-    void render();
+        std::shared_ptr<TextureCube> inputTextureCube,
+        const VkFormat& format);
+
+    // Records the prefiltering of the input texture cube. The renderer
+    // needs to be alive until the commands have been executed. Returns
+    // false if the recording failed.
+    bool record(const VkCommandBuffer& cmdBuf);
+
+    // Prepares the prefiltering without recording commands. Returns false
+    // if the preparation failed.
+    bool prepare();
+    // Records the prefiltering of the given in mipmap levels. Requires that
+    // the renderer has been prepared. The renderer needs to be alive until
+    // the commands have been executed.
+    void recordLevels(const VkCommandBuffer& cmdBuf,
+                      uint32_t firstLevel,
+                      uint32_t levelCount);
+
+    // Returns the key of the texture cube in the bake cache. The key does
+    // not contain the input texture cube.
+    uint64_t cacheKey() const;
 
     std::shared_ptr<TextureCube> textureCube() const;
 
@@ -14,20 +14,36 @@ namespace kuu
 namespace vk
 {
 
+class Buffer;
 struct TextureCube;
 
+/* -------------------------------------------------------------------------- *
+   Projects the environment texture cube into nine spherical harmonics
+   coefficients of the diffuse irradiance with a compute shader.
+
+   The output buffer contains the coefficients as nine vec4s, w is unused.
+   The coefficients are convolved with the cosine lobe and divided by PI
+   so the shader only needs to evaluate the SH basis at the surface normal.
+ * -------------------------------------------------------------------------- */
 class IrradianceRenderer
 {
 public:
     IrradianceRenderer(
         const VkPhysicalDevice& physicalDevice,
         const VkDevice& device,
-        const uint32_t& graphicsQueueFamilyIndex,
         std::shared_ptr<TextureCube> inputTextureCube);
 
-    void render();
+    // Records the projection of the input texture cube. The renderer needs
+    // to be alive until the commands have been executed. Returns false if
+    // the recording failed.
+    bool record(const VkCommandBuffer& cmdBuf);
+
+    // Returns the key of the buffer in the bake cache. The key does not
+    // contain the input texture cube.
+    uint64_t cacheKey() const;
 
-    std::shared_ptr<TextureCube> textureCube() const;
+    // Returns the uniform buffer of SH coefficients.
+    std::shared_ptr<Buffer> buffer() const;
 
 private:
     struct Impl;
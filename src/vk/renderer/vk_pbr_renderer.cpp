@@ -8,18 +8,26 @@
 
 /* -------------------------------------------------------------------------- */
 
-#include <glm/gtc/matrix_inverse.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <glm/gtx/string_cast.hpp>
 #include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
 
 /* -------------------------------------------------------------------------- */
 
 #include "../../common/camera.h"
+#include "../../common/frustum.h"
 #include "../../common/light.h"
 #include "../../common/material.h"
 #include "../../common/mesh.h"
 #include "../../common/model.h"
 #include "../../common/scene.h"
+#include "../../common/transform_store.h"
 
 /* -------------------------------------------------------------------------- */
 
@@ -27,15 +35,17 @@
 #include "../vk_command.h"
 #include "../vk_descriptor_set.h"
 #include "../vk_mesh.h"
+#include "../vk_object_key.h"
 #include "../vk_pipeline.h"
+#include "../vk_pipeline_registry.h"
 #include "../vk_queue.h"
 #include "../vk_shader_module.h"
+#include "../vk_shader_registry.h"
 #include "../vk_stringify.h"
 #include "../vk_texture.h"
-#include "vk_irradiance_renderer.h"
-#include "vk_ibl_brdf_lut_renderer.h"
-#include "vk_ibl_prefilter_renderer.h"
+#include "vk_draw_list.h"
 #include "vk_mesh_manager.h"
+#include "vk_texture_residency_manager.h"
 
 namespace kuu
 {
@@ -47,26 +57,83 @@ namespace
 /* -------------------------------------------------------------------------- *
    Uniform structs
  * -------------------------------------------------------------------------- */
-struct Matrices
+struct Frame
 {
-    glm::mat4 model;
     glm::mat4 view;
     glm::mat4 projection;
-    glm::mat4 normal;
     glm::mat4 light;
+    glm::vec4 cameraPos;
 };
 
 struct PbrParams
 {
+    glm::vec4 albedo;
+    float metallic;
+    float roughness;
+    float ao;
+};
+
+/* -------------------------------------------------------------------------- *
+   Per-draw transforms, indexed with the draw index push constant.
+ * -------------------------------------------------------------------------- */
+struct Draw
+{
+    glm::mat4 model;
+    glm::mat4 normal;
+};
+
+/* -------------------------------------------------------------------------- *
+   Bindless uniform and storage structs
+ * -------------------------------------------------------------------------- */
+struct BindlessFrame
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 light;
     glm::vec4 cameraPos;
+};
+
+struct BindlessDraw
+{
+    glm::mat4 model;
+    glm::mat4 normal;
     glm::vec4 albedo;
     float metallic;
     float roughness;
     float ao;
+    float padding;
+    glm::ivec4 maps0; // ambient occlusion, base color, height, metallic
+    glm::ivec4 maps1; // normal, roughness, unused, unused
 };
 
 /* -------------------------------------------------------------------------- *
-   Textures.
+   Material features of pbr.frag, a bit per material map. The bit index is
+   the constant ID of the specialization constant in the shader.
+ * -------------------------------------------------------------------------- */
+const uint32_t FEATURE_AMBIENT_OCCLUSION_MAP = 1 << 0;
+const uint32_t FEATURE_BASE_COLOR_MAP        = 1 << 1;
+const uint32_t FEATURE_HEIGHT_MAP            = 1 << 2;
+const uint32_t FEATURE_METALLIC_MAP          = 1 << 3;
+const uint32_t FEATURE_NORMAL_MAP            = 1 << 4;
+const uint32_t FEATURE_ROUGHNESS_MAP         = 1 << 5;
+const uint32_t FEATURE_COUNT                 = 6;
+
+// Returns the feature mask of the material.
+uint32_t materialFeatures(const Material::Pbr& pbr)
+{
+    uint32_t features = 0;
+    if (pbr.ambientOcclusionMap.size()) features |= FEATURE_AMBIENT_OCCLUSION_MAP;
+    if (pbr.baseColorMap.size())        features |= FEATURE_BASE_COLOR_MAP;
+    if (pbr.heightMap.size())           features |= FEATURE_HEIGHT_MAP;
+    if (pbr.metallicMap.size())         features |= FEATURE_METALLIC_MAP;
+    if (pbr.normalMap.size())           features |= FEATURE_NORMAL_MAP;
+    if (pbr.roughnessMap.size())        features |= FEATURE_ROUGHNESS_MAP;
+    return features;
+}
+
+/* -------------------------------------------------------------------------- *
+   Textures. File textures are kept within the device memory budget by the
+   residency manager, dummy textures are used in place of evicted textures.
  * -------------------------------------------------------------------------- */
 struct TextureManager
 {
@@ -78,6 +145,10 @@ struct TextureManager
         , device(device)
         , queueFamilyIndex(queueFamilyIndex)
         , commandPool(commandPool)
+        , residency(std::make_shared<TextureResidencyManager>(
+              physicalDevice,
+              device,
+              queueFamilyIndex))
     {
         VkExtent2D extent = { 1, 1 };
 
@@ -105,24 +176,24 @@ struct TextureManager
 
     void add(const std::string& filepath)
     {
-        if (textures2d.count(filepath))
-            return;
-
-        Queue queue(device, queueFamilyIndex, 0);
-        queue.create();
+        if (filepath.size())
+            residency->add(filepath);
+    }
 
-        textures2d[filepath] =
-            std::make_shared<Texture2D>(
-                physicalDevice,
-                device,
-                queue,
-                commandPool,
-                filepath,
-                VK_FILTER_LINEAR,
-                VK_FILTER_LINEAR,
-                VK_SAMPLER_ADDRESS_MODE_REPEAT,
-                VK_SAMPLER_ADDRESS_MODE_REPEAT,
-                true);
+    // Returns the resident texture of file or a dummy texture if the file
+    // path is empty or the texture has been evicted.
+    std::shared_ptr<Texture2D> texture(const std::string& filepath,
+                                       bool grayScale)
+    {
+        std::shared_ptr<Texture2D> tex;
+        if (filepath.size())
+            tex = residency->texture(filepath);
+        if (tex)
+            return tex;
+
+        if (grayScale)
+            return textures2d["dummy_r"];
+        return textures2d["dummy_rgba"];
     }
 
     const VkPhysicalDevice physicalDevice;
@@ -131,66 +202,55 @@ struct TextureManager
     CommandPool& commandPool;
 
     std::map<std::string, std::shared_ptr<Texture2D>> textures2d;
+    std::shared_ptr<TextureResidencyManager> residency;
 
     std::shared_ptr<TextureCube> environment;
-    std::shared_ptr<TextureCube> irradiance;
+    std::shared_ptr<Buffer> irradiance;
     std::shared_ptr<TextureCube> prefiltered;
     std::shared_ptr<Texture2D> brdfLut;
 };
 
 /* -------------------------------------------------------------------------- *
-   A model for physically-based rendering.
+   A material for physically-based rendering. The descriptor set of the
+   material contains the parameters and the maps of the material and it is
+   shared by the models of the material. There is a descriptor set per
+   frame.
  * -------------------------------------------------------------------------- */
-struct PbrModel
+struct PbrMaterial
 {
-    PbrModel(const VkPhysicalDevice& physicalDevice,
-             const VkDevice& device,
-             const VkDescriptorSetLayout& descriptorSetLayout,
-             const VkDescriptorPool& descriptorPool,
-             std::shared_ptr<Model> model,
-             std::shared_ptr<TextureManager> textureManager,
-             std::shared_ptr<MeshManager> meshManager,
-             std::shared_ptr<Texture2D> shadowMap)
-        : model(model)
+    PbrMaterial(const VkPhysicalDevice& physicalDevice,
+                const VkDevice& device,
+                const VkDescriptorSetLayout& descriptorSetLayout,
+                const VkDescriptorPool& descriptorPool,
+                uint32_t frameCount,
+                std::shared_ptr<Material> material,
+                std::shared_ptr<TextureManager> textureManager)
+        : material(material)
+        , textureManager(textureManager)
     {
         // ---------------------------------------------------------------------
         // Params
 
-        pbrParams.albedo    = glm::vec4(model->material->pbr.albedo, 1.0);
-        pbrParams.ao        = model->material->pbr.ao;
-        pbrParams.metallic  = model->material->pbr.metallic;
-        pbrParams.roughness = model->material->pbr.roughness;
-
-        // ---------------------------------------------------------------------
-        // Mesh
+        pbrParams.albedo    = glm::vec4(material->pbr.albedo, 1.0);
+        pbrParams.ao        = material->pbr.ao;
+        pbrParams.metallic  = material->pbr.metallic;
+        pbrParams.roughness = material->pbr.roughness;
 
-        mesh = meshManager->mesh(model->mesh);
+        features = materialFeatures(material->pbr);
 
         // ---------------------------------------------------------------------
         // Descriptor sets.
 
-        descriptorSets = std::make_shared<DescriptorSets>(device, descriptorPool);
-        descriptorSets->setLayout(descriptorSetLayout);
-        descriptorSets->create();
+        descriptorSets.resize(frameCount);
+        for (std::shared_ptr<DescriptorSets>& sets : descriptorSets)
+        {
+            sets = std::make_shared<DescriptorSets>(device, descriptorPool);
+            sets->setLayout(descriptorSetLayout);
+            sets->create();
+        }
 
         // ---------------------------------------------------------------------
-        // Uniform buffers
-
-        matricesUniformBuffer = std::make_shared<Buffer>(physicalDevice, device);
-        matricesUniformBuffer->setSize(sizeof(Matrices));
-        matricesUniformBuffer->setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-        matricesUniformBuffer->setMemoryProperties(
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        matricesUniformBuffer->create();
-
-        lightUniformBuffer = std::make_shared<Buffer>(physicalDevice, device);
-        lightUniformBuffer->setSize(sizeof(Light));
-        lightUniformBuffer->setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-        lightUniformBuffer->setMemoryProperties(
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        lightUniformBuffer->create();
+        // Uniform buffer
 
         paramsUniformBuffer = std::make_shared<Buffer>(physicalDevice, device);
         paramsUniformBuffer->setSize(sizeof(PbrParams));
@@ -201,103 +261,444 @@ struct PbrModel
         paramsUniformBuffer->create();
         paramsUniformBuffer->copyHostVisible(&pbrParams, paramsUniformBuffer->size());
 
-        descriptorSets->writeUniformBuffer(
-            0, matricesUniformBuffer->handle(),
-            0, matricesUniformBuffer->size());
+        for (uint32_t frame = 0; frame < frameCount; ++frame)
+        {
+            descriptorSets[frame]->writeUniformBuffer(
+                0, paramsUniformBuffer->handle(),
+                0, paramsUniformBuffer->size());
 
-        descriptorSets->writeUniformBuffer(
-            1, lightUniformBuffer->handle(),
-            0, lightUniformBuffer->size());
+            // -----------------------------------------------------------------
+            // Texture maps.
 
-        descriptorSets->writeUniformBuffer(
-            2, paramsUniformBuffer->handle(),
-            0, paramsUniformBuffer->size());
+            writeTextures(frame);
+        }
+    }
 
+    // Writes the material textures into descriptor set of the frame. This
+    // needs to be called when the texture residency changes.
+    void writeTextures(uint32_t frame)
+    {
         auto writeTexture = [&](uint32_t binding, std::string filePath, bool grayScale)
         {
-            std::shared_ptr<Texture2D> tex;
-            if (filePath.size())
-            {
-                textureManager->add(filePath);
-                tex = textureManager->textures2d.at(filePath);
+            std::shared_ptr<Texture2D> tex = textureManager->texture(filePath, grayScale);
+            descriptorSets[frame]->writeImage(
+                    binding,
+                    tex->sampler,
+                    tex->imageView,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        };
+
+        writeTexture(1, material->pbr.ambientOcclusionMap, true);
+        writeTexture(2, material->pbr.baseColorMap,        false);
+        writeTexture(3, material->pbr.heightMap,           true);
+        writeTexture(4, material->pbr.metallicMap,         true);
+        writeTexture(5, material->pbr.normalMap,           false);
+        writeTexture(6, material->pbr.roughnessMap,        true);
+    }
+
+    // Material
+    std::shared_ptr<Material> material;
+
+    // Textures
+    std::shared_ptr<TextureManager> textureManager;
+
+    // Uniform buffer of material parameters.
+    std::shared_ptr<Buffer> paramsUniformBuffer;
+
+    // Descriptor sets by the frame.
+    std::vector<std::shared_ptr<DescriptorSets>> descriptorSets;
+
+    // Material parameters, used when map is not set.
+    PbrParams pbrParams;
 
+    // Material features, selects the pipeline variant.
+    uint32_t features = 0;
+};
+
+/* -------------------------------------------------------------------------- *
+   Models for physically-based rendering that share the mesh and the material.
+   The models are drawn with a single instanced draw, the transforms of the
+   visible instances are in the draws buffer from the first draw on.
+ * -------------------------------------------------------------------------- */
+struct PbrInstances
+{
+    PbrInstances(std::shared_ptr<PbrMaterial> material,
+                 std::shared_ptr<Mesh> mesh)
+        : material(material)
+        , mesh(mesh)
+    {}
+
+    // Models
+    std::vector<std::shared_ptr<Model>> models;
+
+    // Material
+    std::shared_ptr<PbrMaterial> material;
+
+    // Mesh
+    std::shared_ptr<Mesh> mesh;
+
+    // Index of the first instance into the draws buffer and the index of
+    // the draw command.
+    uint32_t firstDraw   = 0;
+    uint32_t drawCommand = 0;
+
+    // Count of the instances visible in the current frame.
+    uint32_t visibleCount = 0;
+};
+
+/* -------------------------------------------------------------------------- *
+   Hash of a pair of pointers.
+ * -------------------------------------------------------------------------- */
+struct PointerPairHash
+{
+    template <typename A, typename B>
+    size_t operator()(const std::pair<A*, B*>& p) const
+    {
+        const size_t h = std::hash<A*>()(p.first);
+        return h ^ (std::hash<B*>()(p.second) + 0x9e3779b9 + (h << 6) + (h >> 2));
+    }
+};
+
+/* -------------------------------------------------------------------------- *
+   Returns the unique material texture file paths of models.
+ * -------------------------------------------------------------------------- */
+std::vector<std::string> materialTexturePaths(
+    const std::vector<std::shared_ptr<Model>>& models)
+{
+    std::vector<std::string> out;
+    for (std::shared_ptr<Model> m : models)
+    {
+        const Material::Pbr& pbr = m->material->pbr;
+        for (const std::string& filePath : { pbr.ambientOcclusionMap,
+                                             pbr.baseColorMap,
+                                             pbr.heightMap,
+                                             pbr.metallicMap,
+                                             pbr.normalMap,
+                                             pbr.roughnessMap })
+        {
+            if (filePath.size() &&
+                std::find(out.begin(), out.end(), filePath) == out.end())
+            {
+                out.push_back(filePath);
             }
-            else
+        }
+    }
+    return out;
+}
+
+/* -------------------------------------------------------------------------- *
+   Bindless rendering of PBR models. The material textures of all the models
+   are in a single sampled image array and the per-draw data is in a storage
+   buffer indexed with the instance index. A single descriptor set is bound
+   per frame, each frame has its own descriptor set.
+ * -------------------------------------------------------------------------- */
+struct PbrBindless
+{
+    PbrBindless(const VkPhysicalDevice& physicalDevice,
+                const VkDevice& device,
+                uint32_t frameCount,
+                const std::vector<std::shared_ptr<Model>>& models,
+                std::shared_ptr<TextureManager> textureManager,
+                std::shared_ptr<MeshManager> meshManager,
+                std::shared_ptr<Texture2D> shadowMap)
+        : device(device)
+        , models(models)
+        , textureManager(textureManager)
+    {
+        // ---------------------------------------------------------------------
+        // Draws
+
+        for (std::shared_ptr<Model> m : models)
+        {
+            const Material::Pbr& pbr = m->material->pbr;
+
+            BindlessDraw draw;
+            draw.albedo    = glm::vec4(pbr.albedo, 1.0);
+            draw.metallic  = pbr.metallic;
+            draw.roughness = pbr.roughness;
+            draw.ao        = pbr.ao;
+            draw.padding   = 0.0f;
+            draw.maps0     = glm::ivec4(slot(pbr.ambientOcclusionMap, true),
+                                        slot(pbr.baseColorMap,        false),
+                                        slot(pbr.heightMap,           true),
+                                        slot(pbr.metallicMap,         true));
+            draw.maps1     = glm::ivec4(slot(pbr.normalMap,           false),
+                                        slot(pbr.roughnessMap,        true),
+                                        -1, -1);
+            draws.push_back(draw);
+
+            // Models of the same mesh and material textures are next to
+            // each other and drawn with a single instanced draw. Texture
+            // array indices must be dynamically uniform within a draw so
+            // models of different textures cannot share a draw.
+            std::shared_ptr<Mesh> mesh = meshManager->mesh(m->mesh);
+            if (batches.empty() ||
+                batches.back().mesh != mesh ||
+                draws[batches.back().firstDraw].maps0 != draw.maps0 ||
+                draws[batches.back().firstDraw].maps1 != draw.maps1)
             {
-                if (grayScale)
-                    tex = textureManager->textures2d["dummy_r"];
-                else
-                    tex = textureManager->textures2d["dummy_rgba"];
+                Batch batch;
+                batch.mesh      = mesh;
+                batch.firstDraw = uint32_t(draws.size() - 1);
+                batches.push_back(batch);
             }
+            batches.back().drawCount++;
+        }
 
-            descriptorSets->writeImage(
-                    binding,
-                    tex->sampler,
-                    tex->imageView,
-                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        textureCount = std::max(uint32_t(slotPaths.size()), 1u);
+
+        // ---------------------------------------------------------------------
+        // Texture array size is a specialization constant.
+
+        specializationEntry.constantID = 0;
+        specializationEntry.offset     = 0;
+        specializationEntry.size       = sizeof(int32_t);
+
+        specializationValue = int32_t(textureCount);
+
+        specializationInfo.mapEntryCount = 1;
+        specializationInfo.pMapEntries   = &specializationEntry;
+        specializationInfo.dataSize      = sizeof(int32_t);
+        specializationInfo.pData         = &specializationValue;
+
+        // ---------------------------------------------------------------------
+        // Descriptor set layout
+
+        std::vector<VkDescriptorSetLayoutBinding> layoutBindings =
+        {
+            { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1,            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1,            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1,            VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureCount, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1,            VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,            VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,            VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,            VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
         };
 
+        VkDescriptorSetLayoutCreateInfo layoutInfo;
+        layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext        = NULL;
+        layoutInfo.flags        = 0;
+        layoutInfo.bindingCount = uint32_t(layoutBindings.size());
+        layoutInfo.pBindings    = layoutBindings.data();
+
+        VkResult result =
+            vkCreateDescriptorSetLayout(
+                device,
+                &layoutInfo,
+                NULL,
+                &descriptorSetLayout);
+
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": bindless descriptor set layout creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return;
+        }
+
+        object_key::addDescriptorSetLayout(descriptorSetLayout, layoutInfo);
+
         // ---------------------------------------------------------------------
-        // Texture maps.
-
-        writeTexture(3, model->material->pbr.ambientOcclusionMap, true);
-        writeTexture(4, model->material->pbr.baseColorMap,        false);
-        writeTexture(5, model->material->pbr.heightMap,           true);
-        writeTexture(6, model->material->pbr.metallicMap,         true);
-        writeTexture(7, model->material->pbr.normalMap,           false);
-        writeTexture(8, model->material->pbr.roughnessMap,        true);
-
-        descriptorSets->writeImage(
-                9,
-                textureManager->irradiance->sampler,
-                textureManager->irradiance->imageView,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        // Descriptor pool and sets
+
+        descriptorPool = std::make_shared<DescriptorPool>(device);
+        descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1 * frameCount);
+        descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         3 * frameCount);
+        descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (textureCount + 3) * frameCount);
+        descriptorPool->setMaxCount(frameCount);
+        descriptorPool->create();
 
-        descriptorSets->writeImage(
-                10,
+        descriptorSets.resize(frameCount);
+        for (std::shared_ptr<DescriptorSets>& sets : descriptorSets)
+        {
+            sets = std::make_shared<DescriptorSets>(device, descriptorPool->handle());
+            sets->setLayout(descriptorSetLayout);
+            sets->create();
+        }
+
+        // ---------------------------------------------------------------------
+        // Buffers
+
+        drawsBuffer = std::make_shared<Buffer>(physicalDevice, device);
+        drawsBuffer->setSize(sizeof(BindlessDraw) * std::max(draws.size(), size_t(1)));
+        drawsBuffer->setUsage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        drawsBuffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        drawsBuffer->create();
+
+        // Material data is static, the transforms are written every frame.
+        if (draws.size())
+            drawsBuffer->copyHostVisible(
+                draws.data(),
+                sizeof(BindlessDraw) * draws.size());
+
+        frameUniformBuffer = std::make_shared<Buffer>(physicalDevice, device);
+        frameUniformBuffer->setSize(sizeof(BindlessFrame));
+        frameUniformBuffer->setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        frameUniformBuffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        frameUniformBuffer->create();
+
+        lightUniformBuffer = std::make_shared<Buffer>(physicalDevice, device);
+        lightUniformBuffer->setSize(sizeof(Light));
+        lightUniformBuffer->setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        lightUniformBuffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        lightUniformBuffer->create();
+
+        for (uint32_t frame = 0; frame < frameCount; ++frame)
+        {
+            std::shared_ptr<DescriptorSets> sets = descriptorSets[frame];
+            sets->writeStorageBuffer(
+                0, drawsBuffer->handle(),
+                0, drawsBuffer->size());
+
+            sets->writeUniformBuffer(
+                1, frameUniformBuffer->handle(),
+                0, frameUniformBuffer->size());
+
+            sets->writeUniformBuffer(
+                2, lightUniformBuffer->handle(),
+                0, lightUniformBuffer->size());
+
+            // -----------------------------------------------------------------
+            // Texture maps.
+
+            writeTextures(frame);
+            writeIblMaps(frame);
+
+            sets->writeImage(
+                    7,
+                    shadowMap->sampler,
+                    shadowMap->imageView,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
+
+    ~PbrBindless()
+    {
+        descriptorSets.clear();
+        descriptorPool.reset();
+
+        object_key::removeDescriptorSetLayout(descriptorSetLayout);
+        vkDestroyDescriptorSetLayout(
+            device,
+            descriptorSetLayout,
+            NULL);
+    }
+
+    // Returns the texture array index of the file, -1 if path is empty.
+    int32_t slot(const std::string& filePath, bool grayScale)
+    {
+        if (filePath.empty())
+            return -1;
+
+        auto it = slots.find(filePath);
+        if (it != slots.end())
+            return it->second;
+
+        const int32_t index = int32_t(slotPaths.size());
+        slots[filePath] = index;
+        slotPaths.push_back(filePath);
+        slotGrayScales.push_back(grayScale);
+        return index;
+    }
+
+    // Writes the IBL maps into descriptor set of the frame. This needs to
+    // be called when the IBL maps change.
+    void writeIblMaps(uint32_t frame)
+    {
+        descriptorSets[frame]->writeUniformBuffer(
+                4,
+                textureManager->irradiance->handle(),
+                0, textureManager->irradiance->size());
+
+        descriptorSets[frame]->writeImage(
+                5,
                 textureManager->prefiltered->sampler,
                 textureManager->prefiltered->imageView,
                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-        descriptorSets->writeImage(
-                11,
+        descriptorSets[frame]->writeImage(
+                6,
                 textureManager->brdfLut->sampler,
                 textureManager->brdfLut->imageView,
                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-        descriptorSets->writeImage(
-                12,
-                shadowMap->sampler,
-                shadowMap->imageView,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     }
 
-    // Model
-    std::shared_ptr<Model> model;
+    // Writes the material textures into texture array of the frame. This
+    // needs to be called when the texture residency changes.
+    void writeTextures(uint32_t frame)
+    {
+        if (slotPaths.empty())
+        {
+            std::shared_ptr<Texture2D> tex = textureManager->texture("", false);
+            descriptorSets[frame]->writeImage(
+                    3,
+                    tex->sampler,
+                    tex->imageView,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    0);
+            return;
+        }
 
-    // Mesh
-    std::shared_ptr<Mesh> mesh;
+        for (size_t i = 0; i < slotPaths.size(); ++i)
+        {
+            std::shared_ptr<Texture2D> tex =
+                textureManager->texture(slotPaths[i], slotGrayScales[i]);
+            descriptorSets[frame]->writeImage(
+                    3,
+                    tex->sampler,
+                    tex->imageView,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    uint32_t(i));
+        }
+    }
 
-    // Uniform buffers
-    std::shared_ptr<Buffer> matricesUniformBuffer;
-    std::shared_ptr<Buffer> lightUniformBuffer;
-    std::shared_ptr<Buffer> paramsUniformBuffer;
+    VkDevice device;
 
-    // Descriptor sets
-    std::shared_ptr<DescriptorSets> descriptorSets;
+    // Draws that share a mesh and material textures.
+    struct Batch
+    {
+        std::shared_ptr<Mesh> mesh;
+        uint32_t firstDraw = 0;
+        uint32_t drawCount = 0;
+    };
 
-    // Material parameters, used when map is not set.
-    PbrParams pbrParams;
+    // Models and the batches of models.
+    std::vector<std::shared_ptr<Model>> models;
+    std::vector<Batch> batches;
 
-    // Material maps.
-    std::shared_ptr<Texture2D> albedoMap;
-    std::shared_ptr<Texture2D> metallicMap;
-    std::shared_ptr<Texture2D> roughnessMap;
-    std::shared_ptr<Texture2D> aoMap;
+    // Textures
+    std::shared_ptr<TextureManager> textureManager;
+    std::map<std::string, int32_t> slots;
+    std::vector<std::string> slotPaths;
+    std::vector<bool> slotGrayScales;
+    uint32_t textureCount = 1;
+
+    // Texture array size specialization
+    VkSpecializationMapEntry specializationEntry;
+    VkSpecializationInfo specializationInfo;
+    int32_t specializationValue = 1;
+
+    // Per-draw data
+    std::vector<BindlessDraw> draws;
+
+    // Buffers
+    std::shared_ptr<Buffer> drawsBuffer;
+    std::shared_ptr<Buffer> frameUniformBuffer;
+    std::shared_ptr<Buffer> lightUniformBuffer;
 
-    // Extra maps for parallax and normal mapping.
-    std::shared_ptr<Texture2D> height;
-    std::shared_ptr<Texture2D> normal;
+    // Descriptors, a set per frame.
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    std::shared_ptr<DescriptorPool> descriptorPool;
+    std::vector<std::shared_ptr<DescriptorSets>> descriptorSets;
 };
 
 } // anonymous namespace
@@ -311,7 +712,9 @@ struct PbrRenderer::Impl
          const VkExtent2D& extent,
          const uint32_t queueFamilyIndex,
          const VkRenderPass& renderPass,
-         std::shared_ptr<TextureCube> environment,
+         std::shared_ptr<Buffer> irradiance,
+         std::shared_ptr<TextureCube> prefiltered,
+         std::shared_ptr<Texture2D> brdfLut,
          std::shared_ptr<MeshManager> meshManager)
         : physicalDevice(physicalDevice)
         , device(device)
@@ -319,31 +722,73 @@ struct PbrRenderer::Impl
         , renderPass(renderPass)
         , meshManager(meshManager)
     {
+        checkBindlessSupport();
         createCommandPool(device, queueFamilyIndex);
         createTextureManager(queueFamilyIndex);
-        createIblMaps(queueFamilyIndex, environment);
+        createFrameBuffers();
+        textureManager->irradiance  = irradiance;
+        textureManager->prefiltered = prefiltered;
+        textureManager->brdfLut     = brdfLut;
         createShaders();
-        createDescriptorSetLayout();
-        createPipeline();
+        createDescriptorSetLayouts();
     }
 
     ~Impl()
     {
         vshModule.reset();
         fshModule.reset();
+        bindlessVshModule.reset();
+        bindlessFshModule.reset();
         pipeline.reset();
+        variants.clear();
 
         models.clear();
+        materials.clear();
+        bindless.reset();
 
         commandPool.reset();
-        descriptorPool.reset();
+        frameDescriptorSets.clear();
+        frameDescriptorPool.reset();
+        materialDescriptorPool.reset();
 
+        object_key::removeDescriptorSetLayout(frameDescriptorSetLayout);
         vkDestroyDescriptorSetLayout(
             device,
-            descriptorSetLayout,
+            frameDescriptorSetLayout,
+            NULL);
+
+        object_key::removeDescriptorSetLayout(materialDescriptorSetLayout);
+        vkDestroyDescriptorSetLayout(
+            device,
+            materialDescriptorSetLayout,
             NULL);
     }
 
+    // Bindless path needs a dynamic indexing of sampled image arrays. The
+    // logical device is expected to enable the feature when supported.
+    void checkBindlessSupport()
+    {
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+        bindlessSupported =
+            features.shaderSampledImageArrayDynamicIndexing == VK_TRUE;
+    }
+
+    // Returns true if the texture array of given in size fits into device
+    // limits along with the generated maps.
+    bool bindlessFits(uint32_t textureCount) const
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        const VkPhysicalDeviceLimits& limits = properties.limits;
+        const uint32_t samplers = textureCount + 3;
+        return samplers <= limits.maxPerStageDescriptorSamplers      &&
+               samplers <= limits.maxPerStageDescriptorSampledImages &&
+               samplers <= limits.maxDescriptorSetSamplers           &&
+               samplers <= limits.maxDescriptorSetSampledImages;
+    }
+
     void createCommandPool(const VkDevice& device,
                            const uint32_t queueFamilyIndex)
     {
@@ -361,75 +806,116 @@ struct PbrRenderer::Impl
                 *commandPool);
     }
 
-    void createIblMaps(const uint32_t queueFamilyIndex,
-                       std::shared_ptr<TextureCube> environment)
+    // Creates the uniform buffers shared by the models.
+    void createFrameBuffers()
     {
-        IrradianceRenderer irradianceRenderer(
-            physicalDevice,
-            device,
-            queueFamilyIndex,
-            environment);
-        irradianceRenderer.render();
-
-        textureManager->irradiance  = irradianceRenderer.textureCube();
+        frameUniformBuffer = std::make_shared<Buffer>(physicalDevice, device);
+        frameUniformBuffer->setSize(sizeof(Frame));
+        frameUniformBuffer->setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        frameUniformBuffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        frameUniformBuffer->create();
 
-        IblPrefilterRenderer iblPrefilterRenderer(
-            physicalDevice,
-            device,
-            queueFamilyIndex,
-            environment);
-        iblPrefilterRenderer.render();
+        lightUniformBuffer = std::make_shared<Buffer>(physicalDevice, device);
+        lightUniformBuffer->setSize(sizeof(Light));
+        lightUniformBuffer->setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        lightUniformBuffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        lightUniformBuffer->create();
+    }
 
-        textureManager->prefiltered = iblPrefilterRenderer.textureCube();
+    // Creates the storage buffer of per-instance transforms and the indirect
+    // buffer of instanced draw commands.
+    void createDrawsBuffer(size_t drawCount, size_t commandCount)
+    {
+        instanceModels.resize(drawCount);
+        drawCommands.resize(commandCount);
 
-        IblBrdfLutRenderer iblBrdfRenderer(
-            physicalDevice,
-            device,
-            queueFamilyIndex);
-        iblBrdfRenderer.render();
+        drawsBuffer = std::make_shared<Buffer>(physicalDevice, device);
+        drawsBuffer->setSize(sizeof(Draw) * std::max(drawCount, size_t(1)));
+        drawsBuffer->setUsage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        drawsBuffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        drawsBuffer->create();
 
-        textureManager->brdfLut  = iblBrdfRenderer.texture();
+        drawCommandsBuffer = std::make_shared<Buffer>(physicalDevice, device);
+        drawCommandsBuffer->setSize(
+            sizeof(VkDrawIndexedIndirectCommand) * std::max(commandCount, size_t(1)));
+        drawCommandsBuffer->setUsage(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+        drawCommandsBuffer->setMemoryProperties(
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        drawCommandsBuffer->create();
     }
 
     void createShaders()
     {
-        vshModule = std::make_shared<ShaderModule>(device, "shaders/pbr.vert.spv");
-        vshModule->setStageName("main");
-        vshModule->setStage(VK_SHADER_STAGE_VERTEX_BIT);
-        if (!vshModule->create())
+        vshModule = shader_registry::module(
+            device, "shaders/pbr.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+        if (!vshModule)
             return;
 
-        fshModule = std::make_shared<ShaderModule>(device, "shaders/pbr.frag.spv");
-        fshModule->setStageName("main");
-        fshModule->setStage(VK_SHADER_STAGE_FRAGMENT_BIT);
-        if (!fshModule->create())
+        fshModule = shader_registry::module(
+            device, "shaders/pbr.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+        if (!fshModule)
             return;
+
+        if (!bindlessSupported)
+            return;
+
+        bindlessVshModule = shader_registry::module(
+            device,
+            "shaders/pbr_bindless.vert.spv",
+            VK_SHADER_STAGE_VERTEX_BIT);
+        if (!bindlessVshModule)
+            bindlessSupported = false;
+
+        bindlessFshModule = shader_registry::module(
+            device,
+            "shaders/pbr_bindless.frag.spv",
+            VK_SHADER_STAGE_FRAGMENT_BIT);
+        if (!bindlessFshModule)
+            bindlessSupported = false;
     }
 
-    void createDescriptorSetLayout()
+    // Per-frame set contains the camera, light, IBL maps, shadow map and
+    // per-draw transforms. Per-material set contains the parameters and
+    // the maps of a material.
+    void createDescriptorSetLayouts()
     {
-        if (descriptorSetLayout != VK_NULL_HANDLE)
-            vkDestroyDescriptorSetLayout(
-                device,
-                descriptorSetLayout,
-                NULL);
+        const VkShaderStageFlags vsh = VK_SHADER_STAGE_VERTEX_BIT;
+        const VkShaderStageFlags fsh = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-        uint32_t binding = 0;
-
-        std::vector<VkDescriptorSetLayoutBinding> layoutBindings =
+        frameDescriptorSetLayout = createDescriptorSetLayout(
         {
-            { binding++, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT,   NULL },
-            { binding++, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-            { binding++, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1, vsh | fsh, NULL }, // Frame
+            { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1, fsh,       NULL }, // Light
+            { 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1, fsh,       NULL }, // SH irradiance
+            { 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, fsh,       NULL }, // Prefiltered
+            { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, fsh,       NULL }, // BRDF LUT
+            { 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, fsh,       NULL }, // Shadow map
+            { 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1, vsh,       NULL }, // Draws
+        });
+
+        std::vector<VkDescriptorSetLayoutBinding> materialBindings =
+        {
+            { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, fsh, NULL }, // Params
         };
 
-        const uint32_t images = 12;
-        for (int i = 0; i < images; ++i)
-            layoutBindings.push_back(
-                { binding++, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                  1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL } );
+        // Material maps
+        for (uint32_t i = 1; i <= 6; ++i)
+            materialBindings.push_back(
+                { i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, fsh, NULL } );
 
+        materialDescriptorSetLayout = createDescriptorSetLayout(materialBindings);
+    }
 
+    VkDescriptorSetLayout createDescriptorSetLayout(
+        const std::vector<VkDescriptorSetLayoutBinding>& layoutBindings)
+    {
         VkDescriptorSetLayoutCreateInfo layoutInfo;
         layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         layoutInfo.pNext        = NULL;
@@ -437,12 +923,13 @@ struct PbrRenderer::Impl
         layoutInfo.bindingCount = uint32_t(layoutBindings.size());
         layoutInfo.pBindings    = layoutBindings.data();
 
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
         VkResult result =
             vkCreateDescriptorSetLayout(
                 device,
                 &layoutInfo,
                 NULL,
-                &descriptorSetLayout);
+                &layout);
 
         if (result != VK_SUCCESS)
         {
@@ -450,11 +937,119 @@ struct PbrRenderer::Impl
                       << ": descriptor set layout creation failed as "
                       << vk::stringify::resultDesc(result)
                       << std::endl;
+            return layout;
+        }
+
+        object_key::addDescriptorSetLayout(layout, layoutInfo);
+        return layout;
+    }
+
+    // Creates the per-frame descriptor sets. The draws buffer and the shadow
+    // map need to exist.
+    void createFrameDescriptorSet()
+    {
+        frameDescriptorPool = std::make_shared<DescriptorPool>(device);
+        frameDescriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         3 * frameCount);
+        frameDescriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 * frameCount);
+        frameDescriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1 * frameCount);
+        frameDescriptorPool->setMaxCount(frameCount);
+        frameDescriptorPool->create();
+
+        frameDescriptorSets.resize(frameCount);
+        for (uint32_t frame = 0; frame < frameCount; ++frame)
+        {
+            std::shared_ptr<DescriptorSets> sets =
+                std::make_shared<DescriptorSets>(device, frameDescriptorPool->handle());
+            sets->setLayout(frameDescriptorSetLayout);
+            sets->create();
+            frameDescriptorSets[frame] = sets;
+
+            sets->writeUniformBuffer(
+                0, frameUniformBuffer->handle(),
+                0, frameUniformBuffer->size());
+
+            sets->writeUniformBuffer(
+                1, lightUniformBuffer->handle(),
+                0, lightUniformBuffer->size());
+
+            writeIblMaps(frame);
+
+            sets->writeImage(
+                    5,
+                    shadowMap->sampler,
+                    shadowMap->imageView,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            sets->writeStorageBuffer(
+                6, drawsBuffer->handle(),
+                0, drawsBuffer->size());
+        }
+    }
+
+    // Writes the IBL maps into the per-frame descriptor set of the frame.
+    // This needs to be called when the IBL maps change.
+    void writeIblMaps(uint32_t frame)
+    {
+        frameDescriptorSets[frame]->writeUniformBuffer(
+                2,
+                textureManager->irradiance->handle(),
+                0, textureManager->irradiance->size());
+
+        frameDescriptorSets[frame]->writeImage(
+                3,
+                textureManager->prefiltered->sampler,
+                textureManager->prefiltered->imageView,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        frameDescriptorSets[frame]->writeImage(
+                4,
+                textureManager->brdfLut->sampler,
+                textureManager->brdfLut->imageView,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    // Sorts the instanced draws by the pipeline variant, the material and
+    // the mesh.
+    void buildDrawList()
+    {
+        std::map<std::shared_ptr<PbrMaterial>, uint32_t> materialIndices;
+        std::map<std::shared_ptr<Mesh>, uint32_t> meshIndices;
+
+        drawList.clear();
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            std::shared_ptr<PbrInstances> m = instances[i];
+            const uint32_t material =
+                materialIndices.insert({ m->material, uint32_t(materialIndices.size()) }).first->second;
+            const uint32_t mesh =
+                meshIndices.insert({ m->mesh, uint32_t(meshIndices.size()) }).first->second;
+
+            drawList.add(DrawList::key(m->material->features, material, mesh), uint32_t(i));
+        }
+        drawList.sort();
+    }
+
+    // Creates the pipelines of the models, the bindless pipeline or a
+    // pipeline variant per material features.
+    void createPipelines()
+    {
+        // Pipelines are shared, released pipelines are destroyed by the
+        // last user.
+        pipeline.reset();
+        variants.clear();
+
+        if (bindless)
+        {
+            pipeline = createPipeline(0);
             return;
         }
+
+        for (std::shared_ptr<PbrInstances> m : instances)
+            if (variants.find(m->material->features) == variants.end())
+                variants[m->material->features] = createPipeline(m->material->features);
     }
 
-    void createPipeline()
+    std::shared_ptr<Pipeline> createPipeline(const uint32_t features)
     {
         std::vector<VkVertexInputAttributeDescription> vertexAttributes =
         {
@@ -471,7 +1066,11 @@ struct PbrRenderer::Impl
         vertexBindingDescription.stride    = 14 * sizeof(float);
 
         std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
-        descriptorSetLayouts.push_back(descriptorSetLayout);
+        if (bindless)
+            descriptorSetLayouts.push_back(bindless->descriptorSetLayout);
+        else
+            descriptorSetLayouts = { frameDescriptorSetLayout,
+                                     materialDescriptorSetLayout };
 
         VkPipelineColorBlendAttachmentState colorBlend = {};
         colorBlend.blendEnable    = VK_FALSE;
@@ -480,15 +1079,40 @@ struct PbrRenderer::Impl
         float blendConstants[4] = { 0, 0, 0, 0 };
         VkExtent2D extent2d = { extent.width, extent.height };
 
-        if (pipeline)
+        // Material features are boolean specialization constants.
+        VkBool32 featureValues[FEATURE_COUNT];
+        VkSpecializationMapEntry featureEntries[FEATURE_COUNT];
+        for (uint32_t i = 0; i < FEATURE_COUNT; ++i)
         {
-            pipeline->destroy();
-            pipeline.reset();
+            featureValues[i] = (features & (1u << i)) ? VK_TRUE : VK_FALSE;
+            featureEntries[i].constantID = i;
+            featureEntries[i].offset     = i * sizeof(VkBool32);
+            featureEntries[i].size       = sizeof(VkBool32);
         }
 
-        pipeline = std::make_shared<Pipeline>(device);
-        pipeline->addShaderStage(vshModule->createInfo());
-        pipeline->addShaderStage(fshModule->createInfo());
+        VkSpecializationInfo featureInfo;
+        featureInfo.mapEntryCount = FEATURE_COUNT;
+        featureInfo.pMapEntries   = featureEntries;
+        featureInfo.dataSize      = sizeof(featureValues);
+        featureInfo.pData         = featureValues;
+
+        std::shared_ptr<Pipeline> pipeline = std::make_shared<Pipeline>(device);
+        if (bindless)
+        {
+            VkPipelineShaderStageCreateInfo fshStage = bindlessFshModule->createInfo();
+            fshStage.pSpecializationInfo = &bindless->specializationInfo;
+
+            pipeline->addShaderStage(bindlessVshModule->createInfo());
+            pipeline->addShaderStage(fshStage);
+        }
+        else
+        {
+            VkPipelineShaderStageCreateInfo fshStage = fshModule->createInfo();
+            fshStage.pSpecializationInfo = &featureInfo;
+
+            pipeline->addShaderStage(vshModule->createInfo());
+            pipeline->addShaderStage(fshStage);
+        }
         pipeline->setVertexInputState(
             { vertexBindingDescription },
               vertexAttributes );
@@ -508,11 +1132,15 @@ struct PbrRenderer::Impl
                 { colorBlend },
                 blendConstants);
 
-        const std::vector<VkPushConstantRange> pushConstantRanges;
+        // Per-model path passes the draw index as a push constant.
+        std::vector<VkPushConstantRange> pushConstantRanges;
+        if (!bindless)
+            pushConstantRanges.push_back(
+                { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t) });
         pipeline->setPipelineLayout(descriptorSetLayouts, pushConstantRanges);
         pipeline->setDynamicState( { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR } );
         pipeline->setRenderPass(renderPass);
-        pipeline->create();
+        return pipeline_registry::pipeline(pipeline);
     }
 
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
@@ -522,21 +1150,73 @@ struct PbrRenderer::Impl
 
     std::shared_ptr<ShaderModule> vshModule;
     std::shared_ptr<ShaderModule> fshModule;
+    std::shared_ptr<ShaderModule> bindlessVshModule;
+    std::shared_ptr<ShaderModule> bindlessFshModule;
 
     std::shared_ptr<CommandPool> commandPool;
 
     std::shared_ptr<TextureManager> textureManager;
 
-    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
-    std::shared_ptr<DescriptorPool> descriptorPool;
+    // Frames in flight. The descriptor sets are per frame so that the
+    // descriptors of a frame can be rewritten while the other frames are
+    // in use by the device. Frames of outdated texture descriptors are
+    // rewritten when the frame is recorded next.
+    uint32_t frameCount = 1;
+    std::vector<bool> outdatedFrames = std::vector<bool>(1, false);
 
+    // Per-frame descriptors
+    VkDescriptorSetLayout frameDescriptorSetLayout = VK_NULL_HANDLE;
+    std::shared_ptr<DescriptorPool> frameDescriptorPool;
+    std::vector<std::shared_ptr<DescriptorSets>> frameDescriptorSets;
+
+    // Per-material descriptors
+    VkDescriptorSetLayout materialDescriptorSetLayout = VK_NULL_HANDLE;
+    std::shared_ptr<DescriptorPool> materialDescriptorPool;
+
+    // Pipeline of the bindless path.
     std::shared_ptr<Pipeline> pipeline;
+    // Pipeline variants of the models by the material features.
+    std::map<uint32_t, std::shared_ptr<Pipeline>> variants;
 
     std::shared_ptr<Scene> scene;
-    std::vector<std::shared_ptr<PbrModel>> models;
+    std::vector<std::shared_ptr<PbrInstances>> instances;
+    std::map<std::shared_ptr<Material>, std::shared_ptr<PbrMaterial>> materials;
     std::shared_ptr<MeshManager> meshManager;
 
     std::shared_ptr<Texture2D> shadowMap;
+
+    // Buffers shared by the models of the per-model path.
+    std::shared_ptr<Buffer> frameUniformBuffer;
+    std::shared_ptr<Buffer> lightUniformBuffer;
+    std::shared_ptr<Buffer> drawsBuffer;
+
+    // Scene models of the draws buffer, the transforms of the visible
+    // instances are written from the transform store of the scene.
+    std::vector<uint32_t> instanceModels;
+
+    // Instanced draw commands, the instance count is the count of visible
+    // instances. The command buffers are recorded once so the visibility
+    // is updated into the indirect buffer every frame.
+    std::shared_ptr<Buffer> drawCommandsBuffer;
+    std::vector<VkDrawIndexedIndirectCommand> drawCommands;
+
+    // Draw indices of the scene models, -1 if the model is not a PBR model,
+    // the scene models of the draws and the instances of the draws of the
+    // per-model path. Models are culled with the spatial index of the scene.
+    std::vector<int32_t> drawIndices;
+    std::vector<uint32_t> drawModels;
+    std::vector<uint32_t> drawInstances;
+    std::vector<uint32_t> visibleModels;
+
+    // Instanced draws in the order of recording and the bind counts of the
+    // recorded commands.
+    DrawList drawList;
+    PbrRenderer::BindCounts bindCounts;
+
+    // Bindless path, null if the models are rendered with a descriptor
+    // set per model.
+    bool bindlessSupported = false;
+    std::shared_ptr<PbrBindless> bindless;
 };
 
 /* -------------------------------------------------------------------------- */
@@ -546,14 +1226,18 @@ PbrRenderer::PbrRenderer(const VkPhysicalDevice& physicalDevice,
                          const uint32_t queueFamilyIndex,
                          const VkExtent2D& extent,
                          const VkRenderPass& renderPass,
-                         std::shared_ptr<TextureCube> environment,
+                         std::shared_ptr<Buffer> irradiance,
+                         std::shared_ptr<TextureCube> prefiltered,
+                         std::shared_ptr<Texture2D> brdfLut,
                          std::shared_ptr<MeshManager> meshManager)
     : impl(std::make_shared<Impl>(physicalDevice,
                                   device,
                                   extent,
                                   queueFamilyIndex,
                                   renderPass,
-                                  environment,
+                                  irradiance,
+                                  prefiltered,
+                                  brdfLut,
                                   meshManager))
 {}
 
@@ -564,38 +1248,156 @@ void PbrRenderer::resized(const VkExtent2D& extent,
 {
     impl->extent     = extent;
     impl->renderPass = renderPass;
-    impl->createPipeline();
+    impl->createPipelines();
 }
 
 /* -------------------------------------------------------------------------- */
 
 void PbrRenderer::setScene(std::shared_ptr<Scene> scene)
 {
+    // Models of the same mesh and material textures are next to each other
+    // so that they can be drawn instanced.
+    typedef std::pair<std::shared_ptr<Mesh>, std::vector<std::string>> BatchKey;
+    std::map<BatchKey, size_t> batchIndices;
+    std::vector<std::vector<size_t>> batchModels;
+    for (size_t i = 0; i < scene->models.size(); ++i)
+    {
+        std::shared_ptr<Model> m = scene->models[i];
+        if (m->material->type != Material::Type::Pbr)
+            continue;
+
+        const Material::Pbr& pbr = m->material->pbr;
+        const BatchKey key(impl->meshManager->mesh(m->mesh),
+                           { pbr.ambientOcclusionMap,
+                             pbr.baseColorMap,
+                             pbr.heightMap,
+                             pbr.metallicMap,
+                             pbr.normalMap,
+                             pbr.roughnessMap });
+
+        auto it = batchIndices.insert({ key, batchModels.size() }).first;
+        if (it->second == batchModels.size())
+            batchModels.push_back(std::vector<size_t>());
+        batchModels[it->second].push_back(i);
+    }
+
     std::vector<std::shared_ptr<Model>> pbrModels;
-    for (std::shared_ptr<Model> m :scene->models)
-        if (m->material->type == Material::Type::Pbr)
-            pbrModels.push_back(m);
-
-    uint32_t uniformBufferCount = 3 * uint32_t(pbrModels.size());
-    uint32_t imageSamplerCount  = 12 * uint32_t(pbrModels.size());
-    impl->descriptorPool = std::make_shared<DescriptorPool>(impl->device);
-    impl->descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,          uniformBufferCount);
-    impl->descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  imageSamplerCount);
-    impl->descriptorPool->setMaxCount(uniformBufferCount + imageSamplerCount);
-    impl->descriptorPool->create();
+    impl->drawIndices.assign(scene->models.size(), -1);
+    impl->drawModels.clear();
+    for (const std::vector<size_t>& models : batchModels)
+    {
+        for (size_t i : models)
+        {
+            impl->drawIndices[i] = int32_t(pbrModels.size());
+            impl->drawModels.push_back(uint32_t(i));
+            pbrModels.push_back(scene->models[i]);
+        }
+    }
 
     impl->scene = scene;
+
+    // Load the textures before the descriptor sets are written as the
+    // residency manager might reduce already loaded textures.
     for (std::shared_ptr<Model> m :pbrModels)
-        impl->models.push_back(
-            std::make_shared<PbrModel>(
+    {
+        const Material::Pbr& pbr = m->material->pbr;
+        impl->textureManager->add(pbr.ambientOcclusionMap);
+        impl->textureManager->add(pbr.baseColorMap);
+        impl->textureManager->add(pbr.heightMap);
+        impl->textureManager->add(pbr.metallicMap);
+        impl->textureManager->add(pbr.normalMap);
+        impl->textureManager->add(pbr.roughnessMap);
+    }
+
+    // Use the bindless path if all the material textures fit into a
+    // single texture array.
+    const uint32_t textureCount =
+        uint32_t(materialTexturePaths(pbrModels).size());
+    if (impl->bindlessSupported && impl->bindlessFits(textureCount))
+    {
+        impl->bindless = std::make_shared<PbrBindless>(
+            impl->physicalDevice,
+            impl->device,
+            impl->frameCount,
+            pbrModels,
+            impl->textureManager,
+            impl->meshManager,
+            impl->shadowMap);
+        impl->createPipelines();
+
+        updateUniformBuffers();
+        return;
+    }
+
+    // Models of the same material share the material descriptor set.
+    std::vector<std::shared_ptr<Material>> pbrMaterials;
+    for (std::shared_ptr<Model> m : pbrModels)
+        if (impl->materials.insert({ m->material, nullptr }).second)
+            pbrMaterials.push_back(m->material);
+
+    const uint32_t setCount     = uint32_t(pbrMaterials.size()) * impl->frameCount;
+    uint32_t uniformBufferCount = 1 * setCount;
+    uint32_t imageSamplerCount  = 6 * setCount;
+    impl->materialDescriptorPool = std::make_shared<DescriptorPool>(impl->device);
+    impl->materialDescriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,          uniformBufferCount);
+    impl->materialDescriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  imageSamplerCount);
+    impl->materialDescriptorPool->setMaxCount(setCount);
+    impl->materialDescriptorPool->create();
+
+    for (std::shared_ptr<Material> m : pbrMaterials)
+        impl->materials[m] =
+            std::make_shared<PbrMaterial>(
                 impl->physicalDevice,
                 impl->device,
-                impl->descriptorSetLayout,
-                impl->descriptorPool->handle(),
+                impl->materialDescriptorSetLayout,
+                impl->materialDescriptorPool->handle(),
+                impl->frameCount,
                 m,
-                impl->textureManager,
-                impl->meshManager,
-                impl->shadowMap));
+                impl->textureManager);
+
+    // Models of the same mesh and material are instances of a single draw.
+    // The material set is bound per draw so models of different materials
+    // cannot share a draw.
+    typedef std::pair<PbrMaterial*, Mesh*> InstancesKey;
+    std::unordered_map<InstancesKey, uint32_t, PointerPairHash> instanceIndices;
+    instanceIndices.reserve(pbrModels.size());
+
+    impl->drawInstances.resize(pbrModels.size());
+    for (size_t i = 0; i < pbrModels.size(); ++i)
+    {
+        std::shared_ptr<Model> m = pbrModels[i];
+        std::shared_ptr<PbrMaterial> material = impl->materials[m->material];
+        std::shared_ptr<Mesh> mesh = impl->meshManager->mesh(m->mesh);
+
+        const InstancesKey key(material.get(), mesh.get());
+        auto it = instanceIndices.insert({ key, uint32_t(impl->instances.size()) }).first;
+        if (it->second == impl->instances.size())
+            impl->instances.push_back(std::make_shared<PbrInstances>(material, mesh));
+
+        impl->instances[it->second]->models.push_back(m);
+        impl->drawInstances[i] = it->second;
+    }
+
+    impl->createDrawsBuffer(pbrModels.size(), impl->instances.size());
+    impl->createFrameDescriptorSet();
+
+    uint32_t firstDraw = 0;
+    for (size_t i = 0; i < impl->instances.size(); ++i)
+    {
+        std::shared_ptr<PbrInstances> instances = impl->instances[i];
+        instances->firstDraw   = firstDraw;
+        instances->drawCommand = uint32_t(i);
+        firstDraw += uint32_t(instances->models.size());
+
+        VkDrawIndexedIndirectCommand& cmd = impl->drawCommands[i];
+        cmd.indexCount    = instances->mesh->indexCount();
+        cmd.instanceCount = uint32_t(instances->models.size());
+        cmd.firstIndex    = 0;
+        cmd.vertexOffset  = 0;
+        cmd.firstInstance = 0;
+    }
+    impl->buildDrawList();
+    impl->createPipelines();
 
    updateUniformBuffers();
 }
@@ -614,67 +1416,360 @@ void PbrRenderer::setShadowMap(std::shared_ptr<Texture2D> shadowMap)
 
 /* -------------------------------------------------------------------------- */
 
-void PbrRenderer::recordCommands(const VkCommandBuffer& commandBuffer)
+void PbrRenderer::setFrameCount(uint32_t frameCount)
+{
+    impl->frameCount = std::max(frameCount, 1u);
+    impl->outdatedFrames.assign(impl->frameCount, false);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void PbrRenderer::setIblMaps(std::shared_ptr<Buffer> irradiance,
+                             std::shared_ptr<TextureCube> prefiltered,
+                             std::shared_ptr<Texture2D> brdfLut)
+{
+    impl->textureManager->irradiance  = irradiance;
+    impl->textureManager->prefiltered = prefiltered;
+    impl->textureManager->brdfLut     = brdfLut;
+
+    impl->outdatedFrames.assign(impl->frameCount, true);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void PbrRenderer::setTextureMemoryBudget(VkDeviceSize budget)
+{
+    impl->textureManager->residency->setBudget(budget);
+}
+
+void PbrRenderer::setTextureUploadBudget(VkDeviceSize budget)
+{
+    impl->textureManager->residency->setUploadBudget(budget);
+}
+
+/* -------------------------------------------------------------------------- */
+
+bool PbrRenderer::updateTextureResidency()
+{
+    // Textures replaced by the previous update might be in use until the
+    // descriptors of all the frames have been rewritten.
+    if (isUpdatingDescriptors())
+        return false;
+
+    std::shared_ptr<TextureResidencyManager> residency =
+        impl->textureManager->residency;
+
+    // Only the textures of the models that passed the culling of the last
+    // uniform buffer update are used, textures of culled models age and
+    // are evicted first.
+    residency->beginFrame();
+    for (uint32_t m : impl->visibleModels)
+    {
+        if (impl->drawIndices[m] < 0)
+            continue;
+
+        const Material::Pbr& pbr = impl->scene->models[m]->material->pbr;
+        for (const std::string& filePath : { pbr.ambientOcclusionMap,
+                                             pbr.baseColorMap,
+                                             pbr.heightMap,
+                                             pbr.metallicMap,
+                                             pbr.normalMap,
+                                             pbr.roughnessMap })
+        {
+            if (filePath.size())
+                residency->use(filePath);
+        }
+    }
+
+    if (!residency->update())
+        return false;
+
+    impl->outdatedFrames.assign(impl->frameCount, true);
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+
+bool PbrRenderer::isOutdated(uint32_t frame) const
+{ return impl->outdatedFrames[frame]; }
+
+bool PbrRenderer::isUpdatingDescriptors() const
+{
+    const std::vector<bool>& outdated = impl->outdatedFrames;
+    return std::find(outdated.begin(), outdated.end(), true) != outdated.end();
+}
+
+void PbrRenderer::updateDescriptors(uint32_t frame)
+{
+    if (!impl->outdatedFrames[frame])
+        return;
+
+    if (impl->bindless)
+    {
+        impl->bindless->writeTextures(frame);
+        impl->bindless->writeIblMaps(frame);
+    }
+    if (frame < impl->frameDescriptorSets.size())
+        impl->writeIblMaps(frame);
+    for (auto& material : impl->materials)
+        material.second->writeTextures(frame);
+
+    impl->outdatedFrames[frame] = false;
+}
+
+/* -------------------------------------------------------------------------- */
+
+void PbrRenderer::recordCommands(const VkCommandBuffer& commandBuffer,
+                                 uint32_t frame)
 {
-    for (std::shared_ptr<PbrModel> model : impl->models)
+    PbrRenderer::BindCounts& counts = impl->bindCounts;
+    counts = PbrRenderer::BindCounts();
+
+    if (impl->bindless)
     {
-        VkDescriptorSet descriptorHandle = model->descriptorSets->handle();
+        // Descriptor set and pipeline are bound once, the draw index is
+        // passed to shaders as the instance index.
+        VkDescriptorSet descriptorHandle = impl->bindless->descriptorSets[frame]->handle();
         VkPipelineLayout pipelineLayout  = impl->pipeline->pipelineLayoutHandle();
         vkCmdBindDescriptorSets(
             commandBuffer,
             VK_PIPELINE_BIND_POINT_GRAPHICS,
             pipelineLayout, 0, 1,
             &descriptorHandle, 0, NULL);
+        counts.descriptorSets++;
 
         VkPipeline pipeline = impl->pipeline->handle();
         vkCmdBindPipeline(
             commandBuffer,
             VK_PIPELINE_BIND_POINT_GRAPHICS,
             pipeline);
+        counts.pipelines++;
+
+        // Batches are of unique meshes.
+        for (const PbrBindless::Batch& batch : impl->bindless->batches)
+        {
+            const VkBuffer vertexBuffer = batch.mesh->vertexBufferHandle();
+            const VkDeviceSize offsets[1] = { 0 };
+            vkCmdBindVertexBuffers(
+                commandBuffer, 0, 1,
+                &vertexBuffer,
+                offsets);
+            counts.vertexBuffers++;
+
+            const VkBuffer indexBuffer = batch.mesh->indexBufferHandle();
+            vkCmdBindIndexBuffer(
+                commandBuffer,
+                indexBuffer,
+                0, VK_INDEX_TYPE_UINT32);
+            counts.indexBuffers++;
+
+            vkCmdDrawIndexed(
+                commandBuffer,
+                batch.mesh->indexCount(),
+                batch.drawCount, 0, 0,
+                batch.firstDraw);
+            counts.draws++;
+        }
+        return;
+    }
+
+    if (impl->instances.empty())
+        return;
+
+    // Per-frame set is bound once, the pipeline variants have compatible
+    // layouts. Draws are in the order of the draw list so pipeline,
+    // material set and mesh buffers are bound only when they change.
+    VkDescriptorSet frameHandle = impl->frameDescriptorSets[frame]->handle();
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        impl->variants.begin()->second->pipelineLayoutHandle(), 0, 1,
+        &frameHandle, 0, NULL);
+    counts.descriptorSets++;
+
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    std::shared_ptr<PbrMaterial> boundMaterial;
+    std::shared_ptr<Mesh> boundMesh;
+    for (size_t i = 0; i < impl->drawList.size(); ++i)
+    {
+        std::shared_ptr<PbrInstances> instances = impl->instances[impl->drawList.draw(i)];
+        std::shared_ptr<Pipeline> variant = impl->variants[instances->material->features];
+        VkPipelineLayout pipelineLayout   = variant->pipelineLayoutHandle();
+
+        VkPipeline pipeline = variant->handle();
+        if (pipeline != boundPipeline)
+        {
+            vkCmdBindPipeline(
+                commandBuffer,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                pipeline);
+            boundPipeline = pipeline;
+            counts.pipelines++;
+        }
 
-        const VkBuffer vertexBuffer = model->mesh->vertexBufferHandle();
-        const VkDeviceSize offsets[1] = { 0 };
-        vkCmdBindVertexBuffers(
-            commandBuffer, 0, 1,
-            &vertexBuffer,
-            offsets);
+        if (instances->material != boundMaterial)
+        {
+            VkDescriptorSet materialHandle = instances->material->descriptorSets[frame]->handle();
+            vkCmdBindDescriptorSets(
+                commandBuffer,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                pipelineLayout, 1, 1,
+                &materialHandle, 0, NULL);
+            boundMaterial = instances->material;
+            counts.descriptorSets++;
+        }
 
-        const VkBuffer indexBuffer = model->mesh->indexBufferHandle();
-        vkCmdBindIndexBuffer(
+        if (instances->mesh != boundMesh)
+        {
+            const VkBuffer vertexBuffer = instances->mesh->vertexBufferHandle();
+            const VkDeviceSize offsets[1] = { 0 };
+            vkCmdBindVertexBuffers(
+                commandBuffer, 0, 1,
+                &vertexBuffer,
+                offsets);
+            counts.vertexBuffers++;
+
+            const VkBuffer indexBuffer = instances->mesh->indexBufferHandle();
+            vkCmdBindIndexBuffer(
+                commandBuffer,
+                indexBuffer,
+                0, VK_INDEX_TYPE_UINT32);
+            counts.indexBuffers++;
+
+            boundMesh = instances->mesh;
+        }
+
+        vkCmdPushConstants(
             commandBuffer,
-            indexBuffer,
-            0, VK_INDEX_TYPE_UINT32);
+            pipelineLayout,
+            VK_SHADER_STAGE_VERTEX_BIT,
+            0, sizeof(uint32_t),
+            &instances->firstDraw);
 
-        vkCmdDrawIndexed(
+        vkCmdDrawIndexedIndirect(
             commandBuffer,
-            model->mesh->indexCount(),
-            1, 0, 0, 1);
+            impl->drawCommandsBuffer->handle(),
+            sizeof(VkDrawIndexedIndirectCommand) * instances->drawCommand,
+            1, sizeof(VkDrawIndexedIndirectCommand));
+        counts.draws++;
     }
 }
 
 /* -------------------------------------------------------------------------- */
 
+PbrRenderer::BindCounts PbrRenderer::bindCounts() const
+{ return impl->bindCounts; }
+
+/* -------------------------------------------------------------------------- */
+
 void PbrRenderer::updateUniformBuffers()
 {
     const glm::vec4& vp = impl->scene->viewport;
     const glm::mat4 lightMatrix = impl->scene->light.orthoShadowMatrix(impl->scene->camera, vp, 1.0f);
     //std::cout << __FUNCTION__ << ": " << glm::to_string(lightMatrix) << std::endl;
 
-    for (std::shared_ptr<PbrModel> m : impl->models)
+    if (impl->bindless)
+    {
+        std::shared_ptr<PbrBindless> bindless = impl->bindless;
+
+        BindlessFrame frame;
+        frame.view       = impl->scene->camera.viewMatrix();
+        frame.projection = impl->scene->camera.projectionMatrix();
+        frame.light      = lightMatrix;
+        frame.cameraPos  = glm::vec4(impl->scene->camera.pos, 1.0);
+
+        std::vector<bool> visible(bindless->models.size(), false);
+        impl->visibleModels.clear();
+        impl->scene->bvh.query(Frustum(frame.projection * frame.view), impl->visibleModels);
+        for (uint32_t m : impl->visibleModels)
+            if (impl->drawIndices[m] >= 0)
+                visible[impl->drawIndices[m]] = true;
+
+        // Transforms are written from the transform store straight into the
+        // mapped draws, the material data of the draws is written once.
+        // Draws use the instance index so they cannot be indirect without
+        // the first instance feature, culled instances are collapsed
+        // instead.
+        if (bindless->draws.size())
+        {
+            unsigned char* draws = static_cast<unsigned char*>(bindless->drawsBuffer->map());
+            if (draws)
+            {
+                const TransformStore& transforms = impl->scene->transforms;
+                transforms.copy(
+                    impl->drawModels.data(), impl->drawModels.size(),
+                    draws + offsetof(BindlessDraw, model), sizeof(BindlessDraw));
+                transforms.normalMatrices(
+                    impl->drawModels.data(), impl->drawModels.size(),
+                    draws + offsetof(BindlessDraw, normal), sizeof(BindlessDraw));
+
+                const glm::mat4 collapsed(0.0f);
+                for (size_t i = 0; i < visible.size(); ++i)
+                    if (!visible[i])
+                        std::memcpy(draws + i * sizeof(BindlessDraw) + offsetof(BindlessDraw, model),
+                                    &collapsed, sizeof(glm::mat4));
+                bindless->drawsBuffer->unmap();
+            }
+        }
+        bindless->frameUniformBuffer->copyHostVisible(&frame, bindless->frameUniformBuffer->size());
+        bindless->lightUniformBuffer->copyHostVisible(&impl->scene->light, bindless->lightUniformBuffer->size());
+        return;
+    }
+
+    Frame frame;
+    frame.view       = impl->scene->camera.viewMatrix();
+    frame.projection = impl->scene->camera.projectionMatrix();
+    frame.light      = lightMatrix;
+    frame.cameraPos  = glm::vec4(impl->scene->camera.pos, 1.0);
+
+    // Models inside of the camera frustum are packed to the front of the
+    // instance range, the rest are not drawn.
+    for (std::shared_ptr<PbrInstances> instances : impl->instances)
+        instances->visibleCount = 0;
+
+    impl->visibleModels.clear();
+    impl->scene->bvh.query(Frustum(frame.projection * frame.view), impl->visibleModels);
+    for (uint32_t m : impl->visibleModels)
     {
-        Matrices matrices;
-        matrices.view       = impl->scene->camera.viewMatrix();
-        matrices.projection = impl->scene->camera.projectionMatrix();
-        matrices.model      = m->model->worldTransform;
-        matrices.normal     = glm::inverseTranspose(matrices.model);
-        matrices.light      = lightMatrix;
+        if (impl->drawIndices[m] < 0)
+            continue;
+
+        std::shared_ptr<PbrInstances> instances =
+            impl->instances[impl->drawInstances[impl->drawIndices[m]]];
+        impl->instanceModels[instances->firstDraw + instances->visibleCount++] = m;
+    }
 
-        m->pbrParams.cameraPos = glm::vec4(impl->scene->camera.pos, 1.0);
+    for (std::shared_ptr<PbrInstances> instances : impl->instances)
+        impl->drawCommands[instances->drawCommand].instanceCount = instances->visibleCount;
+
+    // Transforms of the visible instances are written from the transform
+    // store straight into the mapped draws.
+    if (impl->drawCommands.size())
+    {
+        unsigned char* draws = static_cast<unsigned char*>(impl->drawsBuffer->map());
+        if (draws)
+        {
+            const TransformStore& transforms = impl->scene->transforms;
+            for (std::shared_ptr<PbrInstances> instances : impl->instances)
+            {
+                const uint32_t* items = impl->instanceModels.data() + instances->firstDraw;
+                unsigned char* first  = draws + instances->firstDraw * sizeof(Draw);
+                transforms.copy(
+                    items, instances->visibleCount,
+                    first + offsetof(Draw, model), sizeof(Draw));
+                transforms.normalMatrices(
+                    items, instances->visibleCount,
+                    first + offsetof(Draw, normal), sizeof(Draw));
+            }
+            impl->drawsBuffer->unmap();
+        }
 
-        m->paramsUniformBuffer->copyHostVisible(&m->pbrParams, m->paramsUniformBuffer->size());
-        m->matricesUniformBuffer->copyHostVisible(&matrices, m->matricesUniformBuffer->size());
-        m->lightUniformBuffer->copyHostVisible(&impl->scene->light, m->lightUniformBuffer->size());
+        impl->drawCommandsBuffer->copyHostVisible(
+            impl->drawCommands.data(),
+            sizeof(VkDrawIndexedIndirectCommand) * impl->drawCommands.size());
     }
+    impl->frameUniformBuffer->copyHostVisible(&frame, impl->frameUniformBuffer->size());
+    impl->lightUniformBuffer->copyHostVisible(&impl->scene->light, impl->lightUniformBuffer->size());
 }
 
 } // namespace vk
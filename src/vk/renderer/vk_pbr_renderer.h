@@ -23,6 +23,7 @@ namespace vk
 
 /* -------------------------------------------------------------------------- */
 
+class Buffer;
 class MeshManager;
 struct Texture2D;
 struct TextureCube;
@@ -33,13 +34,27 @@ struct TextureCube;
 class PbrRenderer
 {
 public:
-    // Constructs the PBR renderer.
+    // Counts of the state binds and the draws of recorded commands.
+    struct BindCounts
+    {
+        uint32_t pipelines      = 0;
+        uint32_t descriptorSets = 0;
+        uint32_t vertexBuffers  = 0;
+        uint32_t indexBuffers   = 0;
+        uint32_t draws          = 0;
+    };
+
+    // Constructs the PBR renderer. The IBL maps are the SH coefficients of
+    // the diffuse irradiance, the prefiltered specular environment and the
+    // BRDF integration lookup table.
     PbrRenderer(const VkPhysicalDevice& physicalDevice,
                 const VkDevice& device,
                 const uint32_t queueFamilyIndex,
                 const VkExtent2D& extent,
                 const VkRenderPass& renderPass,
-                std::shared_ptr<TextureCube> environment,
+                std::shared_ptr<Buffer> irradiance,
+                std::shared_ptr<TextureCube> prefiltered,
+                std::shared_ptr<Texture2D> brdfLut,
                 std::shared_ptr<MeshManager> meshManager);
 
     // Viewport has been resized.
@@ -52,8 +67,48 @@ public:
     // Sets the shadow map
     void setShadowMap(std::shared_ptr<Texture2D> shadowMap);
 
-    // Records commands to render the added models with PBR renderer.
-    void recordCommands(const VkCommandBuffer& cmdBuf);
+    // Sets the count of frames, each frame has its own descriptor sets.
+    // The frame is the index of the swapchain image. This needs to be
+    // called before the scene is set, the default count is one.
+    void setFrameCount(uint32_t frameCount);
+
+    // Sets the IBL maps. The descriptors of all the frames are outdated,
+    // see updateDescriptors. The previous maps might be in use until
+    // isUpdatingDescriptors returns false.
+    void setIblMaps(std::shared_ptr<Buffer> irradiance,
+                    std::shared_ptr<TextureCube> prefiltered,
+                    std::shared_ptr<Texture2D> brdfLut);
+
+    // Sets the device memory budget of material textures in bytes.
+    void setTextureMemoryBudget(VkDeviceSize budget);
+    // Sets the per-frame mipmap upload budget of material textures in bytes.
+    void setTextureUploadBudget(VkDeviceSize budget);
+
+    // Starts a new frame of texture residency. Material textures are
+    // evicted or streamed back based on the budget, only the textures of
+    // the models visible in the last updateUniformBuffers are in use. This
+    // needs to be called after updateUniformBuffers and before the frame
+    // is submitted. Returns true if the residency changed, the descriptors
+    // of all the frames are outdated then. The residency is not updated
+    // until the descriptors of all the frames have been updated.
+    bool updateTextureResidency();
+
+    // Returns true if the descriptors of the frame are outdated.
+    bool isOutdated(uint32_t frame) const;
+    // Returns true until the outdated descriptors of all the frames have
+    // been updated.
+    bool isUpdatingDescriptors() const;
+    // Writes the outdated descriptors of the frame. The commands of the
+    // frame must not be in use by the device, the commands need to be
+    // recorded again before the frame is submitted.
+    void updateDescriptors(uint32_t frame);
+
+    // Records commands of the frame to render the added models with PBR
+    // renderer. The draws are sorted by the pipeline, the material and the
+    // mesh and the state is bound only when it changes.
+    void recordCommands(const VkCommandBuffer& cmdBuf, uint32_t frame);
+    // Returns the bind counts of the last recorded commands.
+    BindCounts bindCounts() const;
 
     // Updates uniform buffers. This needs to be called everytime camera
     // matrices in the scene changes.
@@ -19,12 +19,15 @@
 #include "../vk_descriptor_set.h"
 #include "../vk_image.h"
 #include "../vk_mesh.h"
+#include "../vk_object_key.h"
 #include "../vk_pipeline.h"
+#include "../vk_pipeline_registry.h"
 #include "../vk_queue.h"
 #include "../vk_image.h"
 #include "../vk_image_layout_transition.h"
 #include "../vk_render_pass.h"
 #include "../vk_shader_module.h"
+#include "../vk_shader_registry.h"
 #include "../vk_stringify.h"
 #include "../vk_texture.h"
 #include "../../common/mesh.h"
@@ -40,6 +43,7 @@ struct ShadowMapDepth::Impl
 {
     ~Impl()
     {
+        object_key::removeDescriptorSetLayout(descriptorSetLayout);
         vkDestroyDescriptorSetLayout(
             device,
             descriptorSetLayout,
@@ -132,16 +136,14 @@ ShadowMapDepth::ShadowMapDepth(
     const std::string vshFilePath = "shaders/shadow_map_depth.vert.spv";
     const std::string fshFilePath = "shaders/shadow_map_depth.frag.spv";
 
-    impl->vshModule = std::make_shared<ShaderModule>(impl->device, vshFilePath);
-    impl->vshModule->setStageName("main");
-    impl->vshModule->setStage(VK_SHADER_STAGE_VERTEX_BIT);
-    if (!impl->vshModule->create())
+    impl->vshModule = shader_registry::module(
+        impl->device, vshFilePath, VK_SHADER_STAGE_VERTEX_BIT);
+    if (!impl->vshModule)
         return;
 
-    impl->fshModule = std::make_shared<ShaderModule>(impl->device, fshFilePath);
-    impl->fshModule->setStageName("main");
-    impl->fshModule->setStage(VK_SHADER_STAGE_FRAGMENT_BIT);
-    if (!impl->fshModule->create())
+    impl->fshModule = shader_registry::module(
+        impl->device, fshFilePath, VK_SHADER_STAGE_FRAGMENT_BIT);
+    if (!impl->fshModule)
         return;
 
     // -------------------------------------------------------------------------
@@ -173,6 +175,8 @@ ShadowMapDepth::ShadowMapDepth(
         return;
     }
 
+    object_key::addDescriptorSetLayout(impl->descriptorSetLayout, layoutInfo);
+
     impl->descriptorPool = std::make_shared<DescriptorPool>(impl->device);
     impl->descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  1);
     impl->descriptorPool->setMaxCount(1);
@@ -221,7 +225,8 @@ ShadowMapDepth::ShadowMapDepth(
     impl->pipeline->setPipelineLayout(descriptorSetLayouts, pushConstantRanges);
     impl->pipeline->setDynamicState( { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR } );
     impl->pipeline->setRenderPass(renderPass);
-    if (!impl->pipeline->create())
+    impl->pipeline = pipeline_registry::pipeline(impl->pipeline);
+    if (!impl->pipeline)
         return;
 }
 
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "vk_shadow_map_renderer.h"
+#include <algorithm>
 #include <iostream>
 #include <glm/gtx/string_cast.hpp>
 #include "../vk_buffer.h"
@@ -13,19 +14,24 @@
 #include "../vk_descriptor_set.h"
 #include "../vk_image.h"
 #include "../vk_mesh.h"
+#include "../vk_object_key.h"
 #include "../vk_pipeline.h"
+#include "../vk_pipeline_registry.h"
 #include "../vk_queue.h"
 #include "../vk_image.h"
 #include "../vk_image_layout_transition.h"
 #include "../vk_render_pass.h"
 #include "../vk_shader_module.h"
+#include "../vk_shader_registry.h"
 #include "../vk_stringify.h"
 #include "../vk_texture.h"
 #include "../../common/camera.h"
+#include "../../common/frustum.h"
 #include "../../common/light.h"
 #include "../../common/mesh.h"
 #include "../../common/model.h"
 #include "../../common/scene.h"
+#include "../../common/transform_store.h"
 #include "vk_mesh_manager.h"
 
 namespace kuu
@@ -35,66 +41,30 @@ namespace vk
 namespace
 {
 
-/* -------------------------------------------------------------------------- */
-
-struct Matrices
-{
-    glm::mat4 model;
-    glm::mat4 light;
-};
-
 /* -------------------------------------------------------------------------- *
-   A model for shadow mapping.
+   Shadow casters that share a mesh. The casters are drawn with a single
+   instanced draw, the light space transforms of the casters inside of the
+   light frustum are in the transforms buffer from the first transform on.
  * -------------------------------------------------------------------------- */
-struct ShadowMapModel
+struct ShadowMapInstances
 {
-    ShadowMapModel(const VkPhysicalDevice& physicalDevice,
-             const VkDevice& device,
-             const VkDescriptorSetLayout& descriptorSetLayout,
-             const VkDescriptorPool& descriptorPool,
-             std::shared_ptr<Model> model,
-             std::shared_ptr<MeshManager> meshManager)
-        : model(model)
-    {
-        // ---------------------------------------------------------------------
-        // Mesh
+    ShadowMapInstances(std::shared_ptr<Mesh> mesh)
+        : mesh(mesh)
+    {}
 
-        mesh = meshManager->mesh(model->mesh);
-
-        // ---------------------------------------------------------------------
-        // Descriptor sets.
-
-        descriptorSets = std::make_shared<DescriptorSets>(device, descriptorPool);
-        descriptorSets->setLayout(descriptorSetLayout);
-        descriptorSets->create();
-
-        // ---------------------------------------------------------------------
-        // Uniform buffers
-
-        matricesUniformBuffer = std::make_shared<Buffer>(physicalDevice, device);
-        matricesUniformBuffer->setSize(sizeof(Matrices));
-        matricesUniformBuffer->setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-        matricesUniformBuffer->setMemoryProperties(
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        matricesUniformBuffer->create();
-
-        descriptorSets->writeUniformBuffer(
-            0, matricesUniformBuffer->handle(),
-            0, matricesUniformBuffer->size());
-    }
-
-    // Model
-    std::shared_ptr<Model> model;
+    // Models
+    std::vector<std::shared_ptr<Model>> models;
 
     // Mesh
     std::shared_ptr<Mesh> mesh;
 
-    // Uniform buffers
-    std::shared_ptr<Buffer> matricesUniformBuffer;
+    // Index of the first instance into the transforms buffer and the index
+    // of the draw command.
+    uint32_t firstTransform = 0;
+    uint32_t drawCommand    = 0;
 
-    // Descriptor sets
-    std::shared_ptr<DescriptorSets> descriptorSets;
+    // Count of the instances inside of the light frustum.
+    uint32_t visibleCount = 0;
 };
 
 } // anonymous namespace
@@ -135,10 +105,9 @@ struct ShadowMapRenderer::Impl
         const std::string vshFilePath = "shaders/shadow_map.vert.spv";
         const std::string fshFilePath = "shaders/shadow_map.frag.spv";
 
-        vshModule = std::make_shared<ShaderModule>(device, vshFilePath);
-        vshModule->setStageName("main");
-        vshModule->setStage(VK_SHADER_STAGE_VERTEX_BIT);
-        if (!vshModule->create())
+        vshModule = shader_registry::module(
+            device, vshFilePath, VK_SHADER_STAGE_VERTEX_BIT);
+        if (!vshModule)
             return;
 
 //        fshModule = std::make_shared<ShaderModule>(device, fshFilePath);
@@ -217,6 +186,8 @@ struct ShadowMapRenderer::Impl
             return;
         }
 
+        object_key::addRenderPass(renderPass, rpInfo);
+
         std::vector<VkImageView> attachments =
         { texture->imageView };
 
@@ -264,7 +235,7 @@ struct ShadowMapRenderer::Impl
 
         std::vector<VkDescriptorSetLayoutBinding> layoutBindings =
         {
-         { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+         { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
            1, VK_SHADER_STAGE_VERTEX_BIT,   NULL }
         };
 
@@ -290,6 +261,8 @@ struct ShadowMapRenderer::Impl
          return;
      }
 
+     object_key::addDescriptorSetLayout(descriptorSetLayout, layoutInfo);
+
         VkPipelineColorBlendAttachmentState colorBlend = {};
         colorBlend.blendEnable    = VK_FALSE;
         colorBlend.colorWriteMask = 0xf;
@@ -323,11 +296,16 @@ struct ShadowMapRenderer::Impl
 
         std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { descriptorSetLayout };
 
-        const std::vector<VkPushConstantRange> pushConstantRanges;
+        // Index of the first instance transform.
+        const std::vector<VkPushConstantRange> pushConstantRanges =
+        {
+            { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t) }
+        };
         pipeline->setPipelineLayout(descriptorSetLayouts, pushConstantRanges);
         pipeline->setDynamicState( { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR, VK_DYNAMIC_STATE_DEPTH_BIAS } );
         pipeline->setRenderPass(renderPass);
-        if (!pipeline->create())
+        pipeline = pipeline_registry::pipeline(pipeline);
+        if (!pipeline)
             return;
 
         //--------------------------------------------------------------------------
@@ -349,11 +327,13 @@ struct ShadowMapRenderer::Impl
             framebuffer,
             NULL);
 
+        object_key::removeRenderPass(renderPass);
         vkDestroyRenderPass(
             device,
             renderPass,
             NULL);
 
+        object_key::removeDescriptorSetLayout(descriptorSetLayout);
         vkDestroyDescriptorSetLayout(
             device,
             descriptorSetLayout,
@@ -433,34 +413,41 @@ struct ShadowMapRenderer::Impl
             VK_PIPELINE_BIND_POINT_GRAPHICS,
             pipeline->handle());
 
-        for (std::shared_ptr<ShadowMapModel> model : models)
+        VkDescriptorSet descriptorHandle = descriptorSets->handle();
+        VkPipelineLayout pipelineLayout  = pipeline->pipelineLayoutHandle();
+        vkCmdBindDescriptorSets(
+            cmdBuf,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            pipelineLayout, 0, 1,
+            &descriptorHandle, 0, NULL);
+
+        for (std::shared_ptr<ShadowMapInstances> instances : casters)
         {
-            VkDescriptorSet descriptorHandle = model->descriptorSets->handle();
-            VkPipelineLayout pipelineLayout  = pipeline->pipelineLayoutHandle();
-            vkCmdBindDescriptorSets(
+            vkCmdPushConstants(
                 cmdBuf,
-                VK_PIPELINE_BIND_POINT_GRAPHICS,
-                pipelineLayout, 0, 1,
-                &descriptorHandle, 0, NULL);
+                pipelineLayout,
+                VK_SHADER_STAGE_VERTEX_BIT,
+                0, sizeof(uint32_t),
+                &instances->firstTransform);
 
-            const VkBuffer vertexBuffer = model->mesh->vertexBufferHandle();
+            const VkBuffer vertexBuffer = instances->mesh->vertexBufferHandle();
             const VkDeviceSize offsets[1] = { 0 };
             vkCmdBindVertexBuffers(
                 cmdBuf, 0, 1,
                 &vertexBuffer,
                 offsets);
 
-            const VkBuffer indexBuffer = model->mesh->indexBufferHandle();
+            const VkBuffer indexBuffer = instances->mesh->indexBufferHandle();
             vkCmdBindIndexBuffer(
                 cmdBuf,
                 indexBuffer,
                 0, VK_INDEX_TYPE_UINT32);
 
-            uint32_t indexCount = uint32_t(model->mesh->indices().size());
-            vkCmdDrawIndexed(
+            vkCmdDrawIndexedIndirect(
                 cmdBuf,
-                indexCount,
-                1, 0, 0, 1);
+                drawCommandsBuffer->handle(),
+                sizeof(VkDrawIndexedIndirectCommand) * instances->drawCommand,
+                1, sizeof(VkDrawIndexedIndirectCommand));
         }
 
         vkCmdEndRenderPass(cmdBuf);
@@ -501,7 +488,22 @@ struct ShadowMapRenderer::Impl
     // Scene
     std::shared_ptr<Scene> scene;
     std::shared_ptr<MeshManager> meshManager;
-    std::vector<std::shared_ptr<ShadowMapModel>> models;
+    std::vector<std::shared_ptr<ShadowMapInstances>> casters;
+
+    // Light space instance transforms of the casters and the scene models
+    // of the transforms.
+    std::shared_ptr<Buffer> transformsBuffer;
+    std::vector<uint32_t> transformModels;
+
+    // Instanced draw commands, the instance count is the count of casters
+    // inside of the light frustum.
+    std::shared_ptr<Buffer> drawCommandsBuffer;
+    std::vector<VkDrawIndexedIndirectCommand> drawCommands;
+
+    // Instances of the scene models, -1 if the model is not a shadow
+    // caster. Casters are selected with the spatial index of the scene.
+    std::vector<int32_t> casterInstances;
+    std::vector<uint32_t> visibleCasters;
 
     // Internal objects
     std::shared_ptr<ShaderModule> vshModule;
@@ -513,6 +515,7 @@ struct ShadowMapRenderer::Impl
     VkCommandBuffer cmdBuf;
     VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
     std::shared_ptr<DescriptorPool> descriptorPool;
+    std::shared_ptr<DescriptorSets> descriptorSets;
 };
 
 /* -------------------------------------------------------------------------- */
@@ -529,27 +532,78 @@ ShadowMapRenderer::ShadowMapRenderer(
 
 void ShadowMapRenderer::setScene(std::shared_ptr<Scene> scene)
 {
-    std::vector<std::shared_ptr<Model>> pbrModels;
-    for (std::shared_ptr<Model> m : scene->models)
-        if (m->material->type == Material::Type::Pbr)
-            pbrModels.push_back(m);
+    // Casters of the same mesh are instances of a single draw.
+    impl->casterInstances.assign(scene->models.size(), -1);
+    for (size_t i = 0; i < scene->models.size(); ++i)
+    {
+        std::shared_ptr<Model> m = scene->models[i];
+        if (m->material->type != Material::Type::Pbr)
+            continue;
+
+        std::shared_ptr<Mesh> mesh = impl->meshManager->mesh(m->mesh);
+        auto it = std::find_if(
+            impl->casters.begin(),
+            impl->casters.end(),
+            [&](std::shared_ptr<ShadowMapInstances> instances)
+            { return instances->mesh == mesh; });
+
+        if (it == impl->casters.end())
+        {
+            impl->casters.push_back(std::make_shared<ShadowMapInstances>(mesh));
+            it = impl->casters.end() - 1;
+        }
+
+        (*it)->models.push_back(m);
+        impl->casterInstances[i] = int32_t(it - impl->casters.begin());
+    }
+
+    uint32_t transformCount = 0;
+    impl->drawCommands.resize(impl->casters.size());
+    for (size_t i = 0; i < impl->casters.size(); ++i)
+    {
+        std::shared_ptr<ShadowMapInstances> instances = impl->casters[i];
+        instances->firstTransform = transformCount;
+        instances->drawCommand    = uint32_t(i);
+        transformCount += uint32_t(instances->models.size());
+
+        VkDrawIndexedIndirectCommand& cmd = impl->drawCommands[i];
+        cmd.indexCount    = uint32_t(instances->mesh->indices().size());
+        cmd.instanceCount = uint32_t(instances->models.size());
+        cmd.firstIndex    = 0;
+        cmd.vertexOffset  = 0;
+        cmd.firstInstance = 0;
+    }
+    impl->transformModels.resize(transformCount);
+
+    impl->transformsBuffer = std::make_shared<Buffer>(impl->physicalDevice, impl->device);
+    impl->transformsBuffer->setSize(
+        sizeof(glm::mat4) * std::max(size_t(transformCount), size_t(1)));
+    impl->transformsBuffer->setUsage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    impl->transformsBuffer->setMemoryProperties(
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    impl->transformsBuffer->create();
+
+    impl->drawCommandsBuffer = std::make_shared<Buffer>(impl->physicalDevice, impl->device);
+    impl->drawCommandsBuffer->setSize(
+        sizeof(VkDrawIndexedIndirectCommand) * std::max(impl->casters.size(), size_t(1)));
+    impl->drawCommandsBuffer->setUsage(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    impl->drawCommandsBuffer->setMemoryProperties(
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    impl->drawCommandsBuffer->create();
 
-    uint32_t uniformBufferCount = 1 * uint32_t(pbrModels.size());
     impl->descriptorPool = std::make_shared<DescriptorPool>(impl->device);
-    impl->descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBufferCount);
-    impl->descriptorPool->setMaxCount(uniformBufferCount);
+    impl->descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1);
+    impl->descriptorPool->setMaxCount(1);
     impl->descriptorPool->create();
 
-    impl->scene = scene;
-    for (std::shared_ptr<Model> m : pbrModels)
-        impl->models.push_back(
-            std::make_shared<ShadowMapModel>(
-                impl->physicalDevice,
-                impl->device,
-                impl->descriptorSetLayout,
-                impl->descriptorPool->handle(),
-                m,
-                impl->meshManager));
+    impl->descriptorSets = std::make_shared<DescriptorSets>(impl->device, impl->descriptorPool->handle());
+    impl->descriptorSets->setLayout(impl->descriptorSetLayout);
+    impl->descriptorSets->create();
+    impl->descriptorSets->writeStorageBuffer(
+        0, impl->transformsBuffer->handle(),
+        0, impl->transformsBuffer->size());
 
     impl->scene = scene;
     impl->recordCommands();
@@ -563,13 +617,46 @@ void ShadowMapRenderer::render()
     const glm::mat4 lightMatrix = impl->scene->light.orthoShadowMatrix(impl->scene->camera, vp, 1.0f);
     //std::cout << __FUNCTION__ << ": " << glm::to_string(lightMatrix) << std::endl;
 
-    for (std::shared_ptr<ShadowMapModel> m : impl->models)
+    // Models outside of the light frustum cannot cast shadows into the map,
+    // the rest are packed to the front of the instance range.
+    for (std::shared_ptr<ShadowMapInstances> instances : impl->casters)
+        instances->visibleCount = 0;
+
+    impl->visibleCasters.clear();
+    impl->scene->bvh.query(Frustum(lightMatrix), impl->visibleCasters);
+    for (uint32_t m : impl->visibleCasters)
+    {
+        if (impl->casterInstances[m] < 0)
+            continue;
+
+        std::shared_ptr<ShadowMapInstances> instances =
+            impl->casters[impl->casterInstances[m]];
+        impl->transformModels[instances->firstTransform + instances->visibleCount++] = m;
+    }
+
+    for (std::shared_ptr<ShadowMapInstances> instances : impl->casters)
+        impl->drawCommands[instances->drawCommand].instanceCount = instances->visibleCount;
+
+    // Light matrix times the world transforms of the casters are written
+    // from the transform store straight into the mapped transforms.
+    if (impl->drawCommands.size())
     {
-        Matrices matrices;
-        matrices.model = m->model->worldTransform;
-        matrices.light = lightMatrix;
+        unsigned char* transforms = static_cast<unsigned char*>(impl->transformsBuffer->map());
+        if (transforms)
+        {
+            for (std::shared_ptr<ShadowMapInstances> instances : impl->casters)
+                impl->scene->transforms.multiply(
+                    lightMatrix,
+                    impl->transformModels.data() + instances->firstTransform,
+                    instances->visibleCount,
+                    transforms + instances->firstTransform * sizeof(glm::mat4),
+                    sizeof(glm::mat4));
+            impl->transformsBuffer->unmap();
+        }
 
-        m->matricesUniformBuffer->copyHostVisible(&matrices, m->matricesUniformBuffer->size());
+        impl->drawCommandsBuffer->copyHostVisible(
+            impl->drawCommands.data(),
+            sizeof(VkDrawIndexedIndirectCommand) * impl->drawCommands.size());
     }
 
     //--------------------------------------------------------------------------
@@ -29,11 +29,16 @@
 #include "../vk_command.h"
 #include "../vk_descriptor_set.h"
 #include "../vk_mesh.h"
+#include "../vk_object_key.h"
 #include "../vk_pipeline.h"
+#include "../vk_pipeline_registry.h"
 #include "../vk_queue.h"
 #include "../vk_shader_module.h"
+#include "../vk_shader_registry.h"
 #include "../vk_stringify.h"
 #include "../vk_texture.h"
+#include "vk_atmosphere_lut_renderer.h"
+#include "vk_bake_graph.h"
 
 namespace kuu
 {
@@ -62,14 +67,13 @@ struct SkyRenderer::Impl
          const VkDevice& device,
          const VkExtent2D& extent,
          const uint32_t queueFamilyIndex,
-         const VkRenderPass& renderPass,
-         std::shared_ptr<TextureCube> environment)
+         const VkRenderPass& renderPass)
         : physicalDevice(physicalDevice)
         , device(device)
         , extent(extent)
         , renderPass(renderPass)
-        , environment(environment)
     {
+        createLuts(queueFamilyIndex);
         createDescriptorPool();
         createDescriptorSetLayout();
         createDescriptorSets();
@@ -90,6 +94,7 @@ struct SkyRenderer::Impl
         matricesUniformBuffer.reset();
         descriptorPool.reset();
 
+        object_key::removeDescriptorSetLayout(descriptorSetLayout);
         vkDestroyDescriptorSetLayout(
             device,
             descriptorSetLayout,
@@ -198,10 +203,22 @@ struct SkyRenderer::Impl
         mesh->create();
     }
 
+    // Transmittance and multiple scattering LUTs are computed once, the
+    // sky-view LUT is computed every frame.
+    void createLuts(const uint32_t queueFamilyIndex)
+    {
+        luts = std::make_shared<AtmosphereLutRenderer>(physicalDevice, device);
+
+        BakeGraph graph(device, queueFamilyIndex);
+        graph.addPass([&](const VkCommandBuffer& cmdBuf)
+        { return luts->recordPrecomputed(cmdBuf); });
+        graph.execute();
+    }
+
     void createDescriptorPool()
     {
-        uint32_t uniformBufferCount = 1;
-        uint32_t imageSamplerCount  = 1;
+        uint32_t uniformBufferCount = 2;
+        uint32_t imageSamplerCount  = 2;
         descriptorPool = std::make_shared<DescriptorPool>(device);
         descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,          uniformBufferCount);
         descriptorPool->addTypeSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  imageSamplerCount);
@@ -218,15 +235,10 @@ struct SkyRenderer::Impl
 
     void createShaders()
     {
-        vshModule = std::make_shared<ShaderModule>(device, "shaders/skybox.vert.spv");
-        vshModule->setStageName("main");
-        vshModule->setStage(VK_SHADER_STAGE_VERTEX_BIT);
-        vshModule->create();
-
-        fshModule = std::make_shared<ShaderModule>(device, "shaders/skybox.frag.spv");
-        fshModule->setStageName("main");
-        fshModule->setStage(VK_SHADER_STAGE_FRAGMENT_BIT);
-        fshModule->create();
+        vshModule = shader_registry::module(
+            device, "shaders/skybox.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+        fshModule = shader_registry::module(
+            device, "shaders/skybox.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
     }
 
     void createUniformBuffers()
@@ -245,9 +257,19 @@ struct SkyRenderer::Impl
 
         descriptorSets->writeImage(
             1,
-            environment->sampler,
-            environment->imageView,
+            luts->skyView()->sampler,
+            luts->skyView()->imageView,
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        descriptorSets->writeImage(
+            2,
+            luts->transmittance()->sampler,
+            luts->transmittance()->imageView,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        descriptorSets->writeUniformBuffer(
+            3, luts->paramsBuffer()->handle(),
+            0, luts->paramsBuffer()->size());
     }
 
     void createDescriptorSetLayout()
@@ -255,7 +277,9 @@ struct SkyRenderer::Impl
         std::vector<VkDescriptorSetLayoutBinding> layoutBindings =
         {
             { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1, VK_SHADER_STAGE_VERTEX_BIT,   NULL },
-            { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL }
+            { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+            { 3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL }
         };
 
         VkDescriptorSetLayoutCreateInfo layoutInfo;
@@ -280,6 +304,8 @@ struct SkyRenderer::Impl
                       << std::endl;
             return;
         }
+
+        object_key::addDescriptorSetLayout(descriptorSetLayout, layoutInfo);
     }
 
     void createPipeline()
@@ -319,7 +345,7 @@ struct SkyRenderer::Impl
         pipeline->setPipelineLayout(descriptorSetLayouts, pushConstantRanges);
         pipeline->setDynamicState( { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR } );
         pipeline->setRenderPass(renderPass);
-        pipeline->create();
+        pipeline = pipeline_registry::pipeline(pipeline);
     }
 
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
@@ -339,7 +365,7 @@ struct SkyRenderer::Impl
 
     std::shared_ptr<Pipeline> pipeline;
 
-    std::shared_ptr<TextureCube> environment;
+    std::shared_ptr<AtmosphereLutRenderer> luts;
     std::shared_ptr<Scene> scene;
 };
 
@@ -349,14 +375,12 @@ SkyRenderer::SkyRenderer(const VkPhysicalDevice& physicalDevice,
                          const VkDevice& device,
                          const uint32_t queueFamilyIndex,
                          const VkExtent2D& extent,
-                         const VkRenderPass& renderPass,
-                         std::shared_ptr<TextureCube> environment)
+                         const VkRenderPass& renderPass)
     : impl(std::make_shared<Impl>(physicalDevice,
                                   device,
                                   extent,
                                   queueFamilyIndex,
-                                  renderPass,
-                                  environment))
+                                  renderPass))
 {}
 
 /* -------------------------------------------------------------------------- */
@@ -373,6 +397,13 @@ std::shared_ptr<Scene> SkyRenderer::scene() const
 
 /* -------------------------------------------------------------------------- */
 
+void SkyRenderer::recordPrepass(const VkCommandBuffer& commandBuffer)
+{
+    impl->luts->recordSkyView(commandBuffer);
+}
+
+/* -------------------------------------------------------------------------- */
+
 void SkyRenderer::resized(const VkExtent2D& extent,
                           const VkRenderPass& renderPass)
 {
@@ -429,6 +460,8 @@ void SkyRenderer::updateUniformBuffers()
     impl->matricesUniformBuffer->copyHostVisible(
         &matrices,
         impl->matricesUniformBuffer->size());
+
+    impl->luts->setLightDir(impl->scene->light.dir);
 }
 
 } // namespace vk
@@ -24,10 +24,9 @@ namespace vk
 
 /* -------------------------------------------------------------------------- */
 
-struct TextureCube;
-
 /* -------------------------------------------------------------------------- *
-   A skybox renderer.
+   A skybox renderer. The sky is rendered from a sky-view LUT of a physically
+   based atmosphere that is updated every frame.
  * -------------------------------------------------------------------------- */
 class SkyRenderer
 {
@@ -37,8 +36,7 @@ public:
                 const VkDevice& device,
                 const uint32_t queueFamilyIndex,
                 const VkExtent2D& extent,
-                const VkRenderPass& renderPass,
-                std::shared_ptr<TextureCube> environment);
+                const VkRenderPass& renderPass);
 
     // Sets and returns the scene to renderer.
     void setScene(std::shared_ptr<Scene> scene);
@@ -47,6 +45,10 @@ public:
     // Viewport has been resized.
     void resized(const VkExtent2D& extent, const VkRenderPass& renderPass);
 
+    // Records commands that need to be executed outside of the render pass
+    // before the sky is rendered.
+    void recordPrepass(const VkCommandBuffer& cmdBuf);
+
     // Records commands to render the added models with PBR renderer.
     void recordCommands(const VkCommandBuffer& cmdBuf);
 
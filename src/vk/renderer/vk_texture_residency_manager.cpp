@@ -0,0 +1,482 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::TextureResidencyManager class
+ * -------------------------------------------------------------------------- */
+
+#include "vk_texture_residency_manager.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+
+/* -------------------------------------------------------------------------- */
+
+#include "../vk_command.h"
+#include "../vk_queue.h"
+#include "../vk_texture.h"
+
+namespace kuu
+{
+namespace vk
+{
+namespace
+{
+
+/* -------------------------------------------------------------------------- *
+   Top mipmap levels are not dropped below this extent.
+ * -------------------------------------------------------------------------- */
+const uint32_t minDropExtent = 32;
+
+/* -------------------------------------------------------------------------- *
+   Bytes uploaded when a texture is loaded, the rest of the mipmap levels are
+   streamed in later frames.
+ * -------------------------------------------------------------------------- */
+const VkDeviceSize initialUploadSize = 64 * 1024;
+
+/* -------------------------------------------------------------------------- *
+   A residency state of file texture.
+ * -------------------------------------------------------------------------- */
+struct Entry
+{
+    std::string filePath;
+    // Texture, null if evicted
+    std::shared_ptr<Texture2D> texture;
+    // Texture that replaces the texture when its upload is retired.
+    std::shared_ptr<Texture2D> pending;
+    // Resident size and the size when all the levels are resident.
+    VkDeviceSize size = 0;
+    VkDeviceSize fullSize = 0;
+    // Count of dropped top mipmap levels.
+    uint32_t droppedLevels = 0;
+    // Frame when texture was last used.
+    uint64_t lastUsedFrame = 0;
+};
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- */
+
+struct TextureResidencyManager::Impl
+{
+    Impl(const VkPhysicalDevice& physicalDevice,
+         const VkDevice& device,
+         const uint32_t& queueFamilyIndex)
+        : physicalDevice(physicalDevice)
+        , device(device)
+        , queueFamilyIndex(queueFamilyIndex)
+    {
+        commandPool = std::make_shared<CommandPool>(device);
+        commandPool->setQueueFamilyIndex(queueFamilyIndex);
+        commandPool->create();
+
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(
+            physicalDevice,
+            &memoryProperties);
+
+        VkDeviceSize heapSize = 0;
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+        {
+            const VkMemoryHeap& heap = memoryProperties.memoryHeaps[i];
+            if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                heapSize = std::max(heapSize, heap.size);
+        }
+        budget = heapSize / 2;
+    }
+
+    ~Impl()
+    {
+        entries.clear();
+        retired.clear();
+        commandPool.reset();
+    }
+
+    // Keeps the texture alive until the next update as it might be in use
+    // by the device.
+    void retire(std::shared_ptr<Texture2D>& tex)
+    {
+        if (tex)
+            retired.push_back(tex);
+        tex.reset();
+    }
+
+    VkDeviceSize usage() const
+    {
+        VkDeviceSize out = 0;
+        for (auto& e : entries)
+            out += e.second.size;
+        return out;
+    }
+
+    VkDeviceSize staleUsage() const
+    {
+        VkDeviceSize out = 0;
+        for (auto& e : entries)
+            if (e.second.lastUsedFrame < frame)
+                out += e.second.size;
+        return out;
+    }
+
+    // Least recently used first, larger first if used in the same frame.
+    std::vector<Entry*> lruOrder()
+    {
+        std::vector<Entry*> out;
+        for (auto& e : entries)
+            if (e.second.texture || e.second.pending)
+                out.push_back(&e.second);
+
+        std::sort(out.begin(), out.end(), [](const Entry* a, const Entry* b)
+        {
+            if (a->lastUsedFrame != b->lastUsedFrame)
+                return a->lastUsedFrame < b->lastUsedFrame;
+            return a->size > b->size;
+        });
+        return out;
+    }
+
+    // Submits the upload of the texture, the texture replaces the resident
+    // texture when the upload is retired.
+    bool load(Entry& e)
+    {
+        Queue queue(device, queueFamilyIndex, 0);
+        queue.create();
+
+        std::shared_ptr<Texture2D> tex =
+            std::make_shared<Texture2D>(
+                physicalDevice,
+                device,
+                queue,
+                *commandPool,
+                e.filePath,
+                VK_FILTER_LINEAR,
+                VK_FILTER_LINEAR,
+                VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                initialUploadSize);
+
+        if (tex->sampler == VK_NULL_HANDLE)
+        {
+            std::cerr << __FUNCTION__
+                      << ": failed to stream texture "
+                      << e.filePath
+                      << std::endl;
+            return false;
+        }
+
+        retire(e.pending);
+        e.pending       = tex;
+        e.size          = tex->memorySize();
+        e.fullSize      = e.size;
+        e.droppedLevels = 0;
+        return true;
+    }
+
+    bool dropLevel(Entry& e)
+    {
+        const std::shared_ptr<Texture2D>& src = e.texture;
+        if (!src || e.pending || src->mipmapCount <= 1 || src->residentLevel > 0)
+            return false;
+        if (std::min(src->extent.width, src->extent.height) <= minDropExtent)
+            return false;
+
+        Queue queue(device, queueFamilyIndex, 0);
+        queue.create();
+
+        std::shared_ptr<Texture2D> tex =
+            std::make_shared<Texture2D>(
+                physicalDevice,
+                device,
+                queue,
+                *commandPool,
+                *src,
+                1,
+                VK_FILTER_LINEAR,
+                VK_FILTER_LINEAR,
+                VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                VK_SAMPLER_ADDRESS_MODE_REPEAT);
+
+        if (tex->sampler == VK_NULL_HANDLE || !tex->isUploading())
+            return false;
+
+        e.pending = tex;
+        e.size    = tex->memorySize();
+        e.droppedLevels++;
+        return true;
+    }
+
+    void evict(Entry& e)
+    {
+        retire(e.texture);
+        retire(e.pending);
+        e.size = 0;
+    }
+
+    // Retires the processed uploads, the uploaded textures replace the
+    // resident textures. Returns true if any of the resident textures
+    // changed.
+    bool retireUploads()
+    {
+        bool changed = false;
+        for (auto& e : entries)
+        {
+            Entry& entry = e.second;
+            if (entry.texture && entry.texture->retireUpload())
+                changed = true;
+
+            if (entry.pending && entry.pending->retireUpload())
+            {
+                retire(entry.texture);
+                entry.texture = entry.pending;
+                entry.pending.reset();
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // Reduces textures in LRU order until the usage fits into budget.
+    // Returns true if any of the resident textures were evicted.
+    bool fitBudget()
+    {
+        bool changed = false;
+        while (usage() > budget)
+        {
+            bool reduced = false;
+            for (Entry* e : lruOrder())
+            {
+                if (e->lastUsedFrame < frame)
+                {
+                    evict(*e);
+                    reduced = true;
+                    changed = true;
+                }
+                else
+                {
+                    reduced = dropLevel(*e);
+                }
+
+                if (reduced)
+                    break;
+            }
+
+            if (!reduced)
+                break;
+        }
+        return changed;
+    }
+
+    // Streams back the textures used in this frame that are not fully
+    // resident. Stale textures are evicted to make room.
+    bool restream()
+    {
+        std::vector<Entry*> candidates;
+        for (auto& e : entries)
+        {
+            Entry& entry = e.second;
+            if (entry.lastUsedFrame != frame || entry.fullSize == 0)
+                continue;
+            if (entry.pending || (entry.texture && entry.droppedLevels == 0))
+                continue;
+            candidates.push_back(&entry);
+        }
+
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Entry* a, const Entry* b)
+        { return a->fullSize < b->fullSize; });
+
+        bool changed = false;
+        for (Entry* e : candidates)
+        {
+            const VkDeviceSize required = usage() - e->size + e->fullSize;
+            if (required > budget + staleUsage())
+                continue;
+
+            for (Entry* stale : lruOrder())
+            {
+                if (usage() - e->size + e->fullSize <= budget)
+                    break;
+                if (stale->lastUsedFrame < frame)
+                {
+                    evict(*stale);
+                    changed = true;
+                }
+            }
+
+            load(*e);
+        }
+        return changed;
+    }
+
+    // Submits the uploads of the missing mipmap levels of textures within
+    // the upload budget. Recently used textures are streamed first.
+    void stream()
+    {
+        std::vector<Entry*> streamed;
+        for (auto& e : entries)
+        {
+            const std::shared_ptr<Texture2D>& tex = e.second.texture;
+            if (tex && tex->residentLevel > 0 && !tex->isUploading())
+                streamed.push_back(&e.second);
+        }
+
+        std::sort(streamed.begin(), streamed.end(),
+                  [](const Entry* a, const Entry* b)
+        { return a->lastUsedFrame > b->lastUsedFrame; });
+
+        VkDeviceSize uploaded = 0;
+        for (Entry* e : streamed)
+        {
+            if (uploaded >= uploadBudget)
+                break;
+
+            Queue queue(device, queueFamilyIndex, 0);
+            queue.create();
+
+            uploaded += e->texture->streamMipmaps(
+                queue,
+                *commandPool,
+                uploadBudget - uploaded);
+        }
+    }
+
+    bool needsUpdate() const
+    {
+        const VkDeviceSize used = usage();
+        if (used > budget)
+            return true;
+
+        for (auto& e : entries)
+            if (e.second.texture && e.second.texture->residentLevel > 0)
+                return true;
+
+        const VkDeviceSize stale = staleUsage();
+        for (auto& e : entries)
+        {
+            const Entry& entry = e.second;
+            if (entry.lastUsedFrame != frame || entry.fullSize == 0)
+                continue;
+            if (entry.pending || (entry.texture && entry.droppedLevels == 0))
+                continue;
+            if (used - entry.size + entry.fullSize <= budget + stale)
+                return true;
+        }
+        return false;
+    }
+
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    uint32_t queueFamilyIndex;
+    std::shared_ptr<CommandPool> commandPool;
+
+    VkDeviceSize budget = 0;
+    VkDeviceSize uploadBudget = 8 * 1024 * 1024;
+    uint64_t frame = 0;
+
+    std::map<std::string, Entry> entries;
+    // Textures replaced in the current update.
+    std::vector<std::shared_ptr<Texture2D>> retired;
+};
+
+/* -------------------------------------------------------------------------- */
+
+TextureResidencyManager::TextureResidencyManager(
+    const VkPhysicalDevice& physicalDevice,
+    const VkDevice& device,
+    const uint32_t& queueFamilyIndex)
+    : impl(std::make_shared<Impl>(physicalDevice, device, queueFamilyIndex))
+{}
+
+/* -------------------------------------------------------------------------- */
+
+void TextureResidencyManager::setBudget(VkDeviceSize budget)
+{ impl->budget = budget; }
+
+VkDeviceSize TextureResidencyManager::budget() const
+{ return impl->budget; }
+
+/* -------------------------------------------------------------------------- */
+
+void TextureResidencyManager::setUploadBudget(VkDeviceSize budget)
+{ impl->uploadBudget = budget; }
+
+VkDeviceSize TextureResidencyManager::uploadBudget() const
+{ return impl->uploadBudget; }
+
+/* -------------------------------------------------------------------------- */
+
+VkDeviceSize TextureResidencyManager::usage() const
+{ return impl->usage(); }
+
+/* -------------------------------------------------------------------------- */
+
+void TextureResidencyManager::add(const std::string& filePath)
+{
+    if (impl->entries.count(filePath))
+        return;
+
+    Entry& e = impl->entries[filePath];
+    e.filePath      = filePath;
+    e.lastUsedFrame = impl->frame;
+
+    if (!impl->load(e))
+        return;
+    impl->fitBudget();
+}
+
+bool TextureResidencyManager::contains(const std::string& filePath) const
+{ return impl->entries.count(filePath) > 0; }
+
+/* -------------------------------------------------------------------------- */
+
+void TextureResidencyManager::beginFrame()
+{ impl->frame++; }
+
+uint64_t TextureResidencyManager::frame() const
+{ return impl->frame; }
+
+/* -------------------------------------------------------------------------- */
+
+void TextureResidencyManager::use(const std::string& filePath)
+{
+    auto it = impl->entries.find(filePath);
+    if (it != impl->entries.end())
+        it->second.lastUsedFrame = impl->frame;
+}
+
+/* -------------------------------------------------------------------------- */
+
+std::shared_ptr<Texture2D> TextureResidencyManager::texture(
+    const std::string& filePath) const
+{
+    auto it = impl->entries.find(filePath);
+    if (it == impl->entries.end())
+        return nullptr;
+    return it->second.texture;
+}
+
+/* -------------------------------------------------------------------------- */
+
+bool TextureResidencyManager::update()
+{
+    // Descriptors using the textures replaced in the previous update have
+    // been re-written.
+    impl->retired.clear();
+
+    // New uploads are not submitted when textures are replaced so that the
+    // device wait of descriptor writes does not include them.
+    if (impl->retireUploads())
+        return true;
+    if (!impl->needsUpdate())
+        return false;
+
+    bool changed = impl->restream();
+    changed |= impl->fitBudget();
+    impl->stream();
+    return changed;
+}
+
+} // namespace vk
+} // namespace kuu
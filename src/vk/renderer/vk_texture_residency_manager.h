@@ -0,0 +1,93 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::TextureResidencyManager class
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <memory>
+#include <string>
+#include <vulkan/vulkan.h>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+struct Texture2D;
+
+/* -------------------------------------------------------------------------- *
+   Keeps the file textures resident within a device memory budget.
+
+   Manager tracks the frame when a texture was last used. When the resident
+   textures do not fit into budget the textures are reduced in LRU order:
+   texture that was not used in the current frame is evicted and texture
+   that was used in the current frame loses its top mipmap level. Textures
+   that are used but not fully resident are streamed back from the disk when
+   they fit into budget.
+
+   Textures become resident coarse-to-fine. When a texture is loaded only
+   its smallest mipmap levels are uploaded, the finer levels are uploaded
+   in the later updates within the per-frame upload budget.
+
+   Uploads are not waited. An uploaded texture replaces the resident texture
+   in a later update after the device has processed the upload. Textures are
+   recreated on residency change, user needs to re-write the descriptors
+   when update() returns true. The replaced textures are kept alive until
+   the next update, user needs to wait until the device has finished using
+   them before re-writing the descriptors.
+ * -------------------------------------------------------------------------- */
+class TextureResidencyManager
+{
+public:
+    // Constructs the manager. The budget is a half of the largest
+    // device-local memory heap.
+    TextureResidencyManager(const VkPhysicalDevice& physicalDevice,
+                            const VkDevice& device,
+                            const uint32_t& queueFamilyIndex);
+
+    // Sets and returns the device memory budget in bytes.
+    void setBudget(VkDeviceSize budget);
+    VkDeviceSize budget() const;
+
+    // Sets and returns the per-frame mipmap upload budget in bytes.
+    void setUploadBudget(VkDeviceSize budget);
+    VkDeviceSize uploadBudget() const;
+
+    // Returns the device memory used by the resident textures in bytes.
+    VkDeviceSize usage() const;
+
+    // Loads a RGBA or grayscale texture from the disk. Textures are
+    // reduced if the budget is exceeded.
+    void add(const std::string& filePath);
+    // Returns true if the texture has been added.
+    bool contains(const std::string& filePath) const;
+
+    // Starts a new frame.
+    void beginFrame();
+    // Returns the current frame.
+    uint64_t frame() const;
+
+    // Marks the texture as used in the current frame.
+    void use(const std::string& filePath);
+
+    // Returns the resident texture. Texture is null if the texture has
+    // been evicted or it is not added.
+    std::shared_ptr<Texture2D> texture(const std::string& filePath) const;
+
+    // Retires the processed uploads, evicts textures and submits uploads
+    // based on the budget and usage. Returns true if any of the textures
+    // were recreated.
+    bool update();
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace vk
+} // namespace kuu
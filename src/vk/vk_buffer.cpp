@@ -134,7 +134,7 @@ struct Buffer::Impl
 
     // Data from user
     VkDeviceSize size;
-    VkBufferUsageFlagBits usage;
+    VkBufferUsageFlags usage;
     VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     std::vector<uint32_t> queueFamilyIndices;
     VkMemoryPropertyFlags memoryFlags;
@@ -163,13 +163,13 @@ Buffer& Buffer::setSize(VkDeviceSize size)
 VkDeviceSize Buffer::size() const
 { return impl->size; }
 
-Buffer& Buffer::setUsage(VkBufferUsageFlagBits usage)
+Buffer& Buffer::setUsage(VkBufferUsageFlags usage)
 {
     impl->usage = usage;
     return *this;
 }
 
-VkBufferUsageFlagBits Buffer::usage() const
+VkBufferUsageFlags Buffer::usage() const
 { return impl->usage; }
 
 Buffer& Buffer::setSharingMode(VkSharingMode mode)
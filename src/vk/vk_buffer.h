@@ -31,8 +31,8 @@ public:
     VkDeviceSize size() const;
 
     // Sets and gets the usage.
-    Buffer& setUsage(VkBufferUsageFlagBits usage);
-    VkBufferUsageFlagBits usage() const;
+    Buffer& setUsage(VkBufferUsageFlags usage);
+    VkBufferUsageFlags usage() const;
 
     // Sets and gets the sharing mode. By default the buffer is  not shaded
     // and is an exclusive to queue that uses it. If the sharing is
@@ -6,6 +6,7 @@
 #include "vk_descriptor_set.h"
 #include <algorithm>
 #include <iostream>
+#include "vk_object_key.h"
 #include "vk_stringify.h"
 
 namespace kuu
@@ -172,6 +173,8 @@ struct DescriptorSets::Impl
                 return false;
             }
 
+            object_key::addDescriptorSetLayout(layout, layoutInfo);
+
             ownLayout = true;
         }
 
@@ -202,10 +205,13 @@ struct DescriptorSets::Impl
     void destroy()
     {
         if (ownLayout)
+        {
+            object_key::removeDescriptorSetLayout(layout);
             vkDestroyDescriptorSetLayout(
                 logicalDevice,
                 layout,
                 NULL);
+        }
 
         layout         = VK_NULL_HANDLE;
         descriptorSets = VK_NULL_HANDLE;
@@ -346,11 +352,38 @@ void DescriptorSets::writeUniformBuffer(
         0, NULL);
 }
 
+void DescriptorSets::writeStorageBuffer(
+        uint32_t binding,
+        VkBuffer buffer,
+        VkDeviceSize offset,
+        VkDeviceSize range)
+{
+    VkDescriptorBufferInfo info;
+    info.buffer = buffer;
+    info.offset = offset;
+    info.range  = range;
+
+    VkWriteDescriptorSet writeDescriptorSet = {};
+    writeDescriptorSet.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.dstSet          = impl->descriptorSets;
+    writeDescriptorSet.descriptorCount = 1;
+    writeDescriptorSet.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writeDescriptorSet.pBufferInfo     = &info;
+    writeDescriptorSet.dstBinding      = binding;
+
+    vkUpdateDescriptorSets(
+        impl->logicalDevice,
+        1,
+        &writeDescriptorSet,
+        0, NULL);
+}
+
 void DescriptorSets::writeImage(
     uint32_t binding,
     VkSampler sampler,
     VkImageView imageView,
-    VkImageLayout imageLayout)
+    VkImageLayout imageLayout,
+    uint32_t arrayElement)
 {
     VkDescriptorImageInfo info;
     info.sampler     = sampler;
@@ -364,6 +397,32 @@ void DescriptorSets::writeImage(
     writeDescriptorSet.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     writeDescriptorSet.pImageInfo      = &info;
     writeDescriptorSet.dstBinding      = binding;
+    writeDescriptorSet.dstArrayElement = arrayElement;
+
+    vkUpdateDescriptorSets(
+        impl->logicalDevice,
+        1,
+        &writeDescriptorSet,
+        0, NULL);
+}
+
+void DescriptorSets::writeStorageImage(
+    uint32_t binding,
+    VkImageView imageView,
+    VkImageLayout imageLayout)
+{
+    VkDescriptorImageInfo info;
+    info.sampler     = VK_NULL_HANDLE;
+    info.imageView   = imageView;
+    info.imageLayout = imageLayout;
+
+    VkWriteDescriptorSet writeDescriptorSet = {};
+    writeDescriptorSet.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.dstSet          = impl->descriptorSets;
+    writeDescriptorSet.descriptorCount = 1;
+    writeDescriptorSet.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writeDescriptorSet.pImageInfo      = &info;
+    writeDescriptorSet.dstBinding      = binding;
 
     vkUpdateDescriptorSets(
         impl->logicalDevice,
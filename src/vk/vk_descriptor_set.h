@@ -105,11 +105,26 @@ public:
         VkDeviceSize offset,
         VkDeviceSize range);
 
-    // Updates the combined image sampler descriptor set.
+    // Updates the storage buffer descriptor set.
+    void writeStorageBuffer(
+        uint32_t binding,
+        VkBuffer buffer,
+        VkDeviceSize offset,
+        VkDeviceSize range);
+
+    // Updates the combined image sampler descriptor set. Array element is
+    // the index of descriptor within an array binding.
     void writeImage(
         uint32_t binding,
         VkSampler sampler,
         VkImageView imageView,
+        VkImageLayout imageLayout,
+        uint32_t arrayElement = 0);
+
+    // Updates the storage image descriptor set.
+    void writeStorageImage(
+        uint32_t binding,
+        VkImageView imageView,
         VkImageLayout imageLayout);
 
 private:
@@ -106,6 +106,30 @@ int findMemoryTypeIndex(
     return -1;
 }
 
+/* -------------------------------------------------------------------------- *
+   Finds the first supported format of the candidates.
+ * -------------------------------------------------------------------------- */
+VkFormat findFormat(
+    const std::vector<std::pair<VkFormat, VkFormatProperties>>& formats,
+    const std::vector<VkFormat>& candidates,
+    VkFormatFeatureFlags features)
+{
+    for (const VkFormat candidate : candidates)
+    {
+        const auto it = std::find_if(
+            formats.begin(),
+            formats.end(),
+            [candidate](const std::pair<VkFormat, VkFormatProperties>& f)
+        { return f.first == candidate; });
+        if (it == formats.end())
+            continue;
+
+        if ((it->second.optimalTilingFeatures & features) == features)
+            return candidate;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
 /* -------------------------------------------------------------------------- *
    Finds the swap chain surface format.
  * -------------------------------------------------------------------------- */
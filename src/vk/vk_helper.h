@@ -64,6 +64,18 @@ int findMemoryTypeIndex(
     const VkMemoryRequirements& memRequirements,
     uint32_t propertyFlags);
 
+// Returns the first format of the candidates that supports the given in
+// features with optimal tiling.
+//
+// formats vector is a property of PhysicalDeviceInfo.
+//
+// The return value is VK_FORMAT_UNDEFINED if none of the candidates is
+// supported.
+VkFormat findFormat(
+    const std::vector<std::pair<VkFormat, VkFormatProperties>>& formats,
+    const std::vector<VkFormat>& candidates,
+    VkFormatFeatureFlags features);
+
 // Returns a surface format for swapchain.
 VkSurfaceFormatKHR findSwapchainSurfaceFormat(
     const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -68,6 +68,11 @@ void record(const VkCommandBuffer& cmdbuffer,
             barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
             break;
 
+        // storage image -> wait until shader writes have been finished
+        case VK_IMAGE_LAYOUT_GENERAL:
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            break;
+
         default:
             break;
     }
@@ -101,6 +106,11 @@ void record(const VkCommandBuffer& cmdbuffer,
             barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
             break;
 
+        // storage image -> shader writes must wait for the transition
+        case VK_IMAGE_LAYOUT_GENERAL:
+            barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            break;
+
         default:
             break;
     }
@@ -0,0 +1,211 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::object_key namespace.
+ * -------------------------------------------------------------------------- */
+
+#include "vk_object_key.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace kuu
+{
+namespace vk
+{
+namespace object_key
+{
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Appends the bytes of the value into the key. The value must not contain
+// pointers or padding.
+template<typename T>
+void append(std::string& key, const T& value)
+{
+    key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Keys by the handle.
+std::map<VkRenderPass, std::string> renderPasses;
+std::map<VkDescriptorSetLayout, std::string> descriptorSetLayouts;
+std::map<VkShaderModule, std::string> shaderModules;
+std::mutex keysMutex;
+
+// Returns the key of the handle or the handle if there is no key.
+template<typename T>
+std::string find(const std::map<T, std::string>& keys, const T& handle)
+{
+    std::lock_guard<std::mutex> lock(keysMutex);
+    const auto it = keys.find(handle);
+    if (it != keys.end())
+        return it->second;
+
+    std::string key("handle");
+    append(key, handle);
+    return key;
+}
+
+template<typename T>
+void insert(std::map<T, std::string>& keys, const T& handle, const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(keysMutex);
+    keys[handle] = key;
+}
+
+template<typename T>
+void erase(std::map<T, std::string>& keys, const T& handle)
+{
+    std::lock_guard<std::mutex> lock(keysMutex);
+    keys.erase(handle);
+}
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- */
+
+void addRenderPass(const VkRenderPass& renderPass,
+                   const VkRenderPassCreateInfo& info)
+{
+    std::string key;
+
+    // References are compatible if the referenced attachments have the
+    // same format and sample count, or if both are unused.
+    auto appendReference = [&](const VkAttachmentReference& ref)
+    {
+        if (ref.attachment == VK_ATTACHMENT_UNUSED)
+        {
+            append(key, VK_FORMAT_UNDEFINED);
+            append(key, VkSampleCountFlagBits(0));
+            return;
+        }
+
+        const VkAttachmentDescription& desc = info.pAttachments[ref.attachment];
+        append(key, desc.format);
+        append(key, desc.samples);
+    };
+
+    append(key, info.subpassCount);
+    for (uint32_t i = 0; i < info.subpassCount; ++i)
+    {
+        const VkSubpassDescription& subpass = info.pSubpasses[i];
+        append(key, subpass.pipelineBindPoint);
+
+        append(key, subpass.inputAttachmentCount);
+        for (uint32_t a = 0; a < subpass.inputAttachmentCount; ++a)
+            appendReference(subpass.pInputAttachments[a]);
+
+        append(key, subpass.colorAttachmentCount);
+        for (uint32_t a = 0; a < subpass.colorAttachmentCount; ++a)
+            appendReference(subpass.pColorAttachments[a]);
+
+        append(key, subpass.pResolveAttachments != NULL);
+        if (subpass.pResolveAttachments)
+            for (uint32_t a = 0; a < subpass.colorAttachmentCount; ++a)
+                appendReference(subpass.pResolveAttachments[a]);
+
+        append(key, subpass.pDepthStencilAttachment != NULL);
+        if (subpass.pDepthStencilAttachment)
+            appendReference(*subpass.pDepthStencilAttachment);
+    }
+
+    // Passes of several subpasses need to be otherwise identical.
+    if (info.subpassCount > 1)
+    {
+        append(key, info.dependencyCount);
+        for (uint32_t i = 0; i < info.dependencyCount; ++i)
+        {
+            const VkSubpassDependency& dep = info.pDependencies[i];
+            append(key, dep.srcSubpass);
+            append(key, dep.dstSubpass);
+            append(key, dep.srcStageMask);
+            append(key, dep.dstStageMask);
+            append(key, dep.srcAccessMask);
+            append(key, dep.dstAccessMask);
+            append(key, dep.dependencyFlags);
+        }
+    }
+
+    insert(renderPasses, renderPass, key);
+}
+
+void removeRenderPass(const VkRenderPass& renderPass)
+{ erase(renderPasses, renderPass); }
+
+/* -------------------------------------------------------------------------- */
+
+void addDescriptorSetLayout(const VkDescriptorSetLayout& layout,
+                            const VkDescriptorSetLayoutCreateInfo& info)
+{
+    std::vector<VkDescriptorSetLayoutBinding> bindings(
+        info.pBindings, info.pBindings + info.bindingCount);
+    std::sort(bindings.begin(), bindings.end(),
+              [](const VkDescriptorSetLayoutBinding& a,
+                 const VkDescriptorSetLayoutBinding& b)
+    { return a.binding < b.binding; });
+
+    std::string key;
+    append(key, info.flags);
+    append(key, info.bindingCount);
+    for (const VkDescriptorSetLayoutBinding& b : bindings)
+    {
+        append(key, b.binding);
+        append(key, b.descriptorType);
+        append(key, b.descriptorCount);
+        append(key, b.stageFlags);
+
+        append(key, b.pImmutableSamplers != NULL);
+        if (b.pImmutableSamplers)
+            for (uint32_t i = 0; i < b.descriptorCount; ++i)
+                append(key, b.pImmutableSamplers[i]);
+    }
+
+    insert(descriptorSetLayouts, layout, key);
+}
+
+void removeDescriptorSetLayout(const VkDescriptorSetLayout& layout)
+{ erase(descriptorSetLayouts, layout); }
+
+/* -------------------------------------------------------------------------- */
+
+void addShaderModule(const VkShaderModule& module,
+                     const VkShaderModuleCreateInfo& info)
+{
+    // 64-bit FNV-1a
+    const unsigned char* code =
+        reinterpret_cast<const unsigned char*>(info.pCode);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < info.codeSize; ++i)
+    {
+        hash ^= code[i];
+        hash *= 1099511628211ULL;
+    }
+
+    std::string key;
+    append(key, hash);
+    append(key, info.codeSize);
+    insert(shaderModules, module, key);
+}
+
+void removeShaderModule(const VkShaderModule& module)
+{ erase(shaderModules, module); }
+
+/* -------------------------------------------------------------------------- */
+
+std::string renderPass(const VkRenderPass& renderPass)
+{ return find(renderPasses, renderPass); }
+
+std::string descriptorSetLayout(const VkDescriptorSetLayout& layout)
+{ return find(descriptorSetLayouts, layout); }
+
+std::string shaderModule(const VkShaderModule& module)
+{ return find(shaderModules, module); }
+
+} // namespace object_key
+} // namespace vk
+} // namespace kuu
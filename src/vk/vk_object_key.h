@@ -0,0 +1,60 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::object_key namespace.
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <string>
+#include <vulkan/vulkan.h>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- *
+   Keys of the vulkan objects that a pipeline is created against.
+
+   A key describes the object by its creation info so that objects that
+   are interchangeable for a pipeline have equal keys, e.g. a render pass
+   that is recreated after the swapchain has been resized or the descriptor
+   set layouts of two renderers. Handles are not part of the keys as a
+   handle of a destroyed object can be recycled for a different object.
+
+   The key is recorded when the object is created and removed before the
+   object is destroyed.
+ * -------------------------------------------------------------------------- */
+namespace object_key
+{
+
+// Records and removes the key of a render pass. The key contains the
+// render pass compatibility: the format and sample count of the attachments
+// referenced by the subpasses and the dependencies of a multi-subpass pass.
+void addRenderPass(const VkRenderPass& renderPass,
+                   const VkRenderPassCreateInfo& info);
+void removeRenderPass(const VkRenderPass& renderPass);
+
+// Records and removes the key of a descriptor set layout. The key contains
+// the bindings in the binding order.
+void addDescriptorSetLayout(const VkDescriptorSetLayout& layout,
+                            const VkDescriptorSetLayoutCreateInfo& info);
+void removeDescriptorSetLayout(const VkDescriptorSetLayout& layout);
+
+// Records and removes the key of a shader module. The key contains the
+// hash and the size of the SPIR-V code.
+void addShaderModule(const VkShaderModule& module,
+                     const VkShaderModuleCreateInfo& info);
+void removeShaderModule(const VkShaderModule& module);
+
+// Returns the key of the object. If the key has not been recorded then
+// the key is the handle.
+std::string renderPass(const VkRenderPass& renderPass);
+std::string descriptorSetLayout(const VkDescriptorSetLayout& layout);
+std::string shaderModule(const VkShaderModule& module);
+
+} // namespace object_key
+} // namespace vk
+} // namespace kuu
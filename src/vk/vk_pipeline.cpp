@@ -4,13 +4,136 @@
  * -------------------------------------------------------------------------- */
 
 #include "vk_pipeline.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "vk_object_key.h"
+#include "vk_pipeline_cache.h"
 #include "vk_stringify.h"
 
 namespace kuu
 {
 namespace vk
 {
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Appends the bytes of the value into the state key. The value must not
+// contain pointers or padding.
+template<typename T>
+void append(std::string& key, const T& value)
+{
+    key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Appends the key of an object with its length.
+void append(std::string& key, const std::string& objectKey)
+{
+    append(key, uint32_t(objectKey.size()));
+    key.append(objectKey);
+}
+
+void append(std::string& key, const VkStencilOpState& state)
+{
+    append(key, state.failOp);
+    append(key, state.passOp);
+    append(key, state.depthFailOp);
+    append(key, state.compareOp);
+    append(key, state.compareMask);
+    append(key, state.writeMask);
+    append(key, state.reference);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// A bounded pool of worker threads that creates the pipelines started with
+// createAsync. There is a worker per hardware thread and the workers drain
+// a shared queue so that a burst of pipelines does not spawn a thread per
+// pipeline.
+class WorkerPool
+{
+public:
+    WorkerPool()
+        : stop(false)
+    {
+        unsigned count = std::thread::hardware_concurrency();
+        if (count == 0)
+            count = 1;
+
+        for (unsigned i = 0; i < count; ++i)
+            workers.push_back(std::thread([this]() { run(); }));
+    }
+
+    // Finishes the queued tasks and joins the workers.
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        condition.notify_all();
+
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    // Returns the pool. The workers are started on the first call.
+    static WorkerPool& instance()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    // Queues the function and returns the future of its result.
+    std::shared_future<bool> push(const std::function<bool()>& fn)
+    {
+        auto task = std::make_shared<std::packaged_task<bool()>>(fn);
+        std::shared_future<bool> future = task->get_future().share();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return future;
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]()
+                { return stop || !tasks.empty(); });
+
+                if (tasks.empty())
+                    return;
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stop;
+};
+
+} // anonymous namespace
 
 /* -------------------------------------------------------------------------- */
 
@@ -23,6 +146,31 @@ struct Pipeline::Impl
     }
 
     bool create()
+    {
+        if (!createLayout())
+            return false;
+        return createPipeline();
+    }
+
+    // Creates the layout and queues the pipeline creation into the worker
+    // pool. Pipeline creation reads only the state of this object.
+    bool createAsync()
+    {
+        if (!createLayout())
+            return false;
+        creation = WorkerPool::instance().push(
+            [this]() { return createPipeline(); });
+        return true;
+    }
+
+    // Waits until the pipeline started with createAsync has been created.
+    void wait() const
+    {
+        if (creation.valid())
+            creation.wait();
+    }
+
+    bool createLayout()
     {
         VkResult result = vkCreatePipelineLayout(
             logicalDevice,
@@ -39,7 +187,11 @@ struct Pipeline::Impl
 
             return false;
         }
+        return true;
+    }
 
+    bool createPipeline()
+    {
         VkGraphicsPipelineCreateInfo info;
         info.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
         info.pNext               = NULL;
@@ -61,10 +213,10 @@ struct Pipeline::Impl
         info.basePipelineHandle  = VK_NULL_HANDLE;
         info.basePipelineIndex   = -1;
 
-        result =
+        const VkResult result =
             vkCreateGraphicsPipelines(
                 logicalDevice,
-                VK_NULL_HANDLE,
+                PipelineCache::deviceCache(logicalDevice),
                 1,
                 &info,
                 NULL,
@@ -85,6 +237,9 @@ struct Pipeline::Impl
 
     void destroy()
     {
+        wait();
+        creation = std::shared_future<bool>();
+
         vkDestroyPipeline(
             logicalDevice,
             pipeline,
@@ -101,10 +256,176 @@ struct Pipeline::Impl
 
     bool isValid() const
     {
+        wait();
         return pipelineLayout != VK_NULL_HANDLE &&
                pipeline       != VK_NULL_HANDLE;
     }
 
+    // Returns true if the state is set dynamically.
+    bool isDynamic(VkDynamicState state) const
+    {
+        const VkDynamicState* begin = dynamicState.pDynamicStates;
+        const VkDynamicState* end   = begin + dynamicState.dynamicStateCount;
+        return std::find(begin, end, state) != end;
+    }
+
+    std::string stateKey() const
+    {
+        std::string key;
+        append(key, logicalDevice);
+
+        // Shader stages
+        append(key, uint32_t(shaderStages.size()));
+        for (const VkPipelineShaderStageCreateInfo& stage : shaderStages)
+        {
+            append(key, stage.stage);
+            append(key, object_key::shaderModule(stage.module));
+            key.append(stage.pName);
+            key.push_back('\0');
+
+            const VkSpecializationInfo* spec = stage.pSpecializationInfo;
+            append(key, spec ? spec->mapEntryCount : 0u);
+            if (!spec)
+                continue;
+            for (uint32_t i = 0; i < spec->mapEntryCount; ++i)
+            {
+                append(key, spec->pMapEntries[i].constantID);
+                append(key, spec->pMapEntries[i].offset);
+                append(key, spec->pMapEntries[i].size);
+            }
+            append(key, spec->dataSize);
+            key.append(static_cast<const char*>(spec->pData), spec->dataSize);
+        }
+
+        // Vertex input
+        append(key, vertexInputState.vertexBindingDescriptionCount);
+        for (uint32_t i = 0; i < vertexInputState.vertexBindingDescriptionCount; ++i)
+        {
+            const VkVertexInputBindingDescription& desc =
+                vertexInputState.pVertexBindingDescriptions[i];
+            append(key, desc.binding);
+            append(key, desc.stride);
+            append(key, desc.inputRate);
+        }
+        append(key, vertexInputState.vertexAttributeDescriptionCount);
+        for (uint32_t i = 0; i < vertexInputState.vertexAttributeDescriptionCount; ++i)
+        {
+            const VkVertexInputAttributeDescription& desc =
+                vertexInputState.pVertexAttributeDescriptions[i];
+            append(key, desc.location);
+            append(key, desc.binding);
+            append(key, desc.format);
+            append(key, desc.offset);
+        }
+
+        // Input assembly
+        append(key, inputAssemblyState.topology);
+        append(key, inputAssemblyState.primitiveRestartEnable);
+
+        // Viewports and scissors, only the counts if set dynamically.
+        append(key, viewportState.viewportCount);
+        if (!isDynamic(VK_DYNAMIC_STATE_VIEWPORT))
+            for (uint32_t i = 0; i < viewportState.viewportCount; ++i)
+            {
+                const VkViewport& v = viewportState.pViewports[i];
+                append(key, v.x);
+                append(key, v.y);
+                append(key, v.width);
+                append(key, v.height);
+                append(key, v.minDepth);
+                append(key, v.maxDepth);
+            }
+        append(key, viewportState.scissorCount);
+        if (!isDynamic(VK_DYNAMIC_STATE_SCISSOR))
+            for (uint32_t i = 0; i < viewportState.scissorCount; ++i)
+            {
+                const VkRect2D& r = viewportState.pScissors[i];
+                append(key, r.offset.x);
+                append(key, r.offset.y);
+                append(key, r.extent.width);
+                append(key, r.extent.height);
+            }
+
+        // Rasterizer
+        append(key, rasterizerState.depthClampEnable);
+        append(key, rasterizerState.rasterizerDiscardEnable);
+        append(key, rasterizerState.polygonMode);
+        append(key, rasterizerState.cullMode);
+        append(key, rasterizerState.frontFace);
+        append(key, rasterizerState.depthBiasEnable);
+        append(key, rasterizerState.depthBiasConstantFactor);
+        append(key, rasterizerState.depthBiasClamp);
+        append(key, rasterizerState.depthBiasSlopeFactor);
+        append(key, rasterizerState.lineWidth);
+
+        // Multisampling
+        append(key, multisampleState.rasterizationSamples);
+        append(key, multisampleState.sampleShadingEnable);
+        append(key, multisampleState.minSampleShading);
+        append(key, multisampleState.alphaToCoverageEnable);
+        append(key, multisampleState.alphaToOneEnable);
+        append(key, multisampleState.pSampleMask != NULL);
+        if (multisampleState.pSampleMask)
+        {
+            const uint32_t words = (multisampleState.rasterizationSamples + 31) / 32;
+            for (uint32_t i = 0; i < words; ++i)
+                append(key, multisampleState.pSampleMask[i]);
+        }
+
+        // Depth and stencil
+        append(key, depthStencilState.depthTestEnable);
+        append(key, depthStencilState.depthWriteEnable);
+        append(key, depthStencilState.depthCompareOp);
+        append(key, depthStencilState.depthBoundsTestEnable);
+        append(key, depthStencilState.stencilTestEnable);
+        append(key, depthStencilState.front);
+        append(key, depthStencilState.back);
+        append(key, depthStencilState.minDepthBounds);
+        append(key, depthStencilState.maxDepthBounds);
+
+        // Color blending
+        append(key, colorBlendState.logicOpEnable);
+        append(key, colorBlendState.logicOp);
+        append(key, colorBlendState.attachmentCount);
+        for (uint32_t i = 0; i < colorBlendState.attachmentCount; ++i)
+        {
+            const VkPipelineColorBlendAttachmentState& a =
+                colorBlendState.pAttachments[i];
+            append(key, a.blendEnable);
+            append(key, a.srcColorBlendFactor);
+            append(key, a.dstColorBlendFactor);
+            append(key, a.colorBlendOp);
+            append(key, a.srcAlphaBlendFactor);
+            append(key, a.dstAlphaBlendFactor);
+            append(key, a.alphaBlendOp);
+            append(key, a.colorWriteMask);
+        }
+        for (int i = 0; i < 4; ++i)
+            append(key, colorBlendState.blendConstants[i]);
+
+        // Dynamic states
+        append(key, dynamicState.dynamicStateCount);
+        for (uint32_t i = 0; i < dynamicState.dynamicStateCount; ++i)
+            append(key, dynamicState.pDynamicStates[i]);
+
+        // Layout
+        append(key, layoutInfo.setLayoutCount);
+        for (uint32_t i = 0; i < layoutInfo.setLayoutCount; ++i)
+            append(key, object_key::descriptorSetLayout(layoutInfo.pSetLayouts[i]));
+        append(key, layoutInfo.pushConstantRangeCount);
+        for (uint32_t i = 0; i < layoutInfo.pushConstantRangeCount; ++i)
+        {
+            const VkPushConstantRange& range = layoutInfo.pPushConstantRanges[i];
+            append(key, range.stageFlags);
+            append(key, range.offset);
+            append(key, range.size);
+        }
+
+        // Render pass, compared by the compatibility.
+        append(key, object_key::renderPass(renderPass));
+        return key;
+    }
+
     // Parent
     VkDevice logicalDevice;
 
@@ -112,6 +433,9 @@ struct Pipeline::Impl
     VkPipeline pipeline = VK_NULL_HANDLE;
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
 
+    // Pending creation of createAsync.
+    std::shared_future<bool> creation;
+
     // From user
     std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
     VkPipelineVertexInputStateCreateInfo vertexInputState;
@@ -135,6 +459,17 @@ struct Pipeline::Impl
     std::vector<VkDynamicState> dynamicStateStates;
     std::vector<VkDescriptorSetLayout> layoutDescriptorlayouts;
     std::vector<VkPushConstantRange> layoutPushConstantRanges;
+
+    // Copies of the shader stage entry point names and specializations as
+    // the pipeline can be created after the user data is gone.
+    struct Specialization
+    {
+        std::vector<VkSpecializationMapEntry> entries;
+        std::vector<char> data;
+        VkSpecializationInfo info;
+    };
+    std::vector<std::shared_ptr<std::string>> stageNames;
+    std::vector<std::shared_ptr<Specialization>> specializations;
 };
 
 /* -------------------------------------------------------------------------- */
@@ -147,6 +482,26 @@ Pipeline::Pipeline(const VkDevice& logicalDevice)
 
 Pipeline& Pipeline::addShaderStage(VkPipelineShaderStageCreateInfo stage)
 {
+    auto name = std::make_shared<std::string>(stage.pName);
+    impl->stageNames.push_back(name);
+    stage.pName = name->c_str();
+
+    if (const VkSpecializationInfo* info = stage.pSpecializationInfo)
+    {
+        const char* data = static_cast<const char*>(info->pData);
+
+        auto spec = std::make_shared<Impl::Specialization>();
+        spec->entries.assign(info->pMapEntries,
+                             info->pMapEntries + info->mapEntryCount);
+        spec->data.assign(data, data + info->dataSize);
+        spec->info.mapEntryCount = uint32_t(spec->entries.size());
+        spec->info.pMapEntries   = spec->entries.data();
+        spec->info.dataSize      = spec->data.size();
+        spec->info.pData         = spec->data.data();
+        impl->specializations.push_back(spec);
+        stage.pSpecializationInfo = &spec->info;
+    }
+
     impl->shaderStages.push_back(stage);
     return *this;
 }
@@ -446,6 +801,13 @@ bool Pipeline::create()
     return true;
 }
 
+bool Pipeline::createAsync()
+{
+    if (!isValid())
+        return impl->createAsync();
+    return true;
+}
+
 void Pipeline::destroy()
 {
     if (isValid())
@@ -457,11 +819,20 @@ bool Pipeline::isValid() const
     return impl->isValid();
 }
 
+std::string Pipeline::stateKey() const
+{ return impl->stateKey(); }
+
 VkPipeline Pipeline::handle() const
-{ return impl->pipeline; }
+{
+    impl->wait();
+    return impl->pipeline;
+}
 
 VkPipelineLayout Pipeline::pipelineLayoutHandle() const
-{ return impl->pipelineLayout; }
+{
+    impl->wait();
+    return impl->pipelineLayout;
+}
 
 } // namespace vk
 } // namespace kuu
@@ -8,6 +8,7 @@
 /* -------------------------------------------------------------------------- */
 
 #include <memory>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan.h>
 
@@ -119,9 +120,22 @@ public:
     bool create();
     void destroy();
 
+    // Creates the pipeline layout and queues the pipeline creation into a
+    // pool of a worker per hardware thread. The handle getters and isValid wait until the
+    // pipeline has been created. Returns false if the layout could not be
+    // created.
+    bool createAsync();
+
     // Returns true if the pipeline handle is not a VK_NULL_HANDLE.
     bool isValid() const;
 
+    // Returns the canonical description of the pipeline state: shader
+    // stages with the specialization data, fixed-function states, layout
+    // and render pass. Shader modules, set layouts and render pass are
+    // described by their keys, see object_key. Pipelines with equal keys
+    // are interchangeable.
+    std::string stateKey() const;
+
     // Returns the handle.
     VkPipeline handle() const;
     VkPipelineLayout pipelineLayoutHandle() const;
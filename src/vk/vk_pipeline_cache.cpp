@@ -0,0 +1,291 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::PipelineCache class
+ * -------------------------------------------------------------------------- */
+
+#include "vk_pipeline_cache.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+
+/* -------------------------------------------------------------------------- */
+
+#include "vk_stringify.h"
+
+namespace kuu
+{
+namespace vk
+{
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Caches of the logical devices.
+std::map<VkDevice, VkPipelineCache> deviceCaches;
+std::mutex deviceCachesMutex;
+
+/* -------------------------------------------------------------------------- *
+   Header of the pipeline cache data, see the specification of
+   vkGetPipelineCacheData.
+ * -------------------------------------------------------------------------- */
+struct CacheHeader
+{
+    uint32_t length;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+/* -------------------------------------------------------------------------- *
+   Returns the default cache file path of the physical device.
+ * -------------------------------------------------------------------------- */
+std::string defaultFilePath(const VkPhysicalDevice& physicalDevice)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    QString uuid;
+    for (uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+        uuid += QString("%1").arg(properties.pipelineCacheUUID[i], 2, 16, QChar('0'));
+
+    return QString("cache/pipeline_%1_%2_%3.bin")
+        .arg(properties.vendorID, 4, 16, QChar('0'))
+        .arg(properties.deviceID, 4, 16, QChar('0'))
+        .arg(uuid)
+        .toStdString();
+}
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- */
+
+struct PipelineCache::Impl
+{
+    ~Impl()
+    {
+        if (isValid())
+            destroy();
+    }
+
+    // Reads the cache data from the file. Returns an empty vector if the
+    // file does not exist or if the data is not of this device.
+    std::vector<char> read() const
+    {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file.is_open())
+            return std::vector<char>();
+
+        std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+        if (data.size() < sizeof(CacheHeader))
+            return std::vector<char>();
+
+        CacheHeader header;
+        std::memcpy(&header, data.data(), sizeof(CacheHeader));
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        if (header.length   <  sizeof(CacheHeader)                 ||
+            header.version  != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            header.vendorID != properties.vendorID                 ||
+            header.deviceID != properties.deviceID                 ||
+            std::memcmp(header.pipelineCacheUUID,
+                        properties.pipelineCacheUUID,
+                        VK_UUID_SIZE) != 0)
+        {
+            std::cerr << __FUNCTION__
+                      << ": pipeline cache "
+                      << filePath
+                      << " is not of this device, ignored"
+                      << std::endl;
+            return std::vector<char>();
+        }
+
+        return data;
+    }
+
+    bool create()
+    {
+        const std::vector<char> data = read();
+
+        VkPipelineCacheCreateInfo info = {};
+        info.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        info.initialDataSize = data.size();
+        info.pInitialData    = data.empty() ? NULL : data.data();
+
+        const VkResult result = vkCreatePipelineCache(
+            logicalDevice,
+            &info, NULL,
+            &cache);
+
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": pipeline cache creation failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(deviceCachesMutex);
+        deviceCaches[logicalDevice] = cache;
+        return true;
+    }
+
+    bool save() const
+    {
+        size_t size = 0;
+        VkResult result = vkGetPipelineCacheData(
+            logicalDevice,
+            cache,
+            &size,
+            NULL);
+
+        std::vector<char> data(size);
+        if (result == VK_SUCCESS)
+            result = vkGetPipelineCacheData(
+                logicalDevice,
+                cache,
+                &size,
+                data.data());
+
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": pipeline cache data query failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
+        }
+
+        const QString dirPath = QFileInfo(QString::fromStdString(filePath)).path();
+        if (!QDir().mkpath(dirPath))
+        {
+            std::cerr << __FUNCTION__
+                      << ": failed to create cache directory "
+                      << dirPath.toStdString()
+                      << std::endl;
+            return false;
+        }
+
+        // Data is written into a temporary file that replaces the file
+        // when committed, an interrupted save leaves the old file intact.
+        QSaveFile file(QString::fromStdString(filePath));
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            std::cerr << __FUNCTION__
+                      << ": failed to open pipeline cache file "
+                      << filePath
+                      << std::endl;
+            return false;
+        }
+
+        if (file.write(data.data(), qint64(size)) != qint64(size) ||
+            !file.commit())
+        {
+            std::cerr << __FUNCTION__
+                      << ": failed to write pipeline cache file "
+                      << filePath
+                      << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    void destroy()
+    {
+        save();
+
+        {
+            std::lock_guard<std::mutex> lock(deviceCachesMutex);
+            deviceCaches.erase(logicalDevice);
+        }
+
+        vkDestroyPipelineCache(
+            logicalDevice,
+            cache,
+            NULL);
+
+        cache = VK_NULL_HANDLE;
+    }
+
+    bool isValid() const
+    {
+        return cache != VK_NULL_HANDLE;
+    }
+
+    // Parents
+    VkPhysicalDevice physicalDevice;
+    VkDevice logicalDevice;
+
+    // Cache file
+    std::string filePath;
+
+    // Child
+    VkPipelineCache cache = VK_NULL_HANDLE;
+};
+
+/* -------------------------------------------------------------------------- */
+
+PipelineCache::PipelineCache(const VkPhysicalDevice& physicalDevice,
+                             const VkDevice& logicalDevice,
+                             const std::string& filePath)
+    : impl(std::make_shared<Impl>())
+{
+    impl->physicalDevice = physicalDevice;
+    impl->logicalDevice  = logicalDevice;
+    impl->filePath       = filePath.empty() ? defaultFilePath(physicalDevice)
+                                            : filePath;
+}
+
+bool PipelineCache::create()
+{
+    if (impl->isValid())
+        return true;
+    return impl->create();
+}
+
+void PipelineCache::destroy()
+{
+    if (impl->isValid())
+        impl->destroy();
+}
+
+bool PipelineCache::save() const
+{
+    if (!impl->isValid())
+        return false;
+    return impl->save();
+}
+
+bool PipelineCache::isValid() const
+{ return impl->isValid(); }
+
+VkPipelineCache PipelineCache::handle() const
+{ return impl->cache; }
+
+VkPipelineCache PipelineCache::deviceCache(const VkDevice& logicalDevice)
+{
+    std::lock_guard<std::mutex> lock(deviceCachesMutex);
+    const auto it = deviceCaches.find(logicalDevice);
+    if (it == deviceCaches.end())
+        return VK_NULL_HANDLE;
+    return it->second;
+}
+
+} // namespace vk
+} // namespace kuu
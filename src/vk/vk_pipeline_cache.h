@@ -0,0 +1,67 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::PipelineCache class
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <memory>
+#include <string>
+#include <vulkan/vulkan.h>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- *
+   A persistent vulkan pipeline cache wrapper class.
+
+   The cache data is loaded from the file when the cache is created and
+   saved into the file when the cache is destroyed. The file is ignored if
+   its header does not match the vendor, device and pipeline cache UUID of
+   the physical device, e.g. after a driver update. By default the file is
+   named after the vendor, device and pipeline cache UUID so that each
+   device has its own file. The file is replaced atomically when saved.
+
+   The created cache is the cache of the logical device and it is used by
+   every pipeline creation of the device. Vulkan pipeline caches are
+   internally synchronized so the pipelines can be created from several
+   threads.
+ * -------------------------------------------------------------------------- */
+class PipelineCache
+{
+public:
+    // Constructs the cache. If the file path is empty then the file is
+    // cache/pipeline_<vendor>_<device>_<uuid>.bin in hexadecimal.
+    PipelineCache(const VkPhysicalDevice& physicalDevice,
+                  const VkDevice& logicalDevice,
+                  const std::string& filePath = std::string());
+
+    // Creates the cache from the file and destroys the cache after saving
+    // it into the file.
+    bool create();
+    void destroy();
+
+    // Saves the cache data into the file.
+    bool save() const;
+
+    // Returns true if the handle is not a VK_NULL_HANDLE.
+    bool isValid() const;
+
+    // Returns the handle.
+    VkPipelineCache handle() const;
+
+    // Returns the cache of the logical device. Returns VK_NULL_HANDLE if
+    // a cache of the device has not been created.
+    static VkPipelineCache deviceCache(const VkDevice& logicalDevice);
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace vk
+} // namespace kuu
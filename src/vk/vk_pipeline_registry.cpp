@@ -0,0 +1,74 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::pipeline_registry namespace.
+ * -------------------------------------------------------------------------- */
+
+#include "vk_pipeline_registry.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <map>
+#include <mutex>
+#include <string>
+
+/* -------------------------------------------------------------------------- */
+
+#include "vk_pipeline.h"
+
+namespace kuu
+{
+namespace vk
+{
+namespace pipeline_registry
+{
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Pipelines by the state key.
+std::map<std::string, std::weak_ptr<Pipeline>> pipelines;
+std::mutex pipelinesMutex;
+
+// Returns the registered pipeline of the key, null if none. Removes the
+// released pipelines. Mutex needs to be locked.
+std::shared_ptr<Pipeline> find(const std::string& key)
+{
+    for (auto it = pipelines.begin(); it != pipelines.end();)
+    {
+        if (it->second.expired())
+            it = pipelines.erase(it);
+        else
+            ++it;
+    }
+
+    const auto it = pipelines.find(key);
+    if (it == pipelines.end())
+        return nullptr;
+    return it->second.lock();
+}
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- */
+
+std::shared_ptr<Pipeline> pipeline(std::shared_ptr<Pipeline> description)
+{
+    const std::string key = description->stateKey();
+
+    std::lock_guard<std::mutex> lock(pipelinesMutex);
+    if (std::shared_ptr<Pipeline> p = find(key))
+        return p;
+
+    // Pipeline is compiled on a worker thread and registered right away so
+    // that the same state is not compiled twice.
+    if (!description->createAsync())
+        return nullptr;
+
+    pipelines[key] = description;
+    return description;
+}
+
+} // namespace pipeline_registry
+} // namespace vk
+} // namespace kuu
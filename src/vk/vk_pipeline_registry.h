@@ -0,0 +1,43 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::pipeline_registry namespace.
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <memory>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+class Pipeline;
+
+/* -------------------------------------------------------------------------- *
+   Registry of the graphics pipelines shared by the renderers.
+
+   A pipeline is identified by its state key, see Pipeline::stateKey. The
+   registry keeps weak references, a pipeline is destroyed when the last
+   user releases it.
+
+   Pipelines are compiled in parallel while the renderers are set up. The
+   compilation is joined when the pipeline handle is first needed, e.g.
+   when the command buffers are recorded.
+ * -------------------------------------------------------------------------- */
+namespace pipeline_registry
+{
+
+// Returns the pipeline of the same state as the description. If there is
+// no such pipeline the description is registered and its creation started
+// on a worker thread, see Pipeline::createAsync. Returns null if the
+// pipeline layout could not be created.
+std::shared_ptr<Pipeline> pipeline(std::shared_ptr<Pipeline> description);
+
+} // namespace pipeline_registry
+} // namespace vk
+} // namespace kuu
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <iostream>
 #include "vk_image.h"
+#include "vk_object_key.h"
 #include "vk_stringify.h"
 
 /* -------------------------------------------------------------------------- */
@@ -60,6 +61,8 @@ struct RenderPass::Impl
             return false;
         }
 
+        object_key::addRenderPass(renderPass, info);
+
         depthStencilImage.setType(VK_IMAGE_TYPE_2D);
         depthStencilImage.setFormat(VK_FORMAT_D32_SFLOAT_S8_UINT);
         depthStencilImage.setExtent( { imageExtent.width, imageExtent.height, 1 } );
@@ -123,6 +126,7 @@ struct RenderPass::Impl
                 NULL);                    // [in] allocator
         swapchainFramebuffers.clear();
 
+        object_key::removeRenderPass(renderPass);
         vkDestroyRenderPass(
             logicalDevice, // [in] logical device
             renderPass,    // [in] render pass
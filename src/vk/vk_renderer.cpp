@@ -5,8 +5,9 @@
 
 #include "vk_renderer.h"
 #include <iostream>
+#include <QtCore/QtGlobal>
 #include <QtGui/QImage>
-#include "renderer/vk_atmoshere_renderer.h"
+#include "renderer/vk_environment_baker.h"
 #include "renderer/vk_mesh_manager.h"
 #include "renderer/vk_pbr_renderer.h"
 #include "renderer/vk_shadow_map_depth.h"
@@ -19,10 +20,13 @@
 #include "vk_image.h"
 #include "vk_logical_device.h"
 #include "vk_mesh.h"
+#include "vk_physical_device.h"
 #include "vk_pipeline.h"
+#include "vk_pipeline_cache.h"
 #include "vk_queue.h"
 #include "vk_render_pass.h"
 #include "vk_shader_module.h"
+#include "vk_shader_registry.h"
 #include "vk_stringify.h"
 #include "vk_surface_properties.h"
 #include "vk_sync.h"
@@ -91,6 +95,9 @@ struct Renderer::Impl
         if (!createLogicalDevice())
             return false;
 
+        if (!createPipelineCache())
+            return false;
+
         if (!createSwapchain())
             return false;
 
@@ -148,12 +155,35 @@ struct Renderer::Impl
 
         device = std::make_shared<LogicalDevice>(physicalDevice);
         device->setExtensions( { VK_KHR_SWAPCHAIN_EXTENSION_NAME });
+
+        // PBR renderer indexes the material texture array dynamically,
+        // cube bakes render into layered framebuffers and compute into
+        // storage images of any format if supported by the device.
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+        VkPhysicalDeviceFeatures features = device->features();
+        features.shaderSampledImageArrayDynamicIndexing =
+            supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+        features.geometryShader = supportedFeatures.geometryShader;
+        features.shaderStorageImageWriteWithoutFormat =
+            supportedFeatures.shaderStorageImageWriteWithoutFormat;
+        device->setFeatures(features);
+
         device->addQueueFamily(graphicsFamilyIndex,     1, 1.0f);
         if (graphicsFamilyIndex != presentationFamilyIndex)
             device->addQueueFamily(presentationFamilyIndex, 1, 1.0f);
         return device->create();
     }
 
+    // Pipelines of the device are created with the persistent cache.
+    bool createPipelineCache()
+    {
+        pipelineCache = std::make_shared<PipelineCache>(
+            physicalDevice,
+            device->handle());
+        return pipelineCache->create();
+    }
+
     bool createRenderPass()
     {
         // Colorbuffer attachment description
@@ -259,20 +289,33 @@ struct Renderer::Impl
             if (m->material->type == Material::Type::Pbr)
                 meshManager->addPbrMesh(m->mesh);
 
-        atmosphereRenderer = std::make_shared<AtmosphereRenderer>(
-            physicalDevice,
-            device->handle(),
-            graphicsFamilyIndex);
-        atmosphereRenderer->setLightDir(scene->light.dir);
-        atmosphereRenderer->render();
+        // Culling and shadow caster selection query the models from the
+        // spatial index of the scene, the renderers read the transforms of
+        // the models from the transform store of the scene.
+        scene->updateTransforms();
+        scene->buildBvh();
+
+        // Baked cubes use the smallest HDR format that can be rendered,
+        // blitted and sampled linearly.
+        const PhysicalDeviceInfo deviceInfo(physicalDevice, instance);
+        VkFormat cubeFormat = helper::findFormat(
+            deviceInfo.formats,
+            { VK_FORMAT_B10G11R11_UFLOAT_PACK32,
+              VK_FORMAT_E5B9G9R9_UFLOAT_PACK32,
+              VK_FORMAT_R16G16B16A16_SFLOAT },
+            VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT |
+            VK_FORMAT_FEATURE_BLIT_SRC_BIT         |
+            VK_FORMAT_FEATURE_BLIT_DST_BIT         |
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+        if (cubeFormat == VK_FORMAT_UNDEFINED)
+            cubeFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
 
         skyRenderer = std::make_shared<SkyRenderer>(
             physicalDevice,
             device->handle(),
             graphicsFamilyIndex,
             extent,
-            renderPass->handle(),
-            atmosphereRenderer->textureCube());
+            renderPass->handle());
         skyRenderer->setScene(scene);
 
         shadowMapRenderer = std::make_shared<ShadowMapRenderer>(
@@ -280,7 +323,6 @@ struct Renderer::Impl
                     device->handle(),
                     graphicsFamilyIndex,
                     meshManager);
-        shadowMapRenderer->setScene(scene);
 
         shadowMapDepthRenderer = std::make_shared<ShadowMapDepth>(
                     physicalDevice,
@@ -289,15 +331,45 @@ struct Renderer::Impl
                     renderPass->handle());
         shadowMapDepthRenderer->setShadowMap(shadowMapRenderer->texture());
 
+        // Pipelines of the renderers above are compiled on worker threads
+        // while the environment is baked. Bakes are restored from the cache
+        // if the parameters and shaders have not changed.
+        environmentBaker = std::make_shared<EnvironmentBaker>(
+            physicalDevice,
+            device->handle(),
+            graphicsFamilyIndex,
+            cubeFormat);
+        environmentBaker->setLightDir(scene->light.dir);
+
+        // KUU_CPU_BAKE=1 bakes the atmosphere and the BRDF LUT with the
+        // CPU, KUU_VALIDATE_BAKE=1 compares the CPU and GPU bakes first.
+        environmentBaker->setCpuBake(qgetenv("KUU_CPU_BAKE") == "1");
+        if (qgetenv("KUU_VALIDATE_BAKE") == "1" &&
+            !environmentBaker->validateCpuBake())
+        {
+            std::cerr << __FUNCTION__
+                      << ": CPU bake does not match the GPU bake"
+                      << std::endl;
+        }
+
+        if (!environmentBaker->bake())
+            return false;
+
+        // Records the shadow map commands, needs the shadow pipeline.
+        shadowMapRenderer->setScene(scene);
+
         pbrRenderer = std::make_shared<PbrRenderer>(
             physicalDevice,
             device->handle(),
             graphicsFamilyIndex,
             extent,
             renderPass->handle(),
-            atmosphereRenderer->textureCube(),
+            environmentBaker->irradiance(),
+            environmentBaker->prefiltered(),
+            environmentBaker->brdfLut(),
             meshManager);
         pbrRenderer->setShadowMap(shadowMapRenderer->texture());
+        pbrRenderer->setFrameCount(swapchainImageCount);
         pbrRenderer->setScene(scene);
 
         return true;
@@ -318,62 +390,72 @@ struct Renderer::Impl
                 swapchainImageCount);
 
         for (size_t i = 0; i < commandBuffers.size(); i++)
-        {
-            VkCommandBufferBeginInfo beginInfo;
-            beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            beginInfo.pNext            = NULL;
-            beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-            beginInfo.pInheritanceInfo = NULL;
-
-            vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
-
-            std::vector<VkClearValue> clearValues(2);
-            clearValues[0].color        = { 0.1f, 0.1f, 0.1f, 1.0f };
-            clearValues[1].depthStencil = { 1.0f, 0 };
-
-            VkRenderPassBeginInfo renderPassInfo;
-            renderPassInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderPassInfo.pNext             = NULL;
-            renderPassInfo.renderPass        = renderPass->handle();
-            renderPassInfo.framebuffer       = renderPass->framebuffer(uint32_t(i));
-            renderPassInfo.renderArea.offset = { 0, 0 };
-            renderPassInfo.renderArea.extent = extent;
-            renderPassInfo.clearValueCount   = uint32_t(clearValues.size());
-            renderPassInfo.pClearValues      = clearValues.data();
-
-            vkCmdBeginRenderPass(
-                commandBuffers[i],
-                &renderPassInfo,
-                VK_SUBPASS_CONTENTS_INLINE);
-
-            VkViewport viewport;
-            viewport.x        = 0;
-            viewport.y        = 0;
-            viewport.width    = float(extent.width);
-            viewport.height   = float(extent.height);
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-            vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
-
-            VkRect2D scissor;
-            scissor.offset = {};
-            scissor.extent = extent;
-            vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
-
-            skyRenderer->recordCommands(commandBuffers[i]);
-            pbrRenderer->recordCommands(commandBuffers[i]);
-            //shadowMapDepthRenderer->recordCommands(commandBuffers[i]);
-
-            vkCmdEndRenderPass(commandBuffers[i]);
-            const VkResult result = vkEndCommandBuffer(commandBuffers[i]);
-            if (result != VK_SUCCESS)
-            {
-                std::cerr << __FUNCTION__
-                          << ": render commands failed as "
-                          << vk::stringify::resultDesc(result)
-                          << std::endl;
+            if (!recordCommandBuffer(uint32_t(i)))
                 return false;
-            }
+
+        return true;
+    }
+
+    // Records the frame commands of the swapchain image.
+    bool recordCommandBuffer(uint32_t i)
+    {
+        VkCommandBufferBeginInfo beginInfo;
+        beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.pNext            = NULL;
+        beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+        beginInfo.pInheritanceInfo = NULL;
+
+        vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
+
+        std::vector<VkClearValue> clearValues(2);
+        clearValues[0].color        = { 0.1f, 0.1f, 0.1f, 1.0f };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+
+        VkRenderPassBeginInfo renderPassInfo;
+        renderPassInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.pNext             = NULL;
+        renderPassInfo.renderPass        = renderPass->handle();
+        renderPassInfo.framebuffer       = renderPass->framebuffer(i);
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = extent;
+        renderPassInfo.clearValueCount   = uint32_t(clearValues.size());
+        renderPassInfo.pClearValues      = clearValues.data();
+
+        // Sky-view LUT is computed outside of the render pass.
+        skyRenderer->recordPrepass(commandBuffers[i]);
+
+        vkCmdBeginRenderPass(
+            commandBuffers[i],
+            &renderPassInfo,
+            VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport;
+        viewport.x        = 0;
+        viewport.y        = 0;
+        viewport.width    = float(extent.width);
+        viewport.height   = float(extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
+
+        VkRect2D scissor;
+        scissor.offset = {};
+        scissor.extent = extent;
+        vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
+
+        skyRenderer->recordCommands(commandBuffers[i]);
+        pbrRenderer->recordCommands(commandBuffers[i], i);
+        //shadowMapDepthRenderer->recordCommands(commandBuffers[i]);
+
+        vkCmdEndRenderPass(commandBuffers[i]);
+        const VkResult result = vkEndCommandBuffer(commandBuffers[i]);
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": render commands failed as "
+                      << vk::stringify::resultDesc(result)
+                      << std::endl;
+            return false;
         }
 
         return true;
@@ -389,6 +471,27 @@ struct Renderer::Impl
         if (!imageAvailable->create())
             return false;
 
+        // Fences of the frame submissions, signaled when there is no
+        // submission of the swapchain image in process.
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        frameFences.resize(swapchainImageCount);
+        for (VkFence& fence : frameFences)
+        {
+            const VkResult result =
+                vkCreateFence(device->handle(), &fenceInfo, NULL, &fence);
+            if (result != VK_SUCCESS)
+            {
+                std::cerr << __FUNCTION__
+                          << ": frame fence creation failed as "
+                          << vk::stringify::resultDesc(result)
+                          << std::endl;
+                return false;
+            }
+        }
+
         return true;
     }
 
@@ -423,18 +526,55 @@ struct Renderer::Impl
             return false;
         }
 
+        // Models might have moved since the last frame.
+        scene->updateChangedTransforms();
+
+        // Time-of-day changes are baked incrementally, the PBR renderer is
+        // switched into the new maps when all of them are ready. The sky
+        // itself follows the light every frame. The baker is not updated
+        // while the frames switch maps as the next update would overwrite
+        // the previous maps that frames in flight might still read.
+        environmentBaker->setLightDir(scene->light.dir);
+        if (!pbrRenderer->isUpdatingDescriptors() && environmentBaker->update())
+            pbrRenderer->setIblMaps(environmentBaker->irradiance(),
+                                    environmentBaker->prefiltered(),
+                                    environmentBaker->brdfLut());
+
+        // Texture residency follows the visibility of the uniform update.
         skyRenderer->updateUniformBuffers();
         pbrRenderer->updateUniformBuffers();
+        pbrRenderer->updateTextureResidency();
+
+        // IBL and texture descriptors are rewritten per frame, only the
+        // previous submission of this swapchain image is waited. Descriptor
+        // writes invalidate the recorded commands of the frame, they are
+        // recorded again before the frame is submitted.
+        VkFence& frameFence = frameFences[imageIndex];
+        if (pbrRenderer->isOutdated(imageIndex))
+        {
+            vkWaitForFences(device->handle(), 1, &frameFence, VK_TRUE,
+                            std::numeric_limits<uint64_t>::max());
+            pbrRenderer->updateDescriptors(imageIndex);
+
+            graphicsCommandPool->freeBuffers( { commandBuffers[imageIndex] } );
+            commandBuffers[imageIndex] =
+                graphicsCommandPool->allocateBuffer(
+                    VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+            if (!recordCommandBuffer(imageIndex))
+                return false;
+        }
 
         shadowMapRenderer->render();
 
         // Render
         Queue graphicsQueue(device->handle(), graphicsFamilyIndex, 0);
         graphicsQueue.create();
+        vkResetFences(device->handle(), 1, &frameFence);
         graphicsQueue.submit(commandBuffers[imageIndex],
                              renderingFinished->handle(),
                              imageAvailable->handle(),
-                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             frameFence);
 
         // Present
         Queue presentQueue(device->handle(), presentationFamilyIndex, 0);
@@ -484,15 +624,20 @@ struct Renderer::Impl
         shadowMapDepthRenderer.reset();
         skyRenderer.reset();
         pbrRenderer.reset();
-        atmosphereRenderer.reset();
+        environmentBaker.reset();
 
         graphicsCommandPool->destroy();
         commandBuffers.clear();
         renderingFinished->destroy();
         imageAvailable->destroy();
+        for (VkFence fence : frameFences)
+            vkDestroyFence(device->handle(), fence, NULL);
+        frameFences.clear();
 
         swapchain->destroy();
         renderPass->destroy();
+        shader_registry::release(device->handle());
+        pipelineCache->destroy();
         device->destroy();
     }
 
@@ -525,6 +670,9 @@ struct Renderer::Impl
     // Device.
     std::shared_ptr<LogicalDevice> device;
 
+    // Pipeline cache of the device, saved when the device is destroyed.
+    std::shared_ptr<PipelineCache> pipelineCache;
+
     // Render pass.
     std::shared_ptr<RenderPass> renderPass;
 
@@ -539,12 +687,13 @@ struct Renderer::Impl
     // Sync
     std::shared_ptr<Semaphore> renderingFinished;
     std::shared_ptr<Semaphore> imageAvailable;
+    std::vector<VkFence> frameFences;
 
     // Scene
     const std::shared_ptr<Scene> scene;
 
     // Sub-renderers
-    std::shared_ptr<AtmosphereRenderer> atmosphereRenderer;
+    std::shared_ptr<EnvironmentBaker> environmentBaker;
     std::shared_ptr<PbrRenderer> pbrRenderer;
     std::shared_ptr<SkyRenderer> skyRenderer;
     std::shared_ptr<ShadowMapRenderer> shadowMapRenderer;
@@ -6,6 +6,8 @@
 #include "vk_shader_module.h"
 #include <fstream>
 #include <iostream>
+#include "vk_object_key.h"
+#include "vk_shader_registry.h"
 #include "vk_stringify.h"
 
 namespace kuu
@@ -92,11 +94,14 @@ struct ShaderModule::Impl
             return false;
         }
 
+        object_key::addShaderModule(shaderModule, info);
+
         return true;
     }
 
     void destroy()
     {
+        object_key::removeShaderModule(shaderModule);
         vkDestroyShaderModule(
             logicalDevice,
             shaderModule,
@@ -131,7 +136,10 @@ ShaderModule::ShaderModule(const VkDevice& device)
 ShaderModule::ShaderModule(const VkDevice& device, const std::string& filePath)
     : impl(std::make_shared<Impl>(device))
 {
-    impl->source = readShaderSourceFile(filePath);
+    // Prefer the SPIR-V embedded into the binary.
+    impl->source = shader_registry::embeddedSource(filePath);
+    if (impl->source.empty())
+        impl->source = readShaderSourceFile(filePath);
 }
 
 ShaderModule& ShaderModule::setStage(VkShaderStageFlagBits stage)
@@ -0,0 +1,107 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The implementation of kuu::vk::shader_registry namespace.
+ * -------------------------------------------------------------------------- */
+
+#include "vk_shader_registry.h"
+
+/* -------------------------------------------------------------------------- */
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+/* -------------------------------------------------------------------------- */
+
+#include "vk_shader_module.h"
+
+namespace kuu
+{
+namespace vk
+{
+namespace shader_registry
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Generated by the build from the GLSL sources.
+extern const EmbeddedShader EMBEDDED_SHADERS[];
+extern const size_t EMBEDDED_SHADER_COUNT;
+
+namespace
+{
+
+/* -------------------------------------------------------------------------- */
+
+// Shader modules by the device, file and stage.
+typedef std::tuple<VkDevice, std::string, VkShaderStageFlagBits> ModuleKey;
+std::map<ModuleKey, std::shared_ptr<ShaderModule>> modules;
+std::mutex modulesMutex;
+
+} // anonymous namespace
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<char> embeddedSource(const std::string& filePath)
+{
+    for (size_t i = 0; i < EMBEDDED_SHADER_COUNT; ++i)
+    {
+        const EmbeddedShader& shader = EMBEDDED_SHADERS[i];
+        if (filePath != shader.filePath)
+            continue;
+
+        std::vector<char> source(shader.size);
+        std::memcpy(source.data(), shader.code, shader.size);
+        return source;
+    }
+    return std::vector<char>();
+}
+
+/* -------------------------------------------------------------------------- */
+
+std::shared_ptr<ShaderModule> module(const VkDevice& device,
+                                     const std::string& filePath,
+                                     VkShaderStageFlagBits stage)
+{
+    std::lock_guard<std::mutex> lock(modulesMutex);
+
+    const ModuleKey key(device, filePath, stage);
+    const auto it = modules.find(key);
+    if (it != modules.end())
+        return it->second;
+
+    std::shared_ptr<ShaderModule> module =
+        std::make_shared<ShaderModule>(device, filePath);
+    module->setStageName("main");
+    module->setStage(stage);
+    if (!module->create())
+        return nullptr;
+
+    modules[key] = module;
+    return module;
+}
+
+/* -------------------------------------------------------------------------- */
+
+void release(const VkDevice& device)
+{
+    std::lock_guard<std::mutex> lock(modulesMutex);
+
+    for (auto it = modules.begin(); it != modules.end();)
+    {
+        if (std::get<0>(it->first) == device)
+        {
+            it->second->destroy();
+            it = modules.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+} // namespace shader_registry
+} // namespace vk
+} // namespace kuu
@@ -0,0 +1,62 @@
+/* -------------------------------------------------------------------------- *
+   Antti Jumpponen <kuumies@gmail.com>
+   The definition of kuu::vk::shader_registry namespace.
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+/* -------------------------------------------------------------------------- */
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace kuu
+{
+namespace vk
+{
+
+/* -------------------------------------------------------------------------- */
+
+class ShaderModule;
+
+/* -------------------------------------------------------------------------- *
+   Registry of the shaders embedded into the binary.
+
+   The build compiles the GLSL sources of src/shaders into SPIR-V arrays
+   that are linked into the binary. A shader is identified by the path of
+   its SPIR-V file, e.g. "shaders/pbr.frag.spv", so the shaders do not need
+   to be found from the disk.
+
+   Shader modules are created once per device, file and stage and shared by
+   every user. The modules of a device need to be released before the
+   device is destroyed.
+ * -------------------------------------------------------------------------- */
+namespace shader_registry
+{
+
+// SPIR-V of a shader embedded into the binary.
+struct EmbeddedShader
+{
+    const char* filePath;
+    const uint32_t* code;
+    size_t size;
+};
+
+// Returns the SPIR-V of the embedded shader. Returns an empty vector if the
+// shader is not embedded.
+std::vector<char> embeddedSource(const std::string& filePath);
+
+// Returns the shader module of the device. The module is created on the
+// first request. Returns null if the module could not be created.
+std::shared_ptr<ShaderModule> module(const VkDevice& device,
+                                     const std::string& filePath,
+                                     VkShaderStageFlagBits stage);
+
+// Releases the shader modules of the device.
+void release(const VkDevice& device);
+
+} // namespace shader_registry
+} // namespace vk
+} // namespace kuu
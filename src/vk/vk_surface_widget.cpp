@@ -94,6 +94,8 @@ struct SurfaceWidget::Impl
 
     // Start dragging pos
     QPoint startPos;
+    // True if the mouse has moved since the button press.
+    bool dragged = false;
 };
 
 /* -------------------------------------------------------------------------- */
@@ -154,16 +156,20 @@ void SurfaceWidget::wheelEvent(QWheelEvent* e)
 void SurfaceWidget::mousePressEvent(QMouseEvent* e)
 {
     impl->startPos = e->pos();
+    impl->dragged  = false;
 }
 
 void SurfaceWidget::mouseMoveEvent(QMouseEvent* e)
 {
     emit mouseMove(e->pos() - impl->startPos, e->buttons(), e->modifiers());
     impl->startPos = e->pos();
+    impl->dragged  = true;
 }
 
 void SurfaceWidget::mouseReleaseEvent(QMouseEvent* e)
 {
+    if (!impl->dragged)
+        emit mouseClick(e->pos(), e->button(), e->modifiers());
     impl->startPos = QPoint();
 }
 
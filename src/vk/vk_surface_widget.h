@@ -52,6 +52,9 @@ signals:
     void resized();
     void wheel(int delta);
     void mouseMove(const QPoint& pos, int buttons, int modifiers);
+    // Mouse button was released without moving the mouse, pos is in the
+    // widget coordinates.
+    void mouseClick(const QPoint& pos, int button, int modifiers);
     void key(int key, int modifiers, bool down);
 
 protected:
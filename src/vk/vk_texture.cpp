@@ -4,9 +4,12 @@
  * -------------------------------------------------------------------------- */
 
 #include "vk_texture.h"
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <QtCore/QTime>
 #include <QtGui/QImage>
+#include <QtGui/QImageReader>
 #include "vk_buffer.h"
 #include "vk_command.h"
 #include "vk_helper.h"
@@ -178,7 +181,8 @@ VkSampler createSampler(const VkDevice& device,
                         const VkSamplerAddressMode& addressModeU,
                         const VkSamplerAddressMode& addressModeV,
                         const VkSamplerAddressMode& addressModeW,
-                        const uint32_t& mipLevels)
+                        const uint32_t& mipLevels,
+                        const float minLod = 0.0f)
 {
     VkSamplerCreateInfo info = {};
     info.sType                   = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -195,7 +199,7 @@ VkSampler createSampler(const VkDevice& device,
     info.compareOp               = VK_COMPARE_OP_ALWAYS;
     info.mipmapMode              = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     info.mipLodBias              = 0.0f;
-    info.minLod                  = 0.0f;
+    info.minLod                  = minLod;
     info.maxLod                  = float(mipLevels);
 
     VkSampler sampler;
@@ -245,6 +249,10 @@ bool commandTransitionImageLayout(
         srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
         break;
 
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+        srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        break;
+
     default:
         std::cerr << __FUNCTION__
                   << ": old image layout transition is not supported"
@@ -444,12 +452,13 @@ bool textureFromImage(const VkDevice& device,
                       VkImage& image,
                       VkImageView& imageView,
                       VkSampler& sampler,
-                      VkDeviceMemory& memory)
+                      VkDeviceMemory& memory,
+                      uint32_t& mipmapCount)
 {
     VkExtent3D extent = { uint32_t(img.width()), uint32_t(img.height()), 1 };
 
     // Calc. mipmap count.
-    uint32_t mipmapCount = 1;
+    mipmapCount = 1;
     if (generateMipmaps)
         mipmapCount = uint32_t(std::floor(std::log2(std::max(img.width(), img.height())))) + 1;
 
@@ -506,14 +515,253 @@ struct Texture2D::Impl
 
     ~Impl()
     {
+        // Image needs to be alive until the upload has been processed.
+        if (uploadFence != VK_NULL_HANDLE)
+        {
+            vkWaitForFences(device, 1, &uploadFence, VK_TRUE,
+                            std::numeric_limits<uint64_t>::max());
+            freeUpload();
+        }
+
+        vkDestroySampler(device, retiredSampler, NULL);
         vkDestroySampler(device, self->sampler, NULL);
         vkDestroyImageView(device,  self->imageView, NULL);
         vkDestroyImage(device,  self->image, NULL);
         vkFreeMemory(device, self->memory, NULL);
     }
 
+    // Submits the upload commands with a fence. The upload is retired in
+    // retireUpload after the device has processed it, the resident level
+    // is set into first level then.
+    bool submitUpload(Queue& queue,
+                      CommandPool& commandPool,
+                      const VkCommandBuffer& cmdBuf,
+                      std::shared_ptr<Buffer> buffer,
+                      uint32_t firstLevel)
+    {
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        VkFence fence = VK_NULL_HANDLE;
+        const VkResult result = vkCreateFence(device, &fenceInfo, NULL, &fence);
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": upload fence creation failed as "
+                      << vk::stringify::result(result)
+                      << std::endl;
+            commandPool.freeBuffers({ cmdBuf });
+            return false;
+        }
+
+        if (!queue.submit(cmdBuf, VK_NULL_HANDLE, VK_NULL_HANDLE, 0, fence))
+        {
+            vkDestroyFence(device, fence, NULL);
+            commandPool.freeBuffers({ cmdBuf });
+            return false;
+        }
+
+        uploadFence       = fence;
+        uploadCmdBuf      = cmdBuf;
+        uploadCommandPool = &commandPool;
+        uploadBuffer      = buffer;
+        uploadLevel       = firstLevel;
+        return true;
+    }
+
+    // Frees the fence, the command buffer and the staging buffer of the
+    // processed upload.
+    void freeUpload()
+    {
+        vkDestroyFence(device, uploadFence, NULL);
+        uploadCommandPool->freeBuffers({ uploadCmdBuf });
+
+        uploadFence       = VK_NULL_HANDLE;
+        uploadCmdBuf      = VK_NULL_HANDLE;
+        uploadCommandPool = nullptr;
+        uploadBuffer.reset();
+    }
+
+    // Decodes the streamed image file scaled into the extent of the level.
+    // The texture format is set from the first decoded image, the image is
+    // converted into the texture format.
+    QImage decodeLevel(uint32_t level)
+    {
+        QImageReader reader(QString::fromStdString(filePath));
+        if (level > 0)
+            reader.setScaledSize(
+                QSize(int(std::max(self->extent.width  >> level, 1u)),
+                      int(std::max(self->extent.height >> level, 1u))));
+
+        QImage img = reader.read();
+        if (img.isNull())
+        {
+            std::cerr << __FUNCTION__
+                      << ": failed to decode image "
+                      << filePath
+                      << std::endl;
+            return img;
+        }
+
+        if (self->format == VK_FORMAT_UNDEFINED)
+            self->format = img.isGrayscale() ? VK_FORMAT_R8_UNORM
+                                             : VK_FORMAT_R8G8B8A8_UNORM;
+
+        if (self->format == VK_FORMAT_R8_UNORM)
+            return img.convertToFormat(QImage::Format_Grayscale8);
+        return img.convertToFormat(QImage::Format_RGB32).rgbSwapped();
+    }
+
+    // Creates the given count of mipmap levels of streamed image on host
+    // starting from the image. Each level is scaled from the previous level.
+    std::vector<QImage> createMipmaps(const QImage& img, uint32_t count)
+    {
+        std::vector<QImage> mipmaps(count);
+        mipmaps[0] = img;
+        for (uint32_t level = 1; level < count; ++level)
+        {
+            const QImage& prev = mipmaps[level - 1];
+            const int w = std::max(prev.width()  / 2, 1);
+            const int h = std::max(prev.height() / 2, 1);
+            mipmaps[level] =
+                prev.scaled(w, h,
+                            Qt::IgnoreAspectRatio,
+                            Qt::SmoothTransformation)
+                    .convertToFormat(img.format());
+        }
+        return mipmaps;
+    }
+
+    // Submits the upload of the mipmap levels starting from the first
+    // level. The images are ordered from the first level towards the
+    // smaller levels. If initial is true then all the levels are
+    // transitioned into shader read-only layout, otherwise only the
+    // uploaded levels.
+    bool uploadLevels(Queue& queue,
+                      CommandPool& commandPool,
+                      uint32_t firstLevel,
+                      const std::vector<QImage>& levels,
+                      bool initial)
+    {
+        VkDeviceSize totalSize = 0;
+        for (const QImage& img : levels)
+            totalSize += img.byteCount();
+
+        std::shared_ptr<Buffer> buf =
+            std::make_shared<Buffer>(physicalDevice, device);
+        buf->setSize(totalSize);
+        buf->setUsage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+        buf->setMemoryProperties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (!buf->create())
+            return false;
+
+        const uint32_t bytesPerPixel = self->format == VK_FORMAT_R8_UNORM ? 1 : 4;
+
+        std::vector<VkBufferImageCopy> regions;
+        VkDeviceSize offset = 0;
+        for (size_t i = 0; i < levels.size(); ++i)
+        {
+            const QImage& img = levels[i];
+            buf->copyHostVisible(img.bits(), img.byteCount(), offset);
+
+            VkBufferImageCopy region;
+            region.bufferOffset      = offset;
+            region.bufferRowLength   = uint32_t(img.bytesPerLine()) / bytesPerPixel;
+            region.bufferImageHeight = 0;
+
+            region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel       = firstLevel + uint32_t(i);
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount     = 1;
+
+            region.imageOffset = { 0, 0, 0 };
+            region.imageExtent = { uint32_t(img.width()), uint32_t(img.height()), 1 };
+
+            regions.push_back(region);
+            offset += img.byteCount();
+        }
+
+        uint32_t transitionFirst = firstLevel;
+        uint32_t transitionEnd   = firstLevel + uint32_t(levels.size());
+        if (initial)
+        {
+            transitionFirst = 0;
+            transitionEnd   = self->mipmapCount;
+        }
+
+        // Allocate buffer for queue commands.
+        VkCommandBuffer cmdBuf =
+            commandPool.allocateBuffer(
+                VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+        // Start recording commands
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(cmdBuf, &beginInfo);
+
+        // Old content of levels is discarded.
+        for (uint32_t level = transitionFirst; level < transitionEnd; ++level)
+            commandTransitionImageLayout(
+                self->image,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                level, 1, cmdBuf);
+
+        commandCopyBufferToImage(buf->handle(), self->image, cmdBuf, regions);
+
+        for (uint32_t level = transitionFirst; level < transitionEnd; ++level)
+            commandTransitionImageLayout(
+                self->image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                level, 1, cmdBuf);
+
+        // Stop recording commands.
+        const VkResult result = vkEndCommandBuffer(cmdBuf);
+        if (result != VK_SUCCESS)
+        {
+            std::cerr << __FUNCTION__
+                      << ": failed to apply mipmap upload commands as "
+                      << vk::stringify::result(result)
+                      << std::endl;
+            return false;
+        }
+
+        // Submit commands, staging buffer is kept alive until the upload
+        // is retired.
+        if (!submitUpload(queue, commandPool, cmdBuf, buf, firstLevel))
+            return false;
+
+        return true;
+    }
+
     VkDevice device;
     Texture2D* self;
+
+    // Upload in process by the device.
+    VkFence uploadFence = VK_NULL_HANDLE;
+    VkCommandBuffer uploadCmdBuf = VK_NULL_HANDLE;
+    CommandPool* uploadCommandPool = nullptr;
+    std::shared_ptr<Buffer> uploadBuffer;
+    uint32_t uploadLevel = 0;
+    // Sampler replaced when an upload was retired, it is destroyed when
+    // the next upload is retired.
+    VkSampler retiredSampler = VK_NULL_HANDLE;
+
+    // Streaming state. Host levels are decoded from the file only for the
+    // upload, they are released once they are in the staging buffer.
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    std::string filePath;
+    VkFilter magFilter = VK_FILTER_LINEAR;
+    VkFilter minFilter = VK_FILTER_LINEAR;
+    VkSamplerAddressMode addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    VkSamplerAddressMode addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 };
 
 /* -------------------------------------------------------------------------- */
@@ -523,6 +771,9 @@ Texture2D::Texture2D(const VkDevice& device)
     , image(VK_NULL_HANDLE)
     , imageView(VK_NULL_HANDLE)
     , sampler(VK_NULL_HANDLE)
+    , memory(VK_NULL_HANDLE)
+    , mipmapCount(0)
+    , residentLevel(0)
     , impl(std::make_shared<Impl>(device, this))
 {}
 
@@ -540,6 +791,9 @@ Texture2D::Texture2D(const VkPhysicalDevice& physicalDevice,
     , image(VK_NULL_HANDLE)
     , imageView(VK_NULL_HANDLE)
     , sampler(VK_NULL_HANDLE)
+    , memory(VK_NULL_HANDLE)
+    , mipmapCount(0)
+    , residentLevel(0)
     , impl(std::make_shared<Impl>(device, this))
 {
     // Load image
@@ -595,7 +849,8 @@ Texture2D::Texture2D(const VkPhysicalDevice& physicalDevice,
                      image,
                      imageView,
                      sampler,
-                     memory);
+                     memory,
+                     mipmapCount);
 
     // Stop recording commands.
     const VkResult result = vkEndCommandBuffer(cmdBuf);
@@ -617,6 +872,182 @@ Texture2D::Texture2D(const VkPhysicalDevice& physicalDevice,
         return;
 }
 
+Texture2D::Texture2D(const VkPhysicalDevice& physicalDevice,
+                     const VkDevice& device,
+                     Queue& queue,
+                     CommandPool& commandPool,
+                     const std::string& filePath,
+                     VkFilter magFilter,
+                     VkFilter minFilter,
+                     VkSamplerAddressMode addressModeU,
+                     VkSamplerAddressMode addressModeV,
+                     VkDeviceSize uploadBudget)
+    : format(VK_FORMAT_UNDEFINED)
+    , image(VK_NULL_HANDLE)
+    , imageView(VK_NULL_HANDLE)
+    , sampler(VK_NULL_HANDLE)
+    , memory(VK_NULL_HANDLE)
+    , mipmapCount(0)
+    , residentLevel(0)
+    , impl(std::make_shared<Impl>(device, this))
+{
+    // Only the size is read here, the image is decoded per level.
+    QImageReader reader(QString::fromStdString(filePath));
+    const QSize size = reader.size();
+    if (!size.isValid())
+    {
+        std::cerr << __FUNCTION__
+                  << ": failed to read the size of image "
+                  << filePath
+                  << std::endl;
+        return;
+    }
+
+    impl->physicalDevice = physicalDevice;
+    impl->filePath       = filePath;
+    impl->magFilter      = magFilter;
+    impl->minFilter      = minFilter;
+    impl->addressModeU   = addressModeU;
+    impl->addressModeV   = addressModeV;
+
+    extent = { uint32_t(size.width()), uint32_t(size.height()) };
+    mipmapCount = uint32_t(std::floor(std::log2(std::max(size.width(), size.height())))) + 1;
+
+    // Find the smallest levels that fit into upload budget. Format is not
+    // known before decoding so four bytes per pixel is assumed.
+    VkDeviceSize bytes = 0;
+    uint32_t level = mipmapCount;
+    while (level > 0)
+    {
+        const VkDeviceSize levelBytes =
+            VkDeviceSize(std::max(extent.width  >> (level - 1), 1u)) *
+            VkDeviceSize(std::max(extent.height >> (level - 1), 1u)) * 4;
+        if (level < mipmapCount && bytes + levelBytes > uploadBudget)
+            break;
+
+        bytes += levelBytes;
+        level--;
+    }
+
+    // Decode the first uploaded level and create the smaller levels on
+    // host. The finer levels are decoded when they are streamed.
+    const QImage img = impl->decodeLevel(level);
+    if (img.isNull())
+        return;
+    const std::vector<QImage> levels =
+        impl->createMipmaps(img, mipmapCount - level);
+
+    // Create image.
+    VkExtent3D imageExtent = { extent.width, extent.height, 1 };
+    image = createImage(
+        device,
+        format,
+        imageExtent,
+        mipmapCount,
+        1,
+        0);
+    if (image == VK_NULL_HANDLE)
+        return;
+
+    // Allocate memory.
+    memory = allocateMemory(physicalDevice, device, image);
+    if (memory == VK_NULL_HANDLE)
+        return;
+
+    // Create view.
+    imageView = createImageView(device, image, format, mipmapCount, VK_IMAGE_VIEW_TYPE_2D, 1);
+    if (imageView == VK_NULL_HANDLE)
+        return;
+
+    // Texture is not in use so the sampler is clamped to the submitted
+    // levels right away.
+    if (!impl->uploadLevels(queue, commandPool, level, levels, true))
+        return;
+
+    residentLevel = level;
+    sampler = createSampler(device,
+                            magFilter,
+                            minFilter,
+                            addressModeU,
+                            addressModeV,
+                            VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                            mipmapCount,
+                            float(level));
+}
+
+VkDeviceSize Texture2D::streamMipmaps(Queue& queue,
+                                      CommandPool& commandPool,
+                                      VkDeviceSize byteBudget)
+{
+    if (residentLevel == 0 || impl->filePath.empty() || isUploading())
+        return 0;
+
+    // Find the next finer levels that fit into budget.
+    const VkDeviceSize bytesPerPixel = format == VK_FORMAT_R8_UNORM ? 1 : 4;
+    VkDeviceSize bytes = 0;
+    uint32_t level = residentLevel;
+    while (level > 0)
+    {
+        const VkDeviceSize levelBytes =
+            VkDeviceSize(std::max(extent.width  >> (level - 1), 1u)) *
+            VkDeviceSize(std::max(extent.height >> (level - 1), 1u)) *
+            bytesPerPixel;
+        if (level < residentLevel && bytes + levelBytes > byteBudget)
+            break;
+
+        bytes += levelBytes;
+        level--;
+    }
+
+    // Decode each level scaled into its extent, the full resolution image
+    // is decoded only when the top level is streamed.
+    std::vector<QImage> levels;
+    for (uint32_t l = level; l < residentLevel; ++l)
+    {
+        const QImage img = impl->decodeLevel(l);
+        if (img.isNull())
+            return 0;
+        levels.push_back(img);
+    }
+
+    // Host levels are released when they go out of scope, the upload
+    // reads from the staging buffer.
+    if (!impl->uploadLevels(queue, commandPool, level, levels, false))
+        return 0;
+    return bytes;
+}
+
+bool Texture2D::isUploading() const
+{ return impl->uploadFence != VK_NULL_HANDLE; }
+
+bool Texture2D::retireUpload()
+{
+    if (!isUploading())
+        return false;
+    if (vkGetFenceStatus(impl->device, impl->uploadFence) != VK_SUCCESS)
+        return false;
+
+    impl->freeUpload();
+    if (impl->uploadLevel == residentLevel)
+        return true;
+
+    // Clamp sampler to resident levels. The previous sampler might be in
+    // use until the descriptors have been re-written.
+    vkDestroySampler(impl->device, impl->retiredSampler, NULL);
+    impl->retiredSampler = sampler;
+
+    residentLevel = impl->uploadLevel;
+    sampler = createSampler(impl->device,
+                            impl->magFilter,
+                            impl->minFilter,
+                            impl->addressModeU,
+                            impl->addressModeV,
+                            VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                            mipmapCount,
+                            float(residentLevel));
+    return true;
+}
+
 Texture2D::Texture2D(const VkPhysicalDevice& physicalDevice,
                      const VkDevice& device,
                      const VkExtent2D& extent,
@@ -632,9 +1063,11 @@ Texture2D::Texture2D(const VkPhysicalDevice& physicalDevice,
     , image(VK_NULL_HANDLE)
     , imageView(VK_NULL_HANDLE)
     , sampler(VK_NULL_HANDLE)
+    , memory(VK_NULL_HANDLE)
+    , mipmapCount(1)
+    , residentLevel(0)
     , impl(std::make_shared<Impl>(device, this))
 {
-    const uint32_t mipmapCount = 1;
 
     // Create image.
     VkExtent3D imageExtent = { extent.width, extent.height, 1 };
@@ -665,6 +1098,162 @@ Texture2D::Texture2D(const VkPhysicalDevice& physicalDevice,
         return;
 }
 
+Texture2D::Texture2D(const VkPhysicalDevice& physicalDevice,
+                     const VkDevice& device,
+                     Queue& queue,
+                     CommandPool& commandPool,
+                     const Texture2D& source,
+                     uint32_t skipLevels,
+                     VkFilter magFilter,
+                     VkFilter minFilter,
+                     VkSamplerAddressMode addressModeU,
+                     VkSamplerAddressMode addressModeV)
+    : format(source.format)
+    , image(VK_NULL_HANDLE)
+    , imageView(VK_NULL_HANDLE)
+    , sampler(VK_NULL_HANDLE)
+    , memory(VK_NULL_HANDLE)
+    , mipmapCount(0)
+    , residentLevel(0)
+    , impl(std::make_shared<Impl>(device, this))
+{
+    if (skipLevels >= source.mipmapCount)
+    {
+        std::cerr << __FUNCTION__
+                  << ": source texture has only "
+                  << source.mipmapCount
+                  << " mipmap levels"
+                  << std::endl;
+        return;
+    }
+
+    mipmapCount = source.mipmapCount - skipLevels;
+    extent = { std::max(source.extent.width  >> skipLevels, 1u),
+               std::max(source.extent.height >> skipLevels, 1u) };
+
+    // Create image.
+    VkExtent3D imageExtent = { extent.width, extent.height, 1 };
+    image = createImage(
+        device,
+        format,
+        imageExtent,
+        mipmapCount,
+        1,
+        0);
+    if (image == VK_NULL_HANDLE)
+        return;
+
+    // Allocate memory.
+    memory = allocateMemory(physicalDevice, device, image);
+    if (memory == VK_NULL_HANDLE)
+        return;
+
+    // Create view.
+    imageView = createImageView(device, image, format, mipmapCount, VK_IMAGE_VIEW_TYPE_2D, 1);
+    if (imageView == VK_NULL_HANDLE)
+        return;
+
+    // Create sampler.
+    sampler = createSampler(device, magFilter, minFilter, addressModeU, addressModeV, VK_SAMPLER_ADDRESS_MODE_REPEAT, mipmapCount);
+    if (sampler == VK_NULL_HANDLE)
+        return;
+
+    // Allocate buffer for queue commands.
+    VkCommandBuffer cmdBuf =
+        commandPool.allocateBuffer(
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    // Start recording commands
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmdBuf, &beginInfo);
+
+    for (uint32_t i = 0; i < mipmapCount; ++i)
+    {
+        const uint32_t srcLevel = i + skipLevels;
+
+        commandTransitionImageLayout(
+            source.image,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            srcLevel, 1, cmdBuf);
+
+        commandTransitionImageLayout(
+            image,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            i, 1, cmdBuf);
+
+        VkImageCopy region = {};
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.mipLevel   = srcLevel;
+        region.srcSubresource.layerCount = 1;
+        region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.dstSubresource.mipLevel   = i;
+        region.dstSubresource.layerCount = 1;
+        region.extent.width  = std::max(extent.width  >> i, 1u);
+        region.extent.height = std::max(extent.height >> i, 1u);
+        region.extent.depth  = 1;
+
+        vkCmdCopyImage(
+            cmdBuf,
+            source.image,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &region);
+
+        commandTransitionImageLayout(
+            source.image,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            srcLevel, 1, cmdBuf);
+
+        commandTransitionImageLayout(
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            i, 1, cmdBuf);
+    }
+
+    // Stop recording commands.
+    const VkResult result = vkEndCommandBuffer(cmdBuf);
+    if (result != VK_SUCCESS)
+    {
+        std::cerr << __FUNCTION__
+                  << ": failed to apply mipmap copy commands as "
+                  << vk::stringify::result(result)
+                  << std::endl;
+        return;
+    }
+
+    // Submit commands, source texture needs to be alive until the copy is
+    // retired.
+    impl->submitUpload(queue, commandPool, cmdBuf, nullptr, 0);
+}
+
+VkDeviceSize Texture2D::memorySize() const
+{
+    if (image == VK_NULL_HANDLE)
+        return 0;
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(
+        impl->device,
+        image,
+        &memoryRequirements);
+    return memoryRequirements.size;
+}
+
 /* -------------------------------------------------------------------------- */
 
 std::map<std::string, std::shared_ptr<Texture2D>>
@@ -735,7 +1324,9 @@ std::map<std::string, std::shared_ptr<Texture2D>>
                          tex->image,
                          tex->imageView,
                          tex->sampler,
-                         tex->memory);
+                         tex->memory,
+                         tex->mipmapCount);
+        tex->extent = { uint32_t(images[f].width()), uint32_t(images[f].height()) };
 
         results[filepaths[f]] = tex;
     }
@@ -797,6 +1388,7 @@ TextureCube::TextureCube(
         VkSamplerAddressMode addressModeV,
         VkSamplerAddressMode addressModeW)
     : format(VK_FORMAT_UNDEFINED)
+    , extent({ 0, 0 })
     , image(VK_NULL_HANDLE)
     , imageView(VK_NULL_HANDLE)
     , sampler(VK_NULL_HANDLE)
@@ -844,6 +1436,7 @@ TextureCube::TextureCube(
     extent.width  = images[0].width();
     extent.height = images[0].height();
     extent.depth  = 1;
+    this->extent  = { extent.width, extent.height };
 
     // Crate texture cube image
     format = VK_FORMAT_R8G8B8A8_UNORM;
@@ -967,6 +1560,7 @@ TextureCube::TextureCube(const VkPhysicalDevice& physicalDevice,
                          VkSamplerAddressMode addressModeW,
                          bool mipmaps)
     : format(format)
+    , extent({ extent.width, extent.height })
     , image(VK_NULL_HANDLE)
     , imageView(VK_NULL_HANDLE)
     , sampler(VK_NULL_HANDLE)
@@ -976,6 +1570,18 @@ TextureCube::TextureCube(const VkPhysicalDevice& physicalDevice,
     if (mipmaps)
         mipmapCount = uint32_t((floor(log2(extent.width))) + 1);
 
+    // Compute shaders can write into texture if the format supports
+    // storage images. Texture can be read back e.g. into the bake cache.
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT     |
+                              VK_IMAGE_USAGE_TRANSFER_DST_BIT     |
+                              VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                              VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+    if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)
+        usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+
     // Crate texture cube image
     image = createImage(device,
                         format,
@@ -983,7 +1589,7 @@ TextureCube::TextureCube(const VkPhysicalDevice& physicalDevice,
                         mipmapCount,
                         6,
                         VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT,
-                        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+                        usage);
 
     // Allocate memory.
     memory = allocateMemory(physicalDevice, device, image);
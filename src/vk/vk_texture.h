@@ -37,6 +37,22 @@ struct Texture2D
               VkSamplerAddressMode addressModeU,
               VkSamplerAddressMode addressModeV,
               bool generateMipmaps);
+    // Loads a RGBA or grayscale image from disk and creates a texture with
+    // a full mipmap chain that becomes resident from the smallest level
+    // towards the top level. Only the smallest levels that fit into the
+    // upload budget are decoded and uploaded, rest are decoded and uploaded
+    // with streamMipmaps. The sampler min LOD is clamped to the first
+    // resident level. The upload is not waited, see retireUpload.
+    Texture2D(const VkPhysicalDevice& physicalDevice,
+              const VkDevice& device,
+              Queue& queue,
+              CommandPool& commandPool,
+              const std::string& filePath,
+              VkFilter magFilter,
+              VkFilter minFilter,
+              VkSamplerAddressMode addressModeU,
+              VkSamplerAddressMode addressModeV,
+              VkDeviceSize uploadBudget);
     // Creates an empty texture with undefined layout
     Texture2D(const VkPhysicalDevice& physicalDevice,
               const VkDevice& device,
@@ -51,6 +67,41 @@ struct Texture2D
                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
                     VK_IMAGE_USAGE_SAMPLED_BIT,
              VkImageAspectFlags aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT);
+    // Creates a texture out of the mipmap levels of the source texture. The
+    // given in count of top levels are skipped so the extent of the created
+    // texture is the extent of source level skipLevels. Source texture needs
+    // to be in shader read-only layout and is left into that layout. The
+    // copy is not waited, source needs to be alive until it is retired.
+    Texture2D(const VkPhysicalDevice& physicalDevice,
+              const VkDevice& device,
+              Queue& queue,
+              CommandPool& commandPool,
+              const Texture2D& source,
+              uint32_t skipLevels,
+              VkFilter magFilter,
+              VkFilter minFilter,
+              VkSamplerAddressMode addressModeU,
+              VkSamplerAddressMode addressModeV);
+
+    // Returns the size of device memory bound to texture image.
+    VkDeviceSize memorySize() const;
+
+    // Submits the upload of the next finer mipmap levels of a streamed
+    // texture that fit into the byte budget, at least one level is
+    // uploaded. Nothing is uploaded while a previous upload is in process.
+    // Returns the count of uploaded bytes.
+    VkDeviceSize streamMipmaps(Queue& queue,
+                               CommandPool& commandPool,
+                               VkDeviceSize byteBudget);
+
+    // Returns true if an upload has been submitted and it is not retired.
+    bool isUploading() const;
+    // Retires the upload if the device has processed it. The command
+    // buffer and the staging buffer of the upload are freed. If the upload
+    // made finer levels resident then the sampler is recreated and the
+    // descriptors using the texture needs to be re-written. Returns true
+    // if the upload was retired.
+    bool retireUpload();
 
     VkFormat format;
     VkExtent2D extent;
@@ -58,6 +109,9 @@ struct Texture2D
     VkImageView imageView;
     VkSampler sampler;
     VkDeviceMemory memory;
+    uint32_t mipmapCount;
+    // First resident mipmap level, zero if all the levels are resident.
+    uint32_t residentLevel;
 
 private:
     struct Impl;
@@ -117,6 +171,7 @@ struct TextureCube
                 bool mipmaps);
 
     VkFormat format;
+    VkExtent2D extent;
     VkImage image;
     VkImageView imageView;
     VkSampler sampler;
@@ -17,6 +17,7 @@
 #include <iostream>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QMenuBar>
+#include <QtWidgets/QStatusBar>
 #include <future>
 
 /* -------------------------------------------------------------------------- */
@@ -90,6 +91,13 @@ void Controller::start()
     connect(impl->mainWindow.get(), &MainWindow::runDeviceTest,
             this, &Controller::runDeviceTest);
 
+    // Picks are shown in the status bar of the main window.
+    connect(this, &Controller::picked, [this](int modelIndex, int triangle)
+    {
+        impl->mainWindow->statusBar()->showMessage(
+            QString("Picked model %1, triangle %2").arg(modelIndex).arg(triangle));
+    });
+
     std::future<void> vulkanInstanceTask = std::async([&]()
     {
         const vk::InstanceInfo instanceInfo;
@@ -137,6 +145,9 @@ void Controller::start()
     connect(impl->surfaceWidget.get(), &vk::SurfaceWidget::mouseMove,
             this, &Controller::onSurfaceMouseMove);
 
+    connect(impl->surfaceWidget.get(), &vk::SurfaceWidget::mouseClick,
+            this, &Controller::onSurfaceMouseClick);
+
     connect(impl->surfaceWidget.get(), &vk::SurfaceWidget::key,
             this, &Controller::onSurfaceKey);
 
@@ -661,6 +672,18 @@ void Controller::onSurfaceMouseMove(const QPoint& offset, int buttons, int modif
     }
 }
 
+void Controller::onSurfaceMouseClick(const QPoint& pos, int button, int /*modifiers*/)
+{
+    if (!impl->scene || button != Qt::LeftButton)
+        return;
+
+    // Triangle hierarchies of the meshes are built when a ray first
+    // reaches the bounds of the mesh.
+    Pick pick;
+    if (impl->scene->pick(glm::vec2(pos.x(), pos.y()), pick))
+        emit picked(int(pick.modelIndex), int(pick.triangle));
+}
+
 void Controller::onSurfaceKey(int key, int modifiers, bool down)
 {
     if (down)
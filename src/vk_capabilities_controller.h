@@ -39,8 +39,14 @@ public:
     void onSurfaceResized();
     void onSurfaceWheel(int delta);
     void onSurfaceMouseMove(const QPoint& offset, int buttons, int modifiers);
+    void onSurfaceMouseClick(const QPoint& pos, int button, int modifiers);
     void onSurfaceKey(int key, int modifiers, bool down);
 
+signals:
+    // Emitted when a model triangle has been picked from the surface. The
+    // model index is the index of the model in the scene.
+    void picked(int modelIndex, int triangle);
+
 private:
     struct Impl;
     std::shared_ptr<Impl> impl;